@@ -3,9 +3,19 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
-uniform mat4 projection;
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
+
 uniform mat4 model;
-uniform mat4 view;
 
 void main()
 {
@@ -5,7 +5,18 @@ layout(location = 0) out vec4 FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D texture_diffuse1;
-uniform float time;          // Current time
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
+
 uniform float startTime;     // When the explosion starts
 uniform float duration;      // How long the explosion effect lasts
 
@@ -6,12 +6,26 @@ out VS_OUT {
     vec2 texCoords;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
+
 uniform mat4 model;
 
+// Vertex dequantization, see Mesh::SetVertexFormatUniforms
+uniform vec4 positionScale;
+uniform vec3 positionOffset;
+
 void main()
 {
     vs_out.texCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0); 
+    gl_Position = projection * view * model * vec4(aPos * positionScale.xyz + positionOffset, 1.0); 
 }
\ No newline at end of file
@@ -7,8 +7,18 @@ out VS_OUT {
     vec4 transformedPos;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
+
 uniform mat4 model;
 
 void main()
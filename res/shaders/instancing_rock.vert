@@ -5,11 +5,24 @@ layout (location = 3) in mat4 aInstanceMatrix;
 
 out vec2 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
+
+// Vertex dequantization, see Mesh::SetVertexFormatUniforms
+uniform vec4 positionScale;
+uniform vec3 positionOffset;
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * aInstanceMatrix * vec4(aPos, 1.0f); 
+    gl_Position = projection * view * aInstanceMatrix * vec4(aPos * positionScale.xyz + positionOffset, 1.0f); 
 }
\ No newline at end of file
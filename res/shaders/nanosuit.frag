@@ -1,17 +1,30 @@
 #version 450 core
+// Permutations (see shader_variants.h): POINT_LIGHT, DIR_LIGHT, SPECULAR_MAP
 
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 WorldPos;
+flat in uint Layer;
 
-uniform sampler2D texture_diffuse1;
-uniform sampler2D texture_specular1;
-uniform vec3 viewPos; // Camera position for specular calculation
+uniform sampler2DArray texture_diffuse_array1;
+#ifdef SPECULAR_MAP
+uniform sampler2DArray texture_specular_array1;
+#endif
+
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
 
 // Light parameters
-uniform vec3 lightPosition;
 uniform vec3 lightColor;
-uniform vec3 directionalLightDirection;
 uniform vec3 directionalLightColor;
 uniform float directionalLightScale;
 
@@ -25,30 +38,49 @@ layout(location = 0) out vec4 FragColor;
 void main()
 {
     vec3 normal = normalize(Normal);
+    vec3 uv = vec3(TexCoords, float(Layer));
+    vec3 albedo = texture(texture_diffuse_array1, uv).rgb;
 
     // Ambient component
-    vec3 ambient = ka * texture(texture_diffuse1, TexCoords).rgb;
+    vec3 ambient = ka * albedo;
+
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+#ifdef SPECULAR_MAP
+    vec3 viewDir = normalize(viewPos - WorldPos);
+    float specStrength = texture(texture_specular_array1, uv).r;
+#endif
 
+#ifdef POINT_LIGHT
     // Positional light calculations
     vec3 lightDir = normalize(lightPosition - WorldPos);
     float distance = length(lightPosition - WorldPos);
     float attenuation = 1.0f / (distance * distance + 0.32f * distance + 1.0f);
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = attenuation * kd * diff * lightColor * texture(texture_diffuse1, TexCoords).rgb;
-    
-    vec3 viewDir = normalize(viewPos - WorldPos);
+    diffuse += attenuation * kd * diff * lightColor * albedo;
+
+#ifdef SPECULAR_MAP
+    // also used for the directional light's highlight
     vec3 reflectDir = reflect(-lightDir, normal);
-    float specStrength = texture(texture_specular1, TexCoords).r;
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-    vec3 specular = ks * specStrength * spec * lightColor; 
+    specular += ks * specStrength * spec * lightColor;
+#endif
+#endif
 
+#ifdef DIR_LIGHT
     // Directional light calculations
-    lightDir = normalize(-directionalLightDirection);
-    diff = max(dot(normal, lightDir), 0.0);
-    diffuse += directionalLightScale * kd * diff * directionalLightColor * texture(texture_diffuse1, TexCoords).rgb;
-    
-    spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-    specular += directionalLightScale * ks * specStrength * spec * directionalLightColor;
+    vec3 dirLightDir = normalize(-directionalLightDirection);
+    float dirDiff = max(dot(normal, dirLightDir), 0.0);
+    diffuse += directionalLightScale * kd * dirDiff * directionalLightColor * albedo;
+
+#ifdef SPECULAR_MAP
+#ifndef POINT_LIGHT
+    vec3 reflectDir = reflect(-dirLightDir, normal);
+#endif
+    float dirSpec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    specular += directionalLightScale * ks * specStrength * dirSpec * directionalLightColor;
+#endif
+#endif
 
     // Combine lighting results
     vec3 result = ambient + diffuse + specular;
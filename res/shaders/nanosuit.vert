@@ -3,20 +3,48 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 8) in uint aLayer; // material layer in the texture arrays, see Model::RenderBatched
+
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
 
-uniform mat4 projection;
 uniform mat4 model;
-uniform mat4 view;
+
+// Vertex dequantization, see Mesh::SetVertexFormatUniforms
+uniform vec4 positionScale; // xyz: scale, w: 1 if aNormal.xy is octahedral encoded
+uniform vec3 positionOffset;
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 WorldPos;
+flat out uint Layer;
+
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
 
 void main()
 {
+    vec3 position = aPos * positionScale.xyz + positionOffset;
+    vec3 normal = positionScale.w > 0.5 ? OctDecode(aNormal.xy) : aNormal;
+
     TexCoords = aTexCoords;
-    WorldPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Layer = aLayer;
+    WorldPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * normal;
 
     gl_Position =  projection * view * vec4(WorldPos, 1.0);
 }
\ No newline at end of file
@@ -1,23 +1,35 @@
 #version 450 core
+// Permutations (see shader_variants.h): PBR, NORMAL_MAP, POINT_LIGHT, DIR_LIGHT
 layout(location = 0) out vec4 FragColor;
 
 in vec3 WorldPos;
 in vec2 TexCoords;
 in vec3 Normal;
-
-uniform vec3 viewPos; // Camera (eye) position
+#ifdef NORMAL_MAP
+in vec4 Tangent; // xyz tangent, w handedness, generated at load (see tangent_space.h)
+#endif
+
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
 
 // Material parameters
 uniform sampler2D albedoMap;
+#ifdef NORMAL_MAP
 uniform sampler2D normalMap;
-uniform sampler2D metallicMap;
-uniform sampler2D roughnessMap;
-uniform sampler2D aoMap;
+#endif
+uniform sampler2D ormMap; // r ambient occlusion, g roughness, b metallic
 
 // Lighting infos
-uniform vec3 lightPosition;
 uniform vec3 lightColor;
-uniform vec3 directionalLightDirection;
 uniform vec3 directionalLightColor;
 
 // Scaling factors
@@ -30,21 +42,18 @@ uniform float ka;
 const float PI = 3.1415926535897932384626433832795;
 const vec3 F0Base = vec3(0.04);
 
-// Calculate the corresponding normal in world space
+#ifdef NORMAL_MAP
+// Calculate the corresponding normal in world space from the interpolated tangent frame.
+// As MikkTSpace expects, the bitangent is rebuilt from the unnormalized vectors. Textures are
+// uploaded top row first, so the normal map's +Y (up in the image) runs along -v.
+// Only xy is read, z is rebuilt, so BC5 compressed (two channel) normal maps work as well.
 vec3 getNormalFromMap() {
-    vec3 tangentNormal = texture(normalMap, TexCoords).xyz * 2.0 - 1.0;
-    vec3 Q1  = dFdx(WorldPos);
-    vec3 Q2  = dFdy(WorldPos);
-    vec2 st1 = dFdx(TexCoords);
-    vec2 st2 = dFdy(TexCoords);
-
-    vec3 N   = normalize(Normal);
-    vec3 T  = normalize(Q1 * st2.t - Q2 * st1.t);
-    vec3 B  = -normalize(cross(N, T));
-    mat3 TBN = mat3(T, B, N);
-
-    return normalize(TBN * tangentNormal);
+    vec2 xy = texture(normalMap, TexCoords).xy * 2.0 - 1.0;
+    vec3 tangentNormal = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+    vec3 B = -Tangent.w * cross(Normal, Tangent.xyz);
+    return normalize(tangentNormal.x * Tangent.xyz + tangentNormal.y * B + tangentNormal.z * Normal);
 }
+#endif
 
 float distributionGGX(vec3 N, vec3 H, float roughness) {
     float a = roughness * roughness;
@@ -72,23 +81,33 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0) {
 
 void main() {
     vec3 albedo = pow(texture(albedoMap, TexCoords).rgb, vec3(2.2)) * albedoScale;
-    float metallic = texture(metallicMap, TexCoords).r * metallicScale;
-    float roughness = texture(roughnessMap, TexCoords).r * roughnessScale;
-    float ao = texture(aoMap, TexCoords).r;
+    vec3 orm = texture(ormMap, TexCoords).rgb;
+    float ao = orm.r;
+    float roughness = orm.g * roughnessScale;
+    float metallic = orm.b * metallicScale;
 
+#ifdef NORMAL_MAP
     vec3 N = getNormalFromMap();
-    vec3 V = normalize(viewPos - WorldPos);
+#else
+    vec3 N = normalize(Normal);
+#endif
+    vec3 Lo = vec3(0.0);
 
+#ifdef PBR
+    vec3 V = normalize(viewPos - WorldPos);
     vec3 F0 = mix(F0Base, albedo, metallic);
+#endif
 
+#ifdef POINT_LIGHT
     // Positional Light calculation
     vec3 L = normalize(lightPosition - WorldPos);
-    vec3 H = normalize(V + L);
     float distance = length(lightPosition - WorldPos);
     float attenuation = 1.0 / (distance * distance);
     vec3 incomingRadiance = lightColor * attenuation;
     float NdotL = max(dot(N, L), 0.0);
 
+#ifdef PBR
+    vec3 H = normalize(V + L);
     float NDF = distributionGGX(N, H, roughness);
     float G = geometrySmith(N, V, L, roughness);
     vec3 F = fresnelSchlick(max(dot(H, V), 0.0), F0);
@@ -99,22 +118,31 @@ void main() {
     vec3 Kd = (1.0 - Ks) * (1.0 - metallic);
 
     vec3 BRDF = Kd * albedo / PI + specular;
-    vec3 Lo = BRDF * incomingRadiance * NdotL;
+#else
+    vec3 BRDF = albedo / PI;
+#endif
+    Lo += BRDF * incomingRadiance * NdotL;
+#endif
 
+#ifdef DIR_LIGHT
     // Directional light calculation
     vec3 L_dir = normalize(-directionalLightDirection);
-    vec3 H_dir = normalize(V + L_dir);
     float NdotL_dir = max(dot(N, L_dir), 0.0);
     vec3 incomingRadiance_dir = directionalLightColor * directionalLightScale * NdotL_dir;
 
+#ifdef PBR
+    vec3 H_dir = normalize(V + L_dir);
     float NDF_dir = distributionGGX(N, H_dir, roughness);
     float G_dir = geometrySmith(N, V, L_dir, roughness);
     vec3 F_dir = fresnelSchlick(max(dot(H_dir, V), 0.0), F0);
 
     vec3 specular_dir = NDF_dir * G_dir * F_dir / (4.0 * max(dot(N, V), 0.0) * NdotL_dir + 0.0001);
     vec3 BRDF_dir = (1.0 - F_dir) * albedo / PI + specular_dir;
-
+#else
+    vec3 BRDF_dir = albedo / PI;
+#endif
     Lo += BRDF_dir * incomingRadiance_dir;
+#endif
 
     vec3 ambient = vec3(ka) * albedo * ao;
     vec3 color = ambient + Lo;
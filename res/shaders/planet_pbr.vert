@@ -1,14 +1,29 @@
 #version 450 core
+// Permutations (see shader_variants.h): NORMAL_MAP
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in vec4 aTangent; // xyz tangent, w handedness
 
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
+#ifdef NORMAL_MAP
+out vec4 Tangent;
+#endif
+
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
 uniform mat3 normalMatrix;
 
@@ -17,6 +32,9 @@ void main()
     TexCoords = aTexCoords;
     WorldPos = vec3(model * vec4(aPos, 1.0));
     Normal = normalMatrix * aNormal;   
+#ifdef NORMAL_MAP
+    Tangent = vec4(mat3(model) * aTangent.xyz, aTangent.w);
+#endif
 
     gl_Position =  projection * view * vec4(WorldPos, 1.0);
 }
\ No newline at end of file
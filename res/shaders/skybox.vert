@@ -3,14 +3,25 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+// Per frame values shared by the scene shaders, see frame_data.h
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;        // camera position
+    float time;          // seconds since start
+    vec3 lightPosition;
+    float deltaTime;
+    vec3 directionalLightDirection;
+};
+
 uniform mat4 model;
 
 void main()
 {
     TexCoords = aPos;
-    vec4 pos = projection * view * model * vec4(aPos, 1.0);
+    // rotation only, the sky box stays centered on the camera
+    vec4 pos = projection * mat4(mat3(view)) * model * vec4(aPos, 1.0);
 
     // this will ensure z value (depth value)after projection always be 1.0f
     // we can also manually set gl_FragDepth to 1.0f in fragment shader
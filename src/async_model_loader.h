@@ -0,0 +1,154 @@
+// Loads models in the background so the window can show frames while they stream in.
+// Model::LoadData (MTL, texture decoding, OBJ parsing or the mesh cache) runs on a worker thread;
+// the GL side (textures, VAOs, buffers) is queued for the render thread, which drains the queue
+// under a per-frame time budget with ProcessUploads.
+//
+// Usage Example:
+// AsyncModelLoader loader;
+// ModelHandle rock = loader.Load("res/models/rock/rock.obj");
+// while (rendering) {
+//     loader.ProcessUploads(4000); // at most ~4 ms of uploads this frame
+//     if (rock.IsReady())
+//         rock.Get().Render(shader);
+// }
+
+#pragma once
+#ifndef ASYNC_MODEL_LOADER_H
+#define ASYNC_MODEL_LOADER_H
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "model.h"
+#include "thread_pool.h"
+#include "timer.h"
+
+// Shared state of one model load
+struct ModelLoadState
+{
+	std::string path;
+	ModelLoadOptions options;
+	ModelData data;               // filled by the worker, consumed by the upload
+	std::unique_ptr<Model> model; // created on the GL thread once data is ready
+	std::string error;
+	std::atomic<bool> ready{ false };
+	std::atomic<bool> failed{ false };
+};
+
+// Refers to a model queued on an AsyncModelLoader. Cheap to copy.
+class ModelHandle
+{
+public:
+	ModelHandle() = default;
+	explicit ModelHandle(std::shared_ptr<ModelLoadState> loadState) : state(std::move(loadState)) {}
+
+	// True once the model is completely uploaded and may be rendered
+	bool IsReady() const { return state && state->ready; }
+	bool Failed() const { return state && state->failed; }
+	// Empty unless Failed(), also for a default constructed handle
+	const std::string& Error() const
+	{
+		static const std::string none;
+		return state ? state->error : none;
+	}
+
+	// Only valid when IsReady()
+	Model& Get() { return *state->model; }
+	const Model& Get() const { return *state->model; }
+
+private:
+	std::shared_ptr<ModelLoadState> state;
+};
+
+class AsyncModelLoader
+{
+public:
+	// threadCount == 0 uses one thread per hardware thread
+	explicit AsyncModelLoader(unsigned int threadCount = 0) : pool(threadCount) {}
+
+	AsyncModelLoader(const AsyncModelLoader&) = delete;
+	AsyncModelLoader& operator=(const AsyncModelLoader&) = delete;
+
+	// Starts loading objFilePath on a worker thread. The returned handle becomes ready
+	// after enough ProcessUploads calls; it reports Failed() if the files could not be loaded.
+	ModelHandle Load(const std::string& objFilePath, const ModelLoadOptions& options = ModelLoadOptions());
+
+	/**
+	 * Uploads finished models to the GPU, one texture or mesh at a time, until budgetMicroseconds
+	 * is spent. Call once per frame on the thread owning the GL context; makes at least one step
+	 * when anything is waiting, so a single upload may exceed the budget.
+	 */
+	void ProcessUploads(long long budgetMicroseconds);
+
+	// True while any model is still loading or uploading
+	bool IsBusy() const { return pendingLoads > 0; }
+
+private:
+	std::mutex mutex;
+	std::deque<std::shared_ptr<ModelLoadState>> loaded; // CPU work done, waiting for upload, FIFO
+	std::shared_ptr<ModelLoadState> uploading;          // GL thread only
+	std::atomic<unsigned int> pendingLoads{ 0 };
+	ThreadPool pool; // last, so it finishes the queued loads before the members above go away
+};
+
+ModelHandle AsyncModelLoader::Load(const std::string& objFilePath, const ModelLoadOptions& options)
+{
+	auto state = std::make_shared<ModelLoadState>();
+	state->path = objFilePath;
+	state->options = options;
+	pendingLoads++;
+
+	pool.Submit([this, state]() {
+		try {
+			state->data = Model::LoadData(state->path, state->options);
+		}
+		catch (const std::exception& e) {
+			state->error = e.what();
+			state->failed = true;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		loaded.push_back(state);
+	});
+	return ModelHandle(state);
+}
+
+void AsyncModelLoader::ProcessUploads(long long budgetMicroseconds)
+{
+	Timer timer;
+	timer.start();
+
+	do {
+		if (!uploading) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (loaded.empty())
+					return;
+				uploading = std::move(loaded.front());
+				loaded.pop_front();
+			}
+
+			if (uploading->failed) {
+				std::cerr << "Failed to load model " << uploading->path << ": " << uploading->error << std::endl;
+				uploading.reset();
+				pendingLoads--;
+				continue;
+			}
+
+			uploading->model.reset(new Model(uploading->options));
+			uploading->model->BeginUpload(std::move(uploading->data));
+		}
+
+		if (!uploading->model->UploadNext()) {
+			uploading->ready = true;
+			uploading.reset();
+			pendingLoads--;
+		}
+	} while (timer.elapsedMicroseconds() < budgetMicroseconds);
+}
+
+#endif // !ASYNC_MODEL_LOADER_H
@@ -0,0 +1,697 @@
+// CPU encoder/decoder for the BCn block compressed texture formats (4x4 texel blocks):
+//   BC1  RGB,  8 bytes per block  (opaque color)
+//   BC3  RGBA, 16 bytes           (BC1 color + BC4 alpha)
+//   BC4  R,    8 bytes            (single channel: roughness, metallic, ao)
+//   BC5  RG,   16 bytes           (two BC4 blocks: tangent space normal xy, z is rebuilt in the shader)
+//   BC7  RGBA, 16 bytes           (color with alpha; only mode 6 is written)
+// Touches no OpenGL state: the encoder runs offline or on worker threads and is tested on the CPU by
+// decoding its own output, see MeasureCompressionError and CheckBlockCompression (self_checks.h). dds_file.h stores the result, mip levels
+// come from mip_generator.h.
+//
+// Usage Example:
+// CompressedImage image;
+// CompressImage(pixels, width, height, components, BlockFormat::BC7, image);
+// CompressionError error = MeasureCompressionError(pixels, width, height, components, image);
+
+#pragma once
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mip_generator.h"
+
+enum class BlockFormat : uint32_t
+{
+	BC1,
+	BC3,
+	BC4,
+	BC5,
+	BC7,
+};
+
+// One mip level inside CompressedImage::data
+struct CompressedLevel
+{
+	int width = 0, height = 0;
+	size_t offset = 0;
+	size_t size = 0;
+};
+
+struct CompressedImage
+{
+	BlockFormat format = BlockFormat::BC1;
+	int width = 0, height = 0;
+	std::vector<CompressedLevel> levels; // largest first
+	std::vector<uint8_t> data;           // all levels back to back
+};
+
+// Root mean square error of the decoded top level against the source, over the channels the format keeps
+struct CompressionError
+{
+	double rmse = 0.0; // 0..255 units
+	double psnr = 0.0; // dB, 0 if the image is empty
+};
+
+inline size_t BlockBytes(BlockFormat format) { return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16; }
+
+inline size_t CompressedLevelSize(BlockFormat format, int width, int height)
+{
+	return static_cast<size_t>((std::max(width, 1) + 3) / 4) * ((std::max(height, 1) + 3) / 4) * BlockBytes(format);
+}
+
+// Color channels each format stores, used when measuring the error
+inline int BlockFormatChannels(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC1: return 3;
+	case BlockFormat::BC4: return 1;
+	case BlockFormat::BC5: return 2;
+	default: return 4;
+	}
+}
+
+// Single block codecs. rgba holds the 16 texels of a block row by row, 4 bytes each.
+inline void EncodeBC1Block(const uint8_t* rgba, uint8_t* block);
+inline void EncodeBC3Block(const uint8_t* rgba, uint8_t* block);
+inline void EncodeBC4Block(const uint8_t* rgba, int channel, uint8_t* block); // channel 0..3 of rgba
+inline void EncodeBC5Block(const uint8_t* rgba, uint8_t* block);
+inline void EncodeBC7Block(const uint8_t* rgba, uint8_t* block);
+
+inline void DecodeBC1Block(const uint8_t* block, uint8_t* rgba);
+inline void DecodeBC3Block(const uint8_t* block, uint8_t* rgba);
+inline void DecodeBC4Block(const uint8_t* block, int channel, uint8_t* rgba); // writes that channel only
+inline void DecodeBC5Block(const uint8_t* block, uint8_t* rgba);
+// Decodes mode 6, the only mode EncodeBC7Block writes; blocks in other modes decode to magenta.
+inline void DecodeBC7Block(const uint8_t* block, uint8_t* rgba);
+
+/**
+ * Compresses an 8-bit image and, unless mipmaps is false, the mip chain GenerateMipChain builds from it.
+ * Edge blocks of sizes that are not a multiple of 4 repeat the last row/column.
+ *
+ * @param components 1 (gray), 2 (gray, alpha), 3 (RGB) or 4 (RGBA), as returned by stbi_load.
+ * @param filter How the mip levels are filtered, see mip_generator.h.
+ */
+inline void CompressImage(const uint8_t* pixels, int width, int height, int components, BlockFormat format,
+	CompressedImage& image, MipFilter filter = MipFilter::Color, bool mipmaps = true);
+
+// Decodes one level back into RGBA8 (missing channels: 0 for color, 255 for alpha).
+inline void DecompressLevel(const CompressedImage& image, size_t level, std::vector<uint8_t>& rgba);
+
+// Compares the decoded top level with the source pixels CompressImage was given.
+inline CompressionError MeasureCompressionError(const uint8_t* pixels, int width, int height, int components,
+	const CompressedImage& image);
+
+namespace block_compression_detail
+{
+	// Source pixel expanded to RGBA the way CompressImage reads it
+	inline void ExpandTexel(const uint8_t* pixel, int components, uint8_t* rgba)
+	{
+		switch (components) {
+		case 1: rgba[0] = rgba[1] = rgba[2] = pixel[0]; rgba[3] = 255; break;
+		case 2: rgba[0] = rgba[1] = rgba[2] = pixel[0]; rgba[3] = pixel[1]; break;
+		case 3: rgba[0] = pixel[0]; rgba[1] = pixel[1]; rgba[2] = pixel[2]; rgba[3] = 255; break;
+		default: std::memcpy(rgba, pixel, 4); break;
+		}
+	}
+
+	// Principal axis of the block's colors (first `channels` channels) by power iteration
+	inline void PrincipalAxis(const float (*texels)[4], int channels, const float* mean, float* axis)
+	{
+		float covariance[4][4] = {};
+		for (int t = 0; t < 16; t++) {
+			for (int i = 0; i < channels; i++)
+				for (int j = 0; j < channels; j++)
+					covariance[i][j] += (texels[t][i] - mean[i]) * (texels[t][j] - mean[j]);
+		}
+
+		// Start from the covariance row of the widest channel, a constant start vector can be orthogonal
+		// to the axis (e.g. red rising while green falls)
+		int widest = 0;
+		for (int i = 1; i < channels; i++)
+			if (covariance[i][i] > covariance[widest][widest])
+				widest = i;
+		for (int i = 0; i < 4; i++)
+			axis[i] = i < channels ? covariance[widest][i] : 0.0f;
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[4] = {};
+			for (int i = 0; i < channels; i++)
+				for (int j = 0; j < channels; j++)
+					next[i] += covariance[i][j] * axis[j];
+			float length = 0.0f;
+			for (int i = 0; i < channels; i++)
+				length = std::max(length, std::abs(next[i]));
+			if (length <= 0.0f)
+				return; // flat block, any axis will do
+			for (int i = 0; i < channels; i++)
+				axis[i] = next[i] / length;
+		}
+	}
+
+	// Block endpoints: the extreme projections onto the principal axis
+	inline void FitEndpoints(const float (*texels)[4], int channels, float* e0, float* e1)
+	{
+		float mean[4] = {};
+		for (int t = 0; t < 16; t++)
+			for (int i = 0; i < channels; i++)
+				mean[i] += texels[t][i] / 16.0f;
+
+		float axis[4];
+		PrincipalAxis(texels, channels, mean, axis);
+
+		float minProjection = 0.0f, maxProjection = 0.0f;
+		for (int t = 0; t < 16; t++) {
+			float projection = 0.0f;
+			for (int i = 0; i < channels; i++)
+				projection += (texels[t][i] - mean[i]) * axis[i];
+			minProjection = std::min(minProjection, projection);
+			maxProjection = std::max(maxProjection, projection);
+		}
+		float axisLength2 = 0.0f;
+		for (int i = 0; i < channels; i++)
+			axisLength2 += axis[i] * axis[i];
+		if (axisLength2 > 0.0f) {
+			minProjection /= axisLength2;
+			maxProjection /= axisLength2;
+		}
+		for (int i = 0; i < channels; i++) {
+			e0[i] = std::min(std::max(mean[i] + axis[i] * maxProjection, 0.0f), 255.0f);
+			e1[i] = std::min(std::max(mean[i] + axis[i] * minProjection, 0.0f), 255.0f);
+		}
+	}
+
+	/**
+	 * Least squares endpoints for fixed palette weights: minimizes sum |(1-w) e0 + w e1 - texel|^2.
+	 * Returns false if the weights do not determine both endpoints (all texels on one weight).
+	 */
+	inline bool RefineEndpoints(const float (*texels)[4], int channels, const float* weights, float* e0, float* e1)
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = {}, bx[4] = {};
+		for (int t = 0; t < 16; t++) {
+			float a = 1.0f - weights[t], b = weights[t];
+			aa += a * a; ab += a * b; bb += b * b;
+			for (int i = 0; i < channels; i++) {
+				ax[i] += a * texels[t][i];
+				bx[i] += b * texels[t][i];
+			}
+		}
+		float det = aa * bb - ab * ab;
+		if (std::abs(det) < 1e-6f)
+			return false;
+		for (int i = 0; i < channels; i++) {
+			e0[i] = std::min(std::max((ax[i] * bb - bx[i] * ab) / det, 0.0f), 255.0f);
+			e1[i] = std::min(std::max((bx[i] * aa - ax[i] * ab) / det, 0.0f), 255.0f);
+		}
+		return true;
+	}
+
+	// Packs fields LSB first into a 16 byte block, as BC7 lays them out
+	struct BitWriter
+	{
+		uint8_t* block;
+		int position = 0;
+
+		void Write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; i++, position++) {
+				if (value & (1u << i))
+					block[position >> 3] |= static_cast<uint8_t>(1u << (position & 7));
+			}
+		}
+	};
+
+	struct BitReader
+	{
+		const uint8_t* block;
+		int position = 0;
+
+		uint32_t Read(int bits)
+		{
+			uint32_t value = 0;
+			for (int i = 0; i < bits; i++, position++)
+				value |= static_cast<uint32_t>((block[position >> 3] >> (position & 7)) & 1u) << i;
+			return value;
+		}
+	};
+
+	inline uint16_t PackRGB565(const float* color)
+	{
+		int r = static_cast<int>(std::lround(color[0] * 31.0f / 255.0f));
+		int g = static_cast<int>(std::lround(color[1] * 63.0f / 255.0f));
+		int b = static_cast<int>(std::lround(color[2] * 31.0f / 255.0f));
+		return static_cast<uint16_t>((std::min(std::max(r, 0), 31) << 11) | (std::min(std::max(g, 0), 63) << 5) |
+			std::min(std::max(b, 0), 31));
+	}
+
+	inline void UnpackRGB565(uint16_t packed, int* color)
+	{
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// BC1 four color palette of two packed endpoints
+	inline void BC1Palette(uint16_t c0, uint16_t c1, int (*palette)[3])
+	{
+		UnpackRGB565(c0, palette[0]);
+		UnpackRGB565(c1, palette[1]);
+		for (int i = 0; i < 3; i++) {
+			palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+			palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+		}
+	}
+
+	// Picks the nearest palette entry per texel, returns the summed squared error
+	inline int BC1Indices(const float (*texels)[4], uint16_t c0, uint16_t c1, uint32_t& indices)
+	{
+		int palette[4][3];
+		BC1Palette(c0, c1, palette);
+		indices = 0;
+		int total = 0;
+		for (int t = 0; t < 16; t++) {
+			int best = 0, bestError = 1 << 30;
+			for (int p = 0; p < 4; p++) {
+				int error = 0;
+				for (int i = 0; i < 3; i++) {
+					int d = static_cast<int>(texels[t][i]) - palette[p][i];
+					error += d * d;
+				}
+				if (error < bestError) { bestError = error; best = p; }
+			}
+			indices |= static_cast<uint32_t>(best) << (2 * t);
+			total += bestError;
+		}
+		return total;
+	}
+
+	// Encodes the color part of BC1/BC3, always in the four color mode (c0 > c1)
+	inline void EncodeBC1Color(const uint8_t* rgba, uint8_t* block)
+	{
+		float texels[16][4];
+		for (int t = 0; t < 16; t++)
+			for (int i = 0; i < 4; i++)
+				texels[t][i] = rgba[t * 4 + i];
+
+		float e0[4], e1[4];
+		FitEndpoints(texels, 3, e0, e1);
+		uint16_t c0 = PackRGB565(e0), c1 = PackRGB565(e1);
+		uint32_t indices;
+		int error = BC1Indices(texels, c0, c1, indices);
+
+		// One least squares pass on the chosen indices
+		static const float kWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		float weights[16];
+		for (int t = 0; t < 16; t++)
+			weights[t] = kWeights[(indices >> (2 * t)) & 3];
+		if (RefineEndpoints(texels, 3, weights, e0, e1)) {
+			uint16_t r0 = PackRGB565(e0), r1 = PackRGB565(e1);
+			uint32_t refinedIndices;
+			int refinedError = BC1Indices(texels, r0, r1, refinedIndices);
+			if (refinedError < error) {
+				c0 = r0; c1 = r1; indices = refinedIndices;
+			}
+		}
+
+		if (c0 < c1) {
+			// Swap into the four color order: 0 <-> 1, 2 <-> 3
+			std::swap(c0, c1);
+			indices ^= 0x55555555u;
+		}
+		else if (c0 == c1) {
+			indices = 0; // three color mode, entry 0 is the flat color
+		}
+
+		block[0] = static_cast<uint8_t>(c0); block[1] = static_cast<uint8_t>(c0 >> 8);
+		block[2] = static_cast<uint8_t>(c1); block[3] = static_cast<uint8_t>(c1 >> 8);
+		for (int i = 0; i < 4; i++)
+			block[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+	}
+
+	// Palette of a BC4 block
+	inline void BC4Palette(int r0, int r1, int* palette)
+	{
+		palette[0] = r0;
+		palette[1] = r1;
+		if (r0 > r1) {
+			for (int i = 2; i < 8; i++)
+				palette[i] = ((8 - i) * r0 + (i - 1) * r1) / 7;
+		}
+		else {
+			for (int i = 2; i < 6; i++)
+				palette[i] = ((6 - i) * r0 + (i - 1) * r1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	// BC7 mode 6: 4 bit index weights
+	static const int kBC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	inline int BC7Interpolate(int e0, int e1, int weight) { return ((64 - weight) * e0 + weight * e1 + 32) >> 6; }
+
+	// Quantizes a mode 6 endpoint to 7 bits plus the shared p-bit, returns the decoded 8-bit values
+	inline void QuantizeBC7Endpoint(const float* endpoint, int pbit, int* quantized, int* decoded)
+	{
+		for (int i = 0; i < 4; i++) {
+			int q = static_cast<int>(std::lround((endpoint[i] - pbit) / 2.0f));
+			quantized[i] = std::min(std::max(q, 0), 127);
+			decoded[i] = (quantized[i] << 1) | pbit;
+		}
+	}
+
+	// Nearest mode 6 palette entry per texel for decoded endpoints, returns the summed squared error
+	inline int BC7Indices(const float (*texels)[4], const int* e0, const int* e1, int* indices)
+	{
+		int palette[16][4];
+		for (int p = 0; p < 16; p++)
+			for (int i = 0; i < 4; i++)
+				palette[p][i] = BC7Interpolate(e0[i], e1[i], kBC7Weights4[p]);
+
+		int total = 0;
+		for (int t = 0; t < 16; t++) {
+			int best = 0, bestError = 1 << 30;
+			for (int p = 0; p < 16; p++) {
+				int error = 0;
+				for (int i = 0; i < 4; i++) {
+					int d = static_cast<int>(texels[t][i]) - palette[p][i];
+					error += d * d;
+				}
+				if (error < bestError) { bestError = error; best = p; }
+			}
+			indices[t] = best;
+			total += bestError;
+		}
+		return total;
+	}
+
+	struct BC7Mode6
+	{
+		int quantized[2][4];
+		int pbits[2];
+		int indices[16];
+		int error = 1 << 30;
+	};
+
+	// Best of the four p-bit combinations for float endpoints
+	inline void FitBC7Mode6(const float (*texels)[4], const float* e0, const float* e1, BC7Mode6& best)
+	{
+		for (int p = 0; p < 4; p++) {
+			BC7Mode6 candidate;
+			candidate.pbits[0] = p & 1;
+			candidate.pbits[1] = p >> 1;
+			int decoded[2][4];
+			QuantizeBC7Endpoint(e0, candidate.pbits[0], candidate.quantized[0], decoded[0]);
+			QuantizeBC7Endpoint(e1, candidate.pbits[1], candidate.quantized[1], decoded[1]);
+			candidate.error = BC7Indices(texels, decoded[0], decoded[1], candidate.indices);
+			if (candidate.error < best.error)
+				best = candidate;
+		}
+	}
+}
+
+inline void EncodeBC1Block(const uint8_t* rgba, uint8_t* block)
+{
+	block_compression_detail::EncodeBC1Color(rgba, block);
+}
+
+inline void EncodeBC4Block(const uint8_t* rgba, int channel, uint8_t* block)
+{
+	int minValue = 255, maxValue = 0;
+	for (int t = 0; t < 16; t++) {
+		minValue = std::min(minValue, static_cast<int>(rgba[t * 4 + channel]));
+		maxValue = std::max(maxValue, static_cast<int>(rgba[t * 4 + channel]));
+	}
+
+	// Eight value mode (r0 > r1); a flat block uses r0 == r1 and index 0
+	int palette[8];
+	block_compression_detail::BC4Palette(maxValue, minValue, palette);
+	uint64_t indices = 0;
+	if (maxValue > minValue) {
+		for (int t = 0; t < 16; t++) {
+			int value = rgba[t * 4 + channel];
+			int best = 0, bestError = 1 << 30;
+			for (int p = 0; p < 8; p++) {
+				int error = std::abs(value - palette[p]);
+				if (error < bestError) { bestError = error; best = p; }
+			}
+			indices |= static_cast<uint64_t>(best) << (3 * t);
+		}
+	}
+
+	block[0] = static_cast<uint8_t>(maxValue);
+	block[1] = static_cast<uint8_t>(minValue);
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+inline void EncodeBC3Block(const uint8_t* rgba, uint8_t* block)
+{
+	EncodeBC4Block(rgba, 3, block);
+	block_compression_detail::EncodeBC1Color(rgba, block + 8);
+}
+
+inline void EncodeBC5Block(const uint8_t* rgba, uint8_t* block)
+{
+	EncodeBC4Block(rgba, 0, block);
+	EncodeBC4Block(rgba, 1, block + 8);
+}
+
+inline void EncodeBC7Block(const uint8_t* rgba, uint8_t* block)
+{
+	using namespace block_compression_detail;
+
+	float texels[16][4];
+	for (int t = 0; t < 16; t++)
+		for (int i = 0; i < 4; i++)
+			texels[t][i] = rgba[t * 4 + i];
+
+	float e0[4], e1[4];
+	FitEndpoints(texels, 4, e0, e1);
+	BC7Mode6 best;
+	FitBC7Mode6(texels, e0, e1, best);
+
+	// One least squares pass on the chosen indices
+	float weights[16];
+	for (int t = 0; t < 16; t++)
+		weights[t] = kBC7Weights4[best.indices[t]] / 64.0f;
+	if (RefineEndpoints(texels, 4, weights, e0, e1))
+		FitBC7Mode6(texels, e0, e1, best);
+
+	// The anchor (texel 0) index is stored with its top bit implied 0
+	if (best.indices[0] >= 8) {
+		for (int i = 0; i < 4; i++)
+			std::swap(best.quantized[0][i], best.quantized[1][i]);
+		std::swap(best.pbits[0], best.pbits[1]);
+		for (int t = 0; t < 16; t++)
+			best.indices[t] = 15 - best.indices[t];
+	}
+
+	std::memset(block, 0, 16);
+	BitWriter writer{ block };
+	writer.Write(1u << 6, 7); // mode 6
+	for (int i = 0; i < 4; i++) {
+		writer.Write(static_cast<uint32_t>(best.quantized[0][i]), 7);
+		writer.Write(static_cast<uint32_t>(best.quantized[1][i]), 7);
+	}
+	writer.Write(static_cast<uint32_t>(best.pbits[0]), 1);
+	writer.Write(static_cast<uint32_t>(best.pbits[1]), 1);
+	for (int t = 0; t < 16; t++)
+		writer.Write(static_cast<uint32_t>(best.indices[t]), t == 0 ? 3 : 4);
+}
+
+inline void DecodeBC1Block(const uint8_t* block, uint8_t* rgba)
+{
+	uint16_t c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+	uint16_t c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+	int palette[4][3];
+	block_compression_detail::BC1Palette(c0, c1, palette);
+	bool punchThrough = c0 <= c1;
+	if (punchThrough) {
+		for (int i = 0; i < 3; i++) {
+			palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+			palette[3][i] = 0;
+		}
+	}
+
+	uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+	for (int t = 0; t < 16; t++) {
+		int index = (indices >> (2 * t)) & 3;
+		for (int i = 0; i < 3; i++)
+			rgba[t * 4 + i] = static_cast<uint8_t>(palette[index][i]);
+		rgba[t * 4 + 3] = punchThrough && index == 3 ? 0 : 255;
+	}
+}
+
+inline void DecodeBC4Block(const uint8_t* block, int channel, uint8_t* rgba)
+{
+	int palette[8];
+	block_compression_detail::BC4Palette(block[0], block[1], palette);
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+	for (int t = 0; t < 16; t++)
+		rgba[t * 4 + channel] = static_cast<uint8_t>(palette[(indices >> (3 * t)) & 7]);
+}
+
+inline void DecodeBC3Block(const uint8_t* block, uint8_t* rgba)
+{
+	DecodeBC1Block(block + 8, rgba);
+	DecodeBC4Block(block, 3, rgba);
+}
+
+inline void DecodeBC5Block(const uint8_t* block, uint8_t* rgba)
+{
+	for (int t = 0; t < 16; t++) {
+		rgba[t * 4 + 2] = 0;
+		rgba[t * 4 + 3] = 255;
+	}
+	DecodeBC4Block(block, 0, rgba);
+	DecodeBC4Block(block + 8, 1, rgba);
+}
+
+inline void DecodeBC7Block(const uint8_t* block, uint8_t* rgba)
+{
+	using namespace block_compression_detail;
+
+	if ((block[0] & 0x7F) != 0x40) {
+		for (int t = 0; t < 16; t++) {
+			rgba[t * 4 + 0] = 255; rgba[t * 4 + 1] = 0; rgba[t * 4 + 2] = 255; rgba[t * 4 + 3] = 255;
+		}
+		return;
+	}
+
+	BitReader reader{ block };
+	reader.Read(7);
+	int endpoints[2][4];
+	for (int i = 0; i < 4; i++) {
+		endpoints[0][i] = static_cast<int>(reader.Read(7));
+		endpoints[1][i] = static_cast<int>(reader.Read(7));
+	}
+	int pbits[2] = { static_cast<int>(reader.Read(1)), static_cast<int>(reader.Read(1)) };
+	for (int e = 0; e < 2; e++)
+		for (int i = 0; i < 4; i++)
+			endpoints[e][i] = (endpoints[e][i] << 1) | pbits[e];
+
+	for (int t = 0; t < 16; t++) {
+		int index = static_cast<int>(reader.Read(t == 0 ? 3 : 4));
+		for (int i = 0; i < 4; i++)
+			rgba[t * 4 + i] = static_cast<uint8_t>(BC7Interpolate(endpoints[0][i], endpoints[1][i], kBC7Weights4[index]));
+	}
+}
+
+inline void CompressImage(const uint8_t* pixels, int width, int height, int components, BlockFormat format,
+	CompressedImage& image, MipFilter filter, bool mipmaps)
+{
+	image = CompressedImage();
+	image.format = format;
+	image.width = width;
+	image.height = height;
+	if (width <= 0 || height <= 0 || pixels == nullptr)
+		return;
+
+	auto compressLevel = [&](const uint8_t* levelPixels, int levelWidth, int levelHeight) {
+		CompressedLevel compressed;
+		compressed.width = levelWidth;
+		compressed.height = levelHeight;
+		compressed.offset = image.data.size();
+		compressed.size = CompressedLevelSize(format, levelWidth, levelHeight);
+		image.data.resize(compressed.offset + compressed.size);
+
+		uint8_t* block = image.data.data() + compressed.offset;
+		uint8_t texels[64];
+		for (int by = 0; by < levelHeight; by += 4) {
+			for (int bx = 0; bx < levelWidth; bx += 4) {
+				for (int y = 0; y < 4; y++) {
+					int sy = std::min(by + y, levelHeight - 1);
+					for (int x = 0; x < 4; x++) {
+						int sx = std::min(bx + x, levelWidth - 1);
+						block_compression_detail::ExpandTexel(levelPixels + (static_cast<size_t>(sy) * levelWidth + sx) * components,
+							components, &texels[(y * 4 + x) * 4]);
+					}
+				}
+				switch (format) {
+				case BlockFormat::BC1: EncodeBC1Block(texels, block); break;
+				case BlockFormat::BC3: EncodeBC3Block(texels, block); break;
+				case BlockFormat::BC4: EncodeBC4Block(texels, 0, block); break;
+				case BlockFormat::BC5: EncodeBC5Block(texels, block); break;
+				case BlockFormat::BC7: EncodeBC7Block(texels, block); break;
+				}
+				block += BlockBytes(format);
+			}
+		}
+		image.levels.push_back(compressed);
+	};
+
+	compressLevel(pixels, width, height);
+	if (!mipmaps)
+		return;
+
+	MipChain mips;
+	GenerateMipChain(pixels, width, height, components, filter, mips);
+	for (const MipLevel& level : mips.levels)
+		compressLevel(mips.data.data() + level.offset, level.width, level.height);
+}
+
+inline void DecompressLevel(const CompressedImage& image, size_t levelIndex, std::vector<uint8_t>& rgba)
+{
+	rgba.clear();
+	if (levelIndex >= image.levels.size())
+		return;
+	const CompressedLevel& level = image.levels[levelIndex];
+	rgba.assign(static_cast<size_t>(level.width) * level.height * 4, 0);
+
+	const uint8_t* block = image.data.data() + level.offset;
+	uint8_t texels[64];
+	for (int by = 0; by < level.height; by += 4) {
+		for (int bx = 0; bx < level.width; bx += 4) {
+			std::memset(texels, 0, sizeof(texels));
+			for (int t = 0; t < 16; t++)
+				texels[t * 4 + 3] = 255;
+			switch (image.format) {
+			case BlockFormat::BC1: DecodeBC1Block(block, texels); break;
+			case BlockFormat::BC3: DecodeBC3Block(block, texels); break;
+			case BlockFormat::BC4: DecodeBC4Block(block, 0, texels); break;
+			case BlockFormat::BC5: DecodeBC5Block(block, texels); break;
+			case BlockFormat::BC7: DecodeBC7Block(block, texels); break;
+			}
+			block += BlockBytes(image.format);
+
+			for (int y = 0; y < 4 && by + y < level.height; y++)
+				for (int x = 0; x < 4 && bx + x < level.width; x++)
+					std::memcpy(&rgba[(static_cast<size_t>(by + y) * level.width + bx + x) * 4], &texels[(y * 4 + x) * 4], 4);
+		}
+	}
+}
+
+inline CompressionError MeasureCompressionError(const uint8_t* pixels, int width, int height, int components,
+	const CompressedImage& image)
+{
+	CompressionError error;
+	std::vector<uint8_t> decoded;
+	DecompressLevel(image, 0, decoded);
+	if (decoded.empty() || image.width != width || image.height != height)
+		return error;
+
+	int channels = BlockFormatChannels(image.format);
+	double sum = 0.0;
+	uint8_t source[4];
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; i++) {
+		block_compression_detail::ExpandTexel(pixels + i * components, components, source);
+		for (int c = 0; c < channels; c++) {
+			double d = static_cast<double>(source[c]) - decoded[i * 4 + c];
+			sum += d * d;
+		}
+	}
+	error.rmse = std::sqrt(sum / (static_cast<double>(width) * height * channels));
+	error.psnr = error.rmse > 0.0 ? 20.0 * std::log10(255.0 / error.rmse) : 99.0;
+	return error;
+}
+
+#endif // !BLOCK_COMPRESSION_H
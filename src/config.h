@@ -7,6 +7,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <string>
+
 #include <glm/glm.hpp>
 
 constexpr float PI = 3.14159265358979323846f;
@@ -21,6 +23,28 @@ constexpr int SCR_HEIGHT = 1080; // Screen height
 constexpr float z_near = 0.1f;   // camera near
 constexpr float z_far = 1000.0f; // camera far
 
+// Model loading
+// -------------
+const long long modelUploadBudgetMicroseconds = 4000; // GPU uploads of streamed-in models per frame
+const size_t textureStreamBudgetBytes = 2 * 1024 * 1024; // texels streamed into partially resident textures per frame
+
+// Texture residency
+// -----------------
+const size_t textureBudgetBytes = 256 * 1024 * 1024; // resident texture memory before top mips are evicted, 0 for no limit
+const unsigned int textureEvictFrames = 300;         // frames a texture must go unused before it loses mips
+
+// Image decoding
+// --------------
+const bool benchmarkImageDecoders = false; // at startup, decode every PNG under res/ with stb_image and png_decoder.h and print both timings
+
+// Self checks
+// -----------
+const bool runSelfChecks = false; // at startup, check the project's decoders and encoders on inputs built in memory (self_checks.h)
+
+// Shader programs
+// ---------------
+const std::string programCacheDirectory = "res/shaders/cache"; // linked program binaries (.yprog), "" compiles every run
+
 // Rock instancing
 // ---------------
 unsigned int instancingBuffer = 0; // instancing buffer id
@@ -35,13 +59,22 @@ glm::vec3* rotationAxis = new glm::vec3[amount];  // rotation axis for rocks
 float* rotationSpeeds = new float[amount];        // rotation speed for rocks
 const float rotationSpeedScale = 0.2f;
 
+// Rock LOD selection
+// ------------------
+constexpr unsigned int rockLodLevels = 4; // matches ModelLoadOptions::lodLevels of the rock model
+// projected bounding sphere radius (pixels) a rock needs to use LOD0, LOD1, LOD2; anything smaller uses LOD3
+const float rockLodScreenRadius[rockLodLevels - 1] = { 48.0f, 24.0f, 12.0f };
+const float rockLodHysteresis = 0.15f; // a rock changes level only once it is this fraction past a threshold
+
+unsigned char* rockLods = new unsigned char[amount]();       // current LOD of each rock
+glm::mat4* rockLodMatrices = new glm::mat4[amount];          // model matrices grouped by LOD, uploaded each frame
+glm::vec4 rockBoundingSphere = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f); // rock mesh bounds, xyz center, w radius
+
 // PBR materials
 // -------------
 unsigned int albedo = 0;     // albedo texture id
 unsigned int normal = 0;     // normal texture id
-unsigned int metallic = 0;   // metallic texture id
-unsigned int roughness = 0;  // roughness texture id
-unsigned int ao = 0;         // ao texture id
+unsigned int orm = 0;        // packed ao (r), roughness (g), metallic (b) texture id
 
 float metallicScale = 1.0f;  // Scale factor for metallic
 float roughnessScale = 1.0f; // Scale factor for roughness
@@ -84,6 +117,8 @@ glm::vec3 lightPosition = glm::vec3(0.0f, 0.0f, 12.0f);
 glm::vec3 lightColor = glm::vec3(0.0f, 0.0f, 150.0f);
 
 glm::vec3 directionalLightDirection = glm::vec3(1.0f, -0.4f, 0.0f);
+bool enablePositionalLight = true;  // press p to switch, selects the shader permutations with POINT_LIGHT
+bool enableDirectionalLight = true; // press l to switch, selects the shader permutations with DIR_LIGHT
 glm::vec3 directionalLightColor = glm::vec3(15.0f, 15.0f, 15.0f);
 const float directionalLightScale = 0.5f;
 
@@ -0,0 +1,252 @@
+// Reads and writes block compressed textures as DirectDraw Surface (.dds) files.
+// Written files always carry the DX10 extension header (DXGI format), which covers BC1-BC7;
+// reading also accepts the legacy FourCC codes (DXT1, DXT5, ATI1/BC4U, ATI2/BC5U) other tools write.
+// Only plain 2D textures with a full or partial mip chain are supported, no arrays, cubemaps or volumes.
+// Files written here tag reserved1[0..1] with kDDSWriterTag and a version, so the texture pipeline can
+// rebuild its own outdated files while leaving those of other tools alone.
+//
+// Usage Example:
+// WriteDDS("res/textures/rock.dds", image);
+// MappedFile file("res/textures/rock.dds");
+// CompressedImage loaded;
+// ReadDDS(file.Data(), file.Size(), loaded);
+
+#pragma once
+#ifndef DDS_FILE_H
+#define DDS_FILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#include "block_compression.h"
+
+constexpr uint32_t kDDSMagic = 0x20534444; // "DDS "
+constexpr uint32_t kDDSWriterTag = 0x54485A59; // "YZHT"
+
+struct DDSPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t bitMask[4];
+};
+
+struct DDSHeader
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DDSPixelFormat pixelFormat;
+	uint32_t caps[4];
+	uint32_t reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+static_assert(sizeof(DDSHeader) == 124, "DDSHeader must match the file layout");
+static_assert(sizeof(DDSHeaderDX10) == 20, "DDSHeaderDX10 must match the file layout");
+
+namespace dds_detail
+{
+	constexpr uint32_t kFlagsCaps = 0x1, kFlagsHeight = 0x2, kFlagsWidth = 0x4, kFlagsPixelFormat = 0x1000;
+	constexpr uint32_t kFlagsMipMapCount = 0x20000, kFlagsLinearSize = 0x80000;
+	constexpr uint32_t kPixelFormatFourCC = 0x4;
+	constexpr uint32_t kCapsComplex = 0x8, kCapsTexture = 0x1000, kCapsMipMap = 0x400000;
+	constexpr uint32_t kResourceDimensionTexture2D = 3;
+
+	constexpr uint32_t FourCC(char a, char b, char c, char d)
+	{
+		return static_cast<uint32_t>(static_cast<uint8_t>(a)) | (static_cast<uint32_t>(static_cast<uint8_t>(b)) << 8) |
+			(static_cast<uint32_t>(static_cast<uint8_t>(c)) << 16) | (static_cast<uint32_t>(static_cast<uint8_t>(d)) << 24);
+	}
+
+	// DXGI_FORMAT values, the _SRGB variants are read as their UNORM counterparts
+	constexpr uint32_t kDXGIBC1 = 71, kDXGIBC1SRGB = 72, kDXGIBC3 = 77, kDXGIBC3SRGB = 78;
+	constexpr uint32_t kDXGIBC4 = 80, kDXGIBC5 = 83, kDXGIBC7 = 98, kDXGIBC7SRGB = 99;
+
+	inline uint32_t ToDXGI(BlockFormat format)
+	{
+		switch (format) {
+		case BlockFormat::BC1: return kDXGIBC1;
+		case BlockFormat::BC3: return kDXGIBC3;
+		case BlockFormat::BC4: return kDXGIBC4;
+		case BlockFormat::BC5: return kDXGIBC5;
+		default: return kDXGIBC7;
+		}
+	}
+
+	inline bool FromDXGI(uint32_t dxgi, BlockFormat& format)
+	{
+		switch (dxgi) {
+		case kDXGIBC1: case kDXGIBC1SRGB: format = BlockFormat::BC1; return true;
+		case kDXGIBC3: case kDXGIBC3SRGB: format = BlockFormat::BC3; return true;
+		case kDXGIBC4: format = BlockFormat::BC4; return true;
+		case kDXGIBC5: format = BlockFormat::BC5; return true;
+		case kDXGIBC7: case kDXGIBC7SRGB: format = BlockFormat::BC7; return true;
+		default: return false;
+		}
+	}
+
+	inline bool FromFourCC(uint32_t fourCC, BlockFormat& format)
+	{
+		if (fourCC == FourCC('D', 'X', 'T', '1')) format = BlockFormat::BC1;
+		else if (fourCC == FourCC('D', 'X', 'T', '5')) format = BlockFormat::BC3;
+		else if (fourCC == FourCC('A', 'T', 'I', '1') || fourCC == FourCC('B', 'C', '4', 'U')) format = BlockFormat::BC4;
+		else if (fourCC == FourCC('A', 'T', 'I', '2') || fourCC == FourCC('B', 'C', '5', 'U')) format = BlockFormat::BC5;
+		else return false;
+		return true;
+	}
+}
+
+// Writes image with a DX10 header, returns false on I/O errors
+inline bool WriteDDS(const std::string& path, const CompressedImage& image, uint32_t writerVersion = 0)
+{
+	using namespace dds_detail;
+	if (image.levels.empty())
+		return false;
+
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = kFlagsCaps | kFlagsHeight | kFlagsWidth | kFlagsPixelFormat | kFlagsMipMapCount | kFlagsLinearSize;
+	header.height = static_cast<uint32_t>(image.height);
+	header.width = static_cast<uint32_t>(image.width);
+	header.pitchOrLinearSize = static_cast<uint32_t>(image.levels[0].size);
+	header.mipMapCount = static_cast<uint32_t>(image.levels.size());
+	header.reserved1[0] = kDDSWriterTag;
+	header.reserved1[1] = writerVersion;
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = kPixelFormatFourCC;
+	header.pixelFormat.fourCC = FourCC('D', 'X', '1', '0');
+	header.caps[0] = kCapsTexture | (image.levels.size() > 1 ? kCapsComplex | kCapsMipMap : 0u);
+
+	DDSHeaderDX10 dx10 = {};
+	dx10.dxgiFormat = ToDXGI(image.format);
+	dx10.resourceDimension = kResourceDimensionTexture2D;
+	dx10.arraySize = 1;
+
+	// Written beside the target and renamed over it, so an interrupted write never leaves a truncated .dds that is
+	// newer than its source
+	const std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+		uint32_t magic = kDDSMagic;
+		file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+		file.write(reinterpret_cast<const char*>(image.data.data()), static_cast<std::streamsize>(image.data.size()));
+		file.close(); // flushes, so a full disk shows up here
+		if (!file) {
+			std::error_code ec;
+			std::filesystem::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Parses a .dds file held in memory (e.g. a MappedFile) and copies its blocks into image.
+ * Returns false for unsupported formats or truncated files, including those whose data ends before the last of
+ * the declared mip levels.
+ */
+inline bool ReadDDS(const char* data, size_t size, CompressedImage& image)
+{
+	using namespace dds_detail;
+	image = CompressedImage();
+
+	uint32_t magic;
+	DDSHeader header;
+	if (size < sizeof(magic) + sizeof(header))
+		return false;
+	std::memcpy(&magic, data, sizeof(magic));
+	std::memcpy(&header, data + sizeof(magic), sizeof(header));
+	if (magic != kDDSMagic || header.size != sizeof(DDSHeader) || !(header.pixelFormat.flags & kPixelFormatFourCC))
+		return false;
+
+	size_t offset = sizeof(magic) + sizeof(header);
+	if (header.pixelFormat.fourCC == FourCC('D', 'X', '1', '0')) {
+		DDSHeaderDX10 dx10;
+		if (size < offset + sizeof(dx10))
+			return false;
+		std::memcpy(&dx10, data + offset, sizeof(dx10));
+		offset += sizeof(dx10);
+		if (dx10.resourceDimension != kResourceDimensionTexture2D || dx10.arraySize > 1 || !FromDXGI(dx10.dxgiFormat, image.format))
+			return false;
+	}
+	else if (!FromFourCC(header.pixelFormat.fourCC, image.format)) {
+		return false;
+	}
+
+	image.width = static_cast<int>(header.width);
+	image.height = static_cast<int>(header.height);
+	if (image.width <= 0 || image.height <= 0)
+		return false;
+
+	uint32_t levelCount = (header.flags & kFlagsMipMapCount) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+	int width = image.width, height = image.height;
+	size_t dataSize = 0;
+	for (uint32_t i = 0; i < levelCount; i++) {
+		CompressedLevel level;
+		level.width = width;
+		level.height = height;
+		level.offset = dataSize;
+		level.size = CompressedLevelSize(image.format, width, height);
+		if (offset + dataSize + level.size > size) {
+			image = CompressedImage(); // no partial chain, TextureImage::HasData checks the levels
+			return false;
+		}
+		dataSize += level.size;
+		image.levels.push_back(level);
+		if (width == 1 && height == 1)
+			break;
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+	if (image.levels.empty())
+		return false;
+
+	image.data.assign(reinterpret_cast<const uint8_t*>(data) + offset, reinterpret_cast<const uint8_t*>(data) + offset + dataSize);
+	return true;
+}
+
+// The writerVersion WriteDDS stored, 0 if the file is no .dds or was written by another tool
+inline uint32_t ReadDDSWriterVersion(const char* data, size_t size)
+{
+	uint32_t magic;
+	DDSHeader header;
+	if (size < sizeof(magic) + sizeof(header))
+		return 0;
+	std::memcpy(&magic, data, sizeof(magic));
+	std::memcpy(&header, data + sizeof(magic), sizeof(header));
+	if (magic != kDDSMagic || header.reserved1[0] != kDDSWriterTag)
+		return 0;
+	return header.reserved1[1];
+}
+
+#endif // !DDS_FILE_H
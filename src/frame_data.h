@@ -0,0 +1,143 @@
+// Per frame uniforms shared by every scene shader: camera matrices, light positions and time, written once a frame
+// into one uniform buffer instead of set on each program. FrameData mirrors the std140 "FrameData" block the
+// shaders declare; Shader::SetUniformBlock("FrameData", kFrameDataBinding) connects a program to it once.
+// The buffer is persistently mapped with kSlotCount slots, each guarded by a fence like TextureStreamer's ring, so
+// writing this frame's values does not wait for the GPU to finish drawing with the previous ones. Without a
+// mappable buffer it falls back to glBufferSubData into a single slot.
+//
+// Usage Example:
+// FrameUniformBuffer frameUniforms;
+// shader.SetUniformBlock("FrameData", kFrameDataBinding);
+// while (rendering) {
+//     FrameData frame;
+//     frame.projection = projection;
+//     ...
+//     frameUniforms.Update(frame); // bound to kFrameDataBinding until the next Update
+// }
+//
+// GL thread only.
+
+#pragma once
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <GL/gl3w.h>
+#include <glm/glm.hpp>
+
+// Uniform buffer binding point of the FrameData block
+constexpr GLuint kFrameDataBinding = 0;
+
+// std140 layout of the shaders' FrameData block: each vec3 is padded to 16 bytes by the float after it
+struct FrameData
+{
+	glm::mat4 projection = glm::mat4(1.0f);
+	glm::mat4 view = glm::mat4(1.0f);
+	glm::vec3 viewPos = glm::vec3(0.0f);        // camera position
+	float time = 0.0f;                          // glfwGetTime at the start of the frame
+	glm::vec3 lightPosition = glm::vec3(0.0f);  // positional light
+	float deltaTime = 0.0f;
+	glm::vec3 directionalLightDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+	float padding = 0.0f;
+};
+static_assert(sizeof(FrameData) == 176, "FrameData must match the std140 FrameData block");
+
+struct FrameUniformStats
+{
+	size_t updates = 0;
+	size_t fenceWaits = 0; // Updates that had to wait for the GPU to release their slot
+};
+
+class FrameUniformBuffer
+{
+public:
+	FrameUniformBuffer();
+	~FrameUniformBuffer();
+
+	FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+	FrameUniformBuffer& operator=(const FrameUniformBuffer&) = delete;
+
+	// Writes frame into the next slot and binds it to kFrameDataBinding
+	void Update(const FrameData& frame);
+
+	const FrameUniformStats& GetStats() const { return stats; }
+
+private:
+	static constexpr size_t kSlotCount = 3; // frames the GPU may be behind
+
+private:
+	unsigned int buffer = 0;
+	uint8_t* mapped = nullptr;  // nullptr: glBufferSubData into slot 0
+	size_t slotStride = 0;      // sizeof(FrameData) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	GLsync fences[kSlotCount] = {};
+	size_t slot = kSlotCount;   // last written, none yet
+	FrameUniformStats stats;
+};
+
+FrameUniformBuffer::FrameUniformBuffer()
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	slotStride = (sizeof(FrameData) + alignment - 1) / alignment * alignment;
+
+	GLsizeiptr size = static_cast<GLsizeiptr>(kSlotCount * slotStride);
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags | GL_DYNAMIC_STORAGE_BIT);
+	mapped = static_cast<uint8_t*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	if (!mapped)
+		std::cerr << "Failed to map the frame uniform buffer, updating it with glBufferSubData\n";
+}
+
+FrameUniformBuffer::~FrameUniformBuffer()
+{
+	for (GLsync& fence : fences) {
+		if (fence)
+			glDeleteSync(fence);
+	}
+	if (mapped) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+void FrameUniformBuffer::Update(const FrameData& frame)
+{
+	stats.updates++;
+	if (!mapped) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frame);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferRange(GL_UNIFORM_BUFFER, kFrameDataBinding, buffer, 0, sizeof(FrameData));
+		return;
+	}
+
+	// Every draw reading the previous slot has been issued by now
+	if (slot < kSlotCount)
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot = (slot + 1) % kSlotCount;
+
+	GLsync& fence = fences[slot];
+	if (fence) {
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			stats.fenceWaits++;
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	size_t offset = slot * slotStride;
+	std::memcpy(mapped + offset, &frame, sizeof(FrameData));
+	glBindBufferRange(GL_UNIFORM_BUFFER, kFrameDataBinding, buffer, static_cast<GLintptr>(offset), sizeof(FrameData));
+}
+
+#endif // !FRAME_DATA_H
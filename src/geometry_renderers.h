@@ -15,6 +15,9 @@
 #include <cmath>
 #include <GL/gl3w.h>
 #include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "tangent_space.h"
 
 namespace yzh {
 
@@ -131,10 +134,11 @@ namespace yzh {
 	// Vertex attributes include position, normal, and texture coordinates.
 	// The sphere is detailed with 64 segments along both the X and Y axes, resulting in a highly detailed mesh.
 	// he function allows for customization of the sphere's detail level through x_segments and y_segments.
+	// withTangents adds per-vertex tangents (w = handedness, see tangent_space.h) at attribute location 7.
 	class Sphere: public GeometryShape
 	{
 	public:
-		Sphere(const unsigned int x_segments = 64, const unsigned int y_segments = 64) 
+		Sphere(const unsigned int x_segments = 64, const unsigned int y_segments = 64, bool withTangents = false) 
 		{
 			if (this->VAO == 0) {
 				glGenVertexArrays(1, &VAO);
@@ -178,9 +182,32 @@ namespace yzh {
 
 				indexCount = (unsigned int)indices.size();
 
+				// Tangents from the strip's triangles, every other one has flipped winding.
+				// The zero area triangles joining two rows are skipped by GenerateTangents.
+				std::vector<glm::vec4> tangents;
+				if (withTangents) {
+					std::vector<unsigned int> triangles;
+					triangles.reserve(indices.size() * 3);
+					for (size_t i = 0; i + 2 < indices.size(); i++) {
+						bool even = (i % 2) == 0;
+						triangles.push_back(indices[even ? i : i + 1]);
+						triangles.push_back(indices[even ? i + 1 : i]);
+						triangles.push_back(indices[i + 2]);
+					}
+					const size_t vertexCount = data.size() / 8;
+					const glm::vec3* positions = reinterpret_cast<const glm::vec3*>(&data[0]);
+					const glm::vec3* normals = reinterpret_cast<const glm::vec3*>(&data[3]);
+					const glm::vec2* texCoords = reinterpret_cast<const glm::vec2*>(&data[6]);
+					tangents.resize(vertexCount);
+					GenerateTangents(positions, normals, texCoords, 8 * sizeof(float), vertexCount,
+						triangles.data(), triangles.size(), tangents.data());
+				}
+				const size_t dataBytes = data.size() * sizeof(float);
+
 				glBindVertexArray(VAO);
 				glBindBuffer(GL_ARRAY_BUFFER, VBO);
-				glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
+				glBufferData(GL_ARRAY_BUFFER, dataBytes + tangents.size() * sizeof(glm::vec4), nullptr, GL_STATIC_DRAW);
+				glBufferSubData(GL_ARRAY_BUFFER, 0, dataBytes, &data[0]);
 				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
 				glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
@@ -190,6 +217,11 @@ namespace yzh {
 				glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
 				glEnableVertexAttribArray(2);
 				glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+				if (withTangents) {
+					glBufferSubData(GL_ARRAY_BUFFER, dataBytes, tangents.size() * sizeof(glm::vec4), tangents.data());
+					glEnableVertexAttribArray(7);
+					glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)dataBytes);
+				}
 			}
 		}
 
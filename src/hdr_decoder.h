@@ -0,0 +1,417 @@
+// Radiance .hdr (RGBE) decoder for the HDR environment maps, converting each scanline straight to a GPU format
+// instead of going through stbi_loadf's 32-bit floats:
+//   HDRFormat::RGB9E5  GL_RGB9_E5, 4 bytes per pixel. RGBE is a shared exponent format already, so unless a
+//                      pixel's brightest channel is beyond 65408 or below 2^-16 the conversion only moves
+//                      bits and is exact (SSE2 does 4 such pixels at once)
+//   HDRFormat::Half    GL_RGB16F, 6 bytes per pixel, rounded to nearest even (F16C when the compiler targets it)
+// Scanlines are run-length decoded into one small RGBE row at a time, so the peak is the mapped file plus the
+// output, a third (RGB9E5) or half (Half) of stbi_loadf's float image. Vertical flip is a per call argument,
+// there is no global flag to leak into other loads.
+// Only the common "-Y height +X width" layout with new style RLE or flat scanlines is read; DecodeHDR returns
+// false for anything else and DecodeHDRImage falls back to stbi_loadf, packing its floats with FloatToRGB9E5.
+//
+// Usage Example:
+// HDRInfo info;
+// if (ReadHDRInfo(data, size, info)) {
+//     std::vector<uint32_t> pixels(static_cast<size_t>(info.width) * info.height);
+//     DecodeHDR(data, size, info, HDRFormat::RGB9E5, true, pixels.data()); // flipped for OpenGL
+//     glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, info.width, info.height, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, pixels.data());
+// }
+// uint32_t* image = DecodeHDRImage(data, size, width, height, true); // any HDR stb_image reads, free with stbi_image_free
+
+#pragma once
+#ifndef HDR_DECODER_H
+#define HDR_DECODER_H
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HDR_DECODER_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__F16C__) || defined(__AVX2__)
+#define HDR_DECODER_F16C 1
+#include <immintrin.h>
+#endif
+
+enum class HDRFormat
+{
+	RGB9E5, // one uint32_t per pixel, GL_UNSIGNED_INT_5_9_9_9_REV
+	Half,   // three uint16_t half floats per pixel, GL_HALF_FLOAT
+};
+
+struct HDRInfo
+{
+	int width = 0, height = 0;
+	size_t dataOffset = 0; // first scanline, after the header and resolution line
+
+	size_t Bytes(HDRFormat format) const
+	{
+		return static_cast<size_t>(width) * height * (format == HDRFormat::RGB9E5 ? sizeof(uint32_t) : 3 * sizeof(uint16_t));
+	}
+};
+
+// Parses the header, false if data is no Radiance file or not in the "-Y h +X w" layout
+inline bool ReadHDRInfo(const uint8_t* data, size_t size, HDRInfo& info);
+
+/**
+ * Decodes the scanlines into pixels (info.Bytes(format) bytes), written once each, top row first unless flip is set.
+ *
+ * @return false if the file is truncated or uses the old style RLE; pixels is then partially written.
+ */
+inline bool DecodeHDR(const uint8_t* data, size_t size, const HDRInfo& info, HDRFormat format, bool flip, void* pixels);
+
+// GL_RGB9_E5 packing of linear floats (GL spec, section 8.5.2), for images stbi_loadf had to decode
+inline uint32_t FloatToRGB9E5(float r, float g, float b);
+
+// RGB9E5 pixels of any HDR image, through DecodeHDR or else stbi_loadf, nullptr if neither can read it
+inline uint32_t* DecodeHDRImage(const uint8_t* data, size_t size, int& width, int& height, bool flip);
+
+namespace hdr_detail
+{
+	// Exponent bias between RGBE (value = m * 2^(E - 136)) and RGB9E5 (value = m9 * 2^(e - 24)), with m9 = 2m
+	constexpr int kRGB9E5Bias = 113;
+
+	inline uint32_t RGBEToRGB9E5(const uint8_t* rgbe)
+	{
+		int exponent = rgbe[3];
+		if (exponent == 0)
+			return 0;
+		uint32_t r = rgbe[0] << 1, g = rgbe[1] << 1, b = rgbe[2] << 1;
+		int e = exponent - kRGB9E5Bias;
+		if (e < 0) {
+			// Below the smallest exponent: denormalize, rounding to nearest
+			int shift = -e;
+			if (shift > 10)
+				return 0;
+			uint32_t half = 1u << (shift - 1);
+			r = (r + half) >> shift;
+			g = (g + half) >> shift;
+			b = (b + half) >> shift;
+			r = std::min(r, 511u); g = std::min(g, 511u); b = std::min(b, 511u);
+			e = 0;
+		}
+		else if (e > 31) {
+			// Beyond 65408: saturate each channel
+			int shift = std::min(e - 31, 9);
+			r = std::min(r << shift, 511u);
+			g = std::min(g << shift, 511u);
+			b = std::min(b << shift, 511u);
+			e = 31;
+		}
+		return r | (g << 9) | (b << 18) | (static_cast<uint32_t>(e) << 27);
+	}
+
+	inline uint16_t FloatToHalf(float value)
+	{
+		// Non-negative input only; clamped to the largest half, rounded to nearest even
+		value = std::min(std::max(value, 0.0f), 65504.0f);
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		if (bits < (113u << 23)) {
+			// Subnormal half: let the float adder do the rounding
+			const float magic = 0.5f; // 2^-1, aligns the half denormal lsb with the float lsb
+			float shifted = value + magic;
+			uint32_t shiftedBits, magicBits;
+			std::memcpy(&shiftedBits, &shifted, sizeof(shiftedBits));
+			std::memcpy(&magicBits, &magic, sizeof(magicBits));
+			return static_cast<uint16_t>(shiftedBits - magicBits);
+		}
+		uint32_t odd = (bits >> 13) & 1;
+		bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFF + odd;
+		return static_cast<uint16_t>(bits >> 13);
+	}
+
+	// RGBE pixel to float, as stb_image and the Radiance reference code do it: m * 2^(E - 136)
+	inline float RGBEComponent(uint8_t mantissa, uint8_t exponent)
+	{
+		return exponent == 0 ? 0.0f : std::ldexp(static_cast<float>(mantissa), exponent - 136);
+	}
+
+	inline void ConvertRowRGB9E5(const uint8_t* rgbe, int width, uint32_t* out)
+	{
+		int x = 0;
+#ifdef HDR_DECODER_SSE2
+		// Pixels with E = 0 or E in [113, 144] (e in [0, 31]) only move bits; SSE2 has no per lane shift for the
+		// denormalizing and saturating cases, so a group of 4 holding one of those goes through RGBEToRGB9E5
+		const __m128i zero = _mm_setzero_si128();
+		for (; x + 4 <= width; x += 4) {
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgbe + x * 4)); // r | g << 8 | b << 16 | E << 24
+			__m128i exponent = _mm_srli_epi32(pixels, 24);
+			__m128i e = _mm_sub_epi32(exponent, _mm_set1_epi32(kRGB9E5Bias));
+			__m128i black = _mm_cmpeq_epi32(exponent, zero);
+			__m128i exact = _mm_and_si128(_mm_cmpgt_epi32(e, _mm_set1_epi32(-1)), _mm_cmplt_epi32(e, _mm_set1_epi32(32)));
+			if (_mm_movemask_epi8(_mm_or_si128(black, exact)) != 0xFFFF) {
+				for (int i = 0; i < 4; i++)
+					out[x + i] = RGBEToRGB9E5(rgbe + (x + i) * 4);
+				continue;
+			}
+			// m9 = 2m: r to bits 0-8, g to 9-17, b to 18-26
+			__m128i r = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0xFF)), 1);
+			__m128i g = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0xFF00)), 2);
+			__m128i b = _mm_slli_epi32(_mm_and_si128(pixels, _mm_set1_epi32(0xFF0000)), 3);
+			__m128i packed = _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, _mm_slli_epi32(e, 27)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_andnot_si128(black, packed));
+		}
+#endif
+		for (; x < width; x++)
+			out[x] = RGBEToRGB9E5(rgbe + x * 4);
+	}
+
+#ifdef HDR_DECODER_SSE2
+	// 4 RGBE pixels (16 bytes) -> the R, G, B and unused fourth float vectors, one lane per pixel
+	inline void RGBEToFloat4(const uint8_t* rgbe, __m128 channels[3])
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgbe));
+		__m128i lo = _mm_unpacklo_epi8(bytes, zero), hi = _mm_unpackhi_epi8(bytes, zero);
+		__m128i p01 = _mm_unpacklo_epi16(lo, zero), p1 = _mm_unpackhi_epi16(lo, zero);
+		__m128i p2 = _mm_unpacklo_epi16(hi, zero), p3 = _mm_unpackhi_epi16(hi, zero);
+		// Transpose 4 pixels of (r, g, b, e) into r, g, b, e vectors
+		__m128i t0 = _mm_unpacklo_epi32(p01, p1), t1 = _mm_unpacklo_epi32(p2, p3);
+		__m128i t2 = _mm_unpackhi_epi32(p01, p1), t3 = _mm_unpackhi_epi32(p2, p3);
+		__m128i r = _mm_unpacklo_epi64(t0, t1), g = _mm_unpackhi_epi64(t0, t1);
+		__m128i b = _mm_unpacklo_epi64(t2, t3), e = _mm_unpackhi_epi64(t2, t3);
+
+		// 2^(E - 136) built in the exponent field; E = 0 gives 0, E below 10 (values under 2^-126) flush to 0
+		__m128i biased = _mm_sub_epi32(e, _mm_set1_epi32(136 - 127));
+		__m128i valid = _mm_cmpgt_epi32(biased, zero);
+		__m128 scale = _mm_castsi128_ps(_mm_and_si128(_mm_slli_epi32(biased, 23), valid));
+		channels[0] = _mm_mul_ps(_mm_cvtepi32_ps(r), scale);
+		channels[1] = _mm_mul_ps(_mm_cvtepi32_ps(g), scale);
+		channels[2] = _mm_mul_ps(_mm_cvtepi32_ps(b), scale);
+	}
+
+	// Non-negative floats to half floats in the low 16 bits of each lane
+	inline __m128i FloatToHalf4(__m128 value)
+	{
+#ifdef HDR_DECODER_F16C
+		value = _mm_min_ps(value, _mm_set1_ps(65504.0f));
+		return _mm_unpacklo_epi16(_mm_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT), _mm_setzero_si128());
+#else
+		value = _mm_min_ps(value, _mm_set1_ps(65504.0f));
+		__m128i bits = _mm_castps_si128(value);
+		const __m128 magic = _mm_set1_ps(0.5f);
+		__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(value, magic)), _mm_castps_si128(magic));
+		__m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+		__m128i normal = _mm_add_epi32(bits, _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(15 - 127) << 23) + 0xFFF)));
+		normal = _mm_srli_epi32(_mm_add_epi32(normal, odd), 13);
+		__m128i isSubnormal = _mm_cmplt_epi32(bits, _mm_set1_epi32(113 << 23));
+		return _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+#endif
+	}
+#endif
+
+	inline void ConvertRowHalf(const uint8_t* rgbe, int width, uint16_t* out)
+	{
+		int x = 0;
+#ifdef HDR_DECODER_SSE2
+		for (; x + 4 <= width; x += 4) {
+			__m128 channels[3];
+			RGBEToFloat4(rgbe + x * 4, channels);
+			__m128i r = FloatToHalf4(channels[0]), g = FloatToHalf4(channels[1]), b = FloatToHalf4(channels[2]);
+			uint16_t halves[3][4];
+			uint32_t lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), r);
+			for (int i = 0; i < 4; i++) halves[0][i] = static_cast<uint16_t>(lanes[i]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), g);
+			for (int i = 0; i < 4; i++) halves[1][i] = static_cast<uint16_t>(lanes[i]);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), b);
+			for (int i = 0; i < 4; i++) halves[2][i] = static_cast<uint16_t>(lanes[i]);
+			// Interleave to RGB
+			uint16_t* target = out + x * 3;
+			for (int i = 0; i < 4; i++) {
+				target[i * 3 + 0] = halves[0][i];
+				target[i * 3 + 1] = halves[1][i];
+				target[i * 3 + 2] = halves[2][i];
+			}
+		}
+#endif
+		for (; x < width; x++) {
+			const uint8_t* p = rgbe + x * 4;
+			for (int c = 0; c < 3; c++) {
+				float value = RGBEComponent(p[c], p[3]);
+				out[x * 3 + c] = value < std::ldexp(1.0f, -126) ? 0 : FloatToHalf(value); // flushed like the SIMD path
+			}
+		}
+	}
+
+	// One scanline into rgbe (width * 4 bytes), advancing p. False on truncated data or old style RLE.
+	inline bool ReadScanline(const uint8_t*& p, const uint8_t* end, int width, uint8_t* rgbe)
+	{
+		if (end - p < 4)
+			return false;
+		bool rle = width >= 8 && width < 32768 && p[0] == 2 && p[1] == 2 && !(p[2] & 0x80);
+		if (!rle) {
+			// Flat pixels; a (1, 1, 1, n) repeat marker of the old RLE is not supported
+			if (static_cast<size_t>(end - p) < static_cast<size_t>(width) * 4)
+				return false;
+			for (int x = 0; x < width; x++) {
+				if (p[x * 4] == 1 && p[x * 4 + 1] == 1 && p[x * 4 + 2] == 1)
+					return false;
+			}
+			std::memcpy(rgbe, p, static_cast<size_t>(width) * 4);
+			p += static_cast<size_t>(width) * 4;
+			return true;
+		}
+
+		if (((p[2] << 8) | p[3]) != width)
+			return false;
+		p += 4;
+		// Each channel is run-length coded separately: a count above 128 repeats the next byte count - 128 times
+		for (int c = 0; c < 4; c++) {
+			int x = 0;
+			while (x < width) {
+				if (p >= end)
+					return false;
+				int count = *p++;
+				if (count > 128) {
+					count -= 128;
+					if (count > width - x || p >= end)
+						return false;
+					uint8_t value = *p++;
+					for (int i = 0; i < count; i++)
+						rgbe[(x + i) * 4 + c] = value;
+				}
+				else {
+					if (count == 0 || count > width - x || end - p < count)
+						return false;
+					for (int i = 0; i < count; i++)
+						rgbe[(x + i) * 4 + c] = p[i];
+					p += count;
+				}
+				x += count;
+			}
+		}
+		return true;
+	}
+}
+
+inline bool ReadHDRInfo(const uint8_t* data, size_t size, HDRInfo& info)
+{
+	const char* text = reinterpret_cast<const char*>(data);
+	if (size < 11 || (std::strncmp(text, "#?RADIANCE\n", 11) != 0 && (size < 7 || std::strncmp(text, "#?RGBE\n", 7) != 0)))
+		return false;
+
+	// Header lines up to an empty one, then the resolution line
+	size_t offset = 0;
+	bool rgbe = true;
+	for (;;) {
+		size_t lineEnd = offset;
+		while (lineEnd < size && data[lineEnd] != '\n')
+			lineEnd++;
+		if (lineEnd >= size)
+			return false;
+		std::string line(text + offset, lineEnd - offset);
+		offset = lineEnd + 1;
+		if (line.empty())
+			break;
+		if (line.compare(0, 7, "FORMAT=") == 0)
+			rgbe = line == "FORMAT=32-bit_rle_rgbe";
+	}
+	if (!rgbe)
+		return false; // XYZE
+
+	size_t lineEnd = offset;
+	while (lineEnd < size && data[lineEnd] != '\n')
+		lineEnd++;
+	if (lineEnd >= size)
+		return false;
+	std::string resolution(text + offset, lineEnd - offset);
+	int height = 0, width = 0;
+	char extra;
+	if (std::sscanf(resolution.c_str(), "-Y %d +X %d%c", &height, &width, &extra) != 2 || width <= 0 || height <= 0 ||
+		width > (1 << 16) || height > (1 << 16)) {
+		return false;
+	}
+
+	info.width = width;
+	info.height = height;
+	info.dataOffset = lineEnd + 1;
+	return true;
+}
+
+inline bool DecodeHDR(const uint8_t* data, size_t size, const HDRInfo& info, HDRFormat format, bool flip, void* pixels)
+{
+	using namespace hdr_detail;
+	const uint8_t* p = data + info.dataOffset;
+	const uint8_t* end = data + size;
+	// One RGBE row plus padding for the 16 byte SIMD loads
+	std::vector<uint8_t> rgbe(static_cast<size_t>(info.width) * 4 + 16);
+
+	for (int y = 0; y < info.height; y++) {
+		if (!ReadScanline(p, end, info.width, rgbe.data()))
+			return false;
+		size_t row = static_cast<size_t>(flip ? info.height - 1 - y : y) * info.width;
+		if (format == HDRFormat::RGB9E5)
+			ConvertRowRGB9E5(rgbe.data(), info.width, static_cast<uint32_t*>(pixels) + row);
+		else
+			ConvertRowHalf(rgbe.data(), info.width, static_cast<uint16_t*>(pixels) + row * 3);
+	}
+	return true;
+}
+
+inline uint32_t FloatToRGB9E5(float r, float g, float b)
+{
+	// Largest representable value: (511 / 512) * 2^16
+	const float maxValue = 511.0f / 512.0f * 65536.0f;
+	r = std::min(std::max(r, 0.0f), maxValue);
+	g = std::min(std::max(g, 0.0f), maxValue);
+	b = std::min(std::max(b, 0.0f), maxValue);
+	float maxChannel = std::max(r, std::max(g, b));
+
+	int exponent = std::max(-16, static_cast<int>(std::floor(std::log2(std::max(maxChannel, 1e-30f))))) + 1 + 15;
+	float scale = std::ldexp(1.0f, exponent - 15 - 9);
+	if (static_cast<int>(std::floor(maxChannel / scale + 0.5f)) == 512) {
+		exponent++;
+		scale *= 2.0f;
+	}
+	uint32_t rm = static_cast<uint32_t>(std::floor(r / scale + 0.5f));
+	uint32_t gm = static_cast<uint32_t>(std::floor(g / scale + 0.5f));
+	uint32_t bm = static_cast<uint32_t>(std::floor(b / scale + 0.5f));
+	return std::min(rm, 511u) | (std::min(gm, 511u) << 9) | (std::min(bm, 511u) << 18) | (static_cast<uint32_t>(exponent) << 27);
+}
+
+inline uint32_t* DecodeHDRImage(const uint8_t* data, size_t size, int& width, int& height, bool flip)
+{
+	HDRInfo info;
+	if (ReadHDRInfo(data, size, info)) {
+		// malloc, like stb_image, so stbi_image_free releases both
+		uint32_t* pixels = static_cast<uint32_t*>(std::malloc(info.Bytes(HDRFormat::RGB9E5)));
+		if (pixels && DecodeHDR(data, size, info, HDRFormat::RGB9E5, flip, pixels)) {
+			width = info.width;
+			height = info.height;
+			return pixels;
+		}
+		std::free(pixels);
+	}
+
+	// Per thread, the global flag would leak into every later load
+	int components;
+	stbi_set_flip_vertically_on_load_thread(flip);
+	float* floats = stbi_loadf_from_memory(data, static_cast<int>(size), &width, &height, &components, 3);
+	stbi_set_flip_vertically_on_load_thread(false);
+	if (!floats)
+		return nullptr;
+	// Packed in place: pixel i is written after its three floats at 3i were read
+	uint32_t* pixels = reinterpret_cast<uint32_t*>(floats);
+	size_t count = static_cast<size_t>(width) * height;
+	for (size_t i = 0; i < count; i++)
+		pixels[i] = FloatToRGB9E5(floats[i * 3], floats[i * 3 + 1], floats[i * 3 + 2]);
+	return pixels;
+}
+
+#endif // !HDR_DECODER_H
@@ -6,6 +6,14 @@
 #include <glm/glm.hpp>
 #include <random>
 
+// Instances per LOD bucket in the last RenderInstancingRocks call
+struct RockLodStats
+{
+	unsigned int instances[rockLodLevels] = {};
+	size_t triangles = 0; // drawn over all buckets
+};
+RockLodStats rockLodStats;
+
 void InitModelMatricesAndRotationSpeeds(glm::mat4* modelMatrices, glm::vec3* rotationAxis, float* rotationSpeeds)
 {
 	std::random_device rd;
@@ -38,10 +46,19 @@ void InitModelMatricesAndRotationSpeeds(glm::mat4* modelMatrices, glm::vec3* rot
 
 void SetupInstancingBuffer(unsigned int& instancingBuffer, glm::mat4* modelMatrices, const Model& rock)
 {
-	// Generate and bind the instancing buffer
+	// Generate and bind the instancing buffer, rewritten every frame in LOD order
 	glGenBuffers(1, &instancingBuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, instancingBuffer);
-	glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), modelMatrices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), modelMatrices, GL_DYNAMIC_DRAW);
+
+	// Bounding sphere of the rock, for the projected size of each instance
+	glm::vec3 boundsMin, boundsMax;
+	ComputeBounds(rock.GetMesh()[0].vertices, boundsMin, boundsMax);
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float boundingRadius = 0.0f;
+	for (const Vertex& vertex : rock.GetMesh()[0].vertices)
+		boundingRadius = std::max(boundingRadius, glm::length(vertex.position - center));
+	rockBoundingSphere = glm::vec4(center, boundingRadius);
 
 	// Set up vertex attributes for each mesh in the rock model
 	for (unsigned int i = 0; i < rock.GetMesh().size(); i++) {
@@ -69,22 +86,83 @@ void UpdateModelMatrices(float deltaTime)
 		model = glm::rotate(model, angle, rotationAxis[i]); // random angle & random axis
 		modelMatrices[i] = model;
 	}
-	// Update the buffer with the new transformations
+	// The buffer is updated by RenderInstancingRocks, grouped by LOD
+}
+
+/**
+ * Picks the LOD of every rock from the projected radius of its bounding sphere, with hysteresis
+ * so rocks near a threshold do not flicker between levels, and writes the model matrices into
+ * instancingBuffer grouped by LOD.
+ *
+ * @param firstInstance Receives the first instance of each LOD bucket.
+ * @param instanceCount Receives the instances in each LOD bucket.
+ */
+void SortRocksByLod(const glm::mat4& projection, const glm::vec3& viewPos,
+	unsigned int* firstInstance, unsigned int* instanceCount)
+{
+	// Pixels per unit of radius at distance 1
+	const float pixelScale = projection[1][1] * 0.5f * (float)SCR_HEIGHT;
+
+	for (unsigned int l = 0; l < rockLodLevels; l++)
+		instanceCount[l] = 0;
+
+	for (unsigned int i = 0; i < amount; i++) {
+		const glm::mat4& model = modelMatrices[i];
+		glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(rockBoundingSphere), 1.0f));
+		float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		float distance = std::max(glm::length(center - viewPos), z_near);
+		float screenRadius = rockBoundingSphere.w * scale * pixelScale / distance;
+
+		// Refine while the rock is clearly above the threshold of the next finer level,
+		// coarsen while it is clearly below the threshold of its own level
+		unsigned int lod = rockLods[i];
+		while (lod > 0 && screenRadius > rockLodScreenRadius[lod - 1] * (1.0f + rockLodHysteresis))
+			lod--;
+		while (lod + 1 < rockLodLevels && screenRadius < rockLodScreenRadius[lod] * (1.0f - rockLodHysteresis))
+			lod++;
+		rockLods[i] = (unsigned char)lod;
+		instanceCount[lod]++;
+	}
+
+	unsigned int next[rockLodLevels];
+	for (unsigned int l = 0, first = 0; l < rockLodLevels; l++) {
+		firstInstance[l] = next[l] = first;
+		first += instanceCount[l];
+	}
+	for (unsigned int i = 0; i < amount; i++)
+		rockLodMatrices[next[rockLods[i]]++] = modelMatrices[i];
+
 	glBindBuffer(GL_ARRAY_BUFFER, instancingBuffer);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, amount * sizeof(glm::mat4), &modelMatrices[0][0]);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, amount * sizeof(glm::mat4), &rockLodMatrices[0][0]);
 }
 
-void RenderInstancingRocks(Shader& rockShader, Model& rock)
+void RenderInstancingRocks(Shader& rockShader, Model& rock, const glm::mat4& projection, const glm::vec3& viewPos)
 {
+	unsigned int firstInstance[rockLodLevels], instanceCount[rockLodLevels];
+	SortRocksByLod(projection, viewPos, firstInstance, instanceCount);
+
 	rockShader.Bind();
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, rock.GetMesh()[0].textures[0].id);
+	glBindTexture(GL_TEXTURE_2D, rock.GetMesh()[0].textures[0].Use());
+	rock.GetMesh()[0].SetVertexFormatUniforms(rockShader);
 
 	// Special case: The rock model has only one mesh.
-	// Directly bind its VAO and draw it instanced.
+	// Directly bind its VAO and draw it instanced, once per LOD bucket.
 	// Note: This won't work for models with multiple meshes.
-	glBindVertexArray(rock.GetMesh()[0].GetVAO());
-	glDrawElementsInstanced(GL_TRIANGLES, (unsigned int)(rock.GetMesh()[0].indices.size()), GL_UNSIGNED_INT, 0, amount);
+	const Mesh& mesh = rock.GetMesh()[0];
+	rockLodStats.triangles = 0;
+	glBindVertexArray(mesh.GetVAO());
+	for (unsigned int l = 0; l < rockLodLevels; l++) {
+		rockLodStats.instances[l] = instanceCount[l];
+		if (instanceCount[l] == 0)
+			continue;
+
+		// Clamped to the coarsest level the mesh has; baseInstance offsets the instanced matrix attribute
+		MeshLod lod = mesh.GetLod(l);
+		glDrawElementsInstancedBaseInstance(GL_TRIANGLES, (GLsizei)lod.indexCount, GL_UNSIGNED_INT,
+			(void*)(lod.indexOffset * sizeof(unsigned int)), (GLsizei)instanceCount[l], firstInstance[l]);
+		rockLodStats.triangles += (size_t)lod.indexCount / 3 * instanceCount[l];
+	}
 	glBindVertexArray(0);
 }
 
@@ -9,25 +9,34 @@
 
 #include "camera.h"
 #include "geometry_renderers.h"
+#include "image_benchmark.h"
+#include "self_checks.h"
 #include "scene_manager.h"
 #include "shader.h"
+#include "shader_variants.h"
 #include "timer.h"
 #include "model.h"
+#include "async_model_loader.h"
 #include "config.h"
+#include "frame_data.h"
 #include "pbr.h"
 #include "instancing.h"
 #include "bloom.h"
 #include "skybox.h"
 
 // to send static uniforms to the gpu before entering render loop, prevent multiple sending to optimize.
+// Also connects every shader to the FrameData block (camera, lights, time), updated once per frame.
 void SetupStaticUniforms(Shader& skyboxShader, 
-	Shader& planetPBRShader, 
+	ShaderVariants& planetPBRShaders, 
 	Shader& geometryPBRShader, 
 	Shader& rockShader, 
-	Shader& nanosuitShader, 
+	ShaderVariants& nanosuitShaders, 
 	Shader& nanosuitExplosionShader, 
 	Shader& bloomShader);
 
+// ShaderFeature bits of the scene's permutations, from the lighting switches
+uint32_t SceneShaderFeatures();
+
 int main()
 {
 #ifdef _DEBUG
@@ -51,38 +60,62 @@ int main()
 	scene_manager.Enable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+	if (benchmarkImageDecoders)
+		BenchmarkImageDecoders("res");
+	if (runSelfChecks && !RunSelfChecks())
+		std::cerr << "self checks failed, see above\n";
+
 	// Load model(s)
 	// -------------
-	Model rock("res/models/rock/rock.obj");
-	Model nanosuit("res/models/nanosuit/nanosuit.obj");
+	// Parsed and decoded on worker threads while the rest of the scene is set up,
+	// uploaded a few milliseconds per frame from the render loop. Each model is drawn once it is ready.
+	// Both use the 16-byte quantized vertex layout, set quantizeVertices to false to compare with float vertices.
+	ModelLoadOptions modelOptions;
+	modelOptions.quantizeVertices = true;
+	modelOptions.compressTextures = true; // BCn .dds beside each texture, built on the first run
+	modelOptions.streamTextures = true;   // drawn from their smallest mips first, refined a few MB per frame
+	ModelLoadOptions rockOptions = modelOptions;
+	rockOptions.lodLevels = rockLodLevels; // distant asteroids draw simplified levels
+	ModelLoadOptions nanosuitOptions = modelOptions;
+	nanosuitOptions.textureArrays = true; // all materials in texture arrays, drawn with RenderBatched
+	TextureCache::Instance().SetBudget(textureBudgetBytes, textureEvictFrames);
+	AsyncModelLoader modelLoader;
+	ModelHandle rock = modelLoader.Load("res/models/rock/rock.obj", rockOptions);
+	ModelHandle nanosuit = modelLoader.Load("res/models/nanosuit/nanosuit.obj", nanosuitOptions);
 
 	// Set VAO for geometry shape for later use
 	//yzh::Quad quad;
 	//yzh::Cube cube;
 	yzh::Sphere sphere;
-	yzh::Sphere pbrSphere;
+	yzh::Sphere pbrSphere(64, 64, true); // tangents for the normal mapped PBR shader
 
 	// Build & compile shader(s)
 	// -------------------------
-	Shader skyboxShader("res/shaders/skybox.vert", "res/shaders/skybox.frag"); // sky box shader, render 1st
-	Shader rockShader("res/shaders/instancing_rock.vert", "res/shaders/instancing_rock.frag"); // instancing rock shader, alpha 1.0f
-	Shader planetPBRShader("res/shaders/planet_pbr.vert", "res/shaders/planet_pbr.frag"); // PBR material planet, enable showing normal by pressing N
-	Shader nanosuitShader("res/shaders/nanosuit.vert", "res/shaders/nanosuit.frag"); // nanosuit shader, enable explosion by pressing B
-	Shader geometryPBRShader("res/shaders/geometry_planet_pbr.vert", "res/shaders/geometry_planet_pbr.frag", "res/shaders/geometry_planet_pbr.geom");
-	Shader nanosuitExplosionShader("res/shaders/geometry_nanosuit.vert", "res/shaders/geometry_nanosuit.frag", "res/shaders/geometry_nanosuit.geom");
-
-	Shader bloomShader("res/shaders/bloom_light.vert", "res/shaders/bloom_light.frag"); // light source shader, but this one will render into two channels
+	// Linked programs are cached on disk and restored with glProgramBinary from the second run on.
+	// The rest are all submitted before any is waited for; the render loop draws with each once it is ready.
+	ProgramCache::Instance().SetDirectory(programCacheDirectory);
+	Shader skyboxShader("res/shaders/skybox.vert", "res/shaders/skybox.frag", "", ShaderCompile::Async); // sky box shader, render 1st
+	Shader rockShader("res/shaders/instancing_rock.vert", "res/shaders/instancing_rock.frag", "", ShaderCompile::Async); // instancing rock shader, alpha 1.0f
+	// PBR material planet, enable showing normal by pressing N
+	ShaderVariants planetPBRShaders("res/shaders/planet_pbr.vert", "res/shaders/planet_pbr.frag", "",
+		ShaderFeature::PBR | ShaderFeature::NORMAL_MAP | ShaderFeature::POINT_LIGHT | ShaderFeature::DIR_LIGHT);
+	// nanosuit shader, enable explosion by pressing B
+	ShaderVariants nanosuitShaders("res/shaders/nanosuit.vert", "res/shaders/nanosuit.frag", "",
+		ShaderFeature::POINT_LIGHT | ShaderFeature::DIR_LIGHT | ShaderFeature::SPECULAR_MAP);
+	planetPBRShaders.Get(SceneShaderFeatures()); // the permutations drawn first; others build when a light is switched
+	nanosuitShaders.Get(SceneShaderFeatures());
+	Shader geometryPBRShader("res/shaders/geometry_planet_pbr.vert", "res/shaders/geometry_planet_pbr.frag", "res/shaders/geometry_planet_pbr.geom", ShaderCompile::Async);
+	Shader nanosuitExplosionShader("res/shaders/geometry_nanosuit.vert", "res/shaders/geometry_nanosuit.frag", "res/shaders/geometry_nanosuit.geom", ShaderCompile::Async);
+
+	Shader bloomShader("res/shaders/bloom_light.vert", "res/shaders/bloom_light.frag", "", ShaderCompile::Async); // light source shader, but this one will render into two channels
 	//Shader bloomBlur("res/shaders/bloom_blur.vert", "res/shaders/bloom_blur.frag"); // apply 2-pass Gaussian blur to bright areas
 	//Shader bloomFinal("res/shaders/bloom_final.vert", "res/shaders/bloom_final.frag"); // Combines HDR scene and blurred bloom for final output.
 
 	// Initialize matrices and speeds
 	InitModelMatricesAndRotationSpeeds(modelMatrices, rotationAxis, rotationSpeeds);
 
-	// set up instancing buffer
-	SetupInstancingBuffer(instancingBuffer, modelMatrices, rock);
-
 	// load textures for pbr rendering
-	LoadPBRMaterials(albedo, normal, metallic, roughness, ao);
+	LoadPBRMaterials(albedo, normal, orm);
 
 	// Set up sky box vao, vbo. load cube map textures
 	SetupSkybox(skyboxVAO, skyboxVBO);
@@ -92,11 +125,15 @@ int main()
 	nanosuitModel = glm::translate(nanosuitModel, glm::vec3(0.0f, 0.0f, 12.0f));
 	nanosuitModel = glm::scale(nanosuitModel, glm::vec3(0.25f));
 
-	SetupStaticUniforms(skyboxShader, planetPBRShader, geometryPBRShader, rockShader, nanosuitShader, nanosuitExplosionShader, bloomShader);
+	SetupStaticUniforms(skyboxShader, planetPBRShaders, geometryPBRShader, rockShader, nanosuitShaders, nanosuitExplosionShader, bloomShader);
+	FrameUniformBuffer frameUniforms;
 
 #ifdef _DEBUG
 	timer.stop();
+	float lastLodReport = 0.0f;
 #endif // _DEBUG
+	UniformStats uniformStats; // of the previous frame
+	size_t pendingShaders = Shader::PollPending();
 
 	// Main render loop
 	while (!glfwWindowShouldClose(scene_manager.GetWindow())) {
@@ -104,6 +141,24 @@ int main()
 		scene_manager.ProcessInput();
 		float time = (float)glfwGetTime(); // current time
 
+		// Upload models that finished loading, capped per frame
+		modelLoader.ProcessUploads(modelUploadBudgetMicroseconds);
+		TextureStreamer::Instance().Update(textureStreamBudgetBytes);
+		TextureCache::Instance().Update(); // evicts mips of long unused textures, restores those bound again
+
+		// Finish the shaders the driver has linked, running their static uniform setup
+		if (pendingShaders > 0) {
+			pendingShaders = Shader::PollPending();
+#ifdef _DEBUG
+			if (pendingShaders == 0)
+				ProgramCache::Instance().PrintStats(); // startup cost of the programs, with or without the cache
+#endif // _DEBUG
+		}
+
+		// set up instancing buffer once the rock is uploaded
+		if (rock.IsReady() && instancingBuffer == 0)
+			SetupInstancingBuffer(instancingBuffer, modelMatrices, rock.Get());
+
 		// Render
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -117,36 +172,43 @@ int main()
 		glm::mat4 view = camera->GetViewMatrix();
 		glm::mat4 model = glm::mat4(1.0f);
 
+		// Shared by every shader through the FrameData block
+		FrameData frame;
+		frame.projection = projection;
+		frame.view = view;
+		frame.viewPos = camera->position;
+		frame.time = time;
+		frame.lightPosition = lightPosition;
+		frame.deltaTime = scene_manager.GetDeltaTime();
+		frame.directionalLightDirection = directionalLightDirection;
+		frameUniforms.Update(frame);
+		uint32_t sceneFeatures = SceneShaderFeatures();
+
 		// 1. Render sky box
 		model = glm::mat4(1.0f); // reset model matrix
-		glm::mat4 skyview = glm::mat4(glm::mat3(camera->GetViewMatrix())); // Important: remove translation from the view matrix
 
-		skyboxShader.Bind();
-		skyboxShader.SetMat4("view", skyview);
-		skyboxShader.SetMat4("projection", projection);
-		skyboxShader.SetMat4("model", model);
-		RenderSkybox(skyboxShader);
+		if (skyboxShader.IsReady()) {
+			skyboxShader.Bind(); // the shader removes the translation from the view matrix
+			skyboxShader.SetMat4("model", model);
+			RenderSkybox(skyboxShader);
+		}
 
 		// 2. Draw planet(mars) with PBR
 		// -----------------------------
 		glm::mat4 pbrModel = glm::mat4(1.0f);
 		pbrModel = glm::scale(model, glm::vec3(10.0f)); // radius 10.0f
 
-		planetPBRShader.Bind();
-		planetPBRShader.SetMat4("projection", projection);
-		planetPBRShader.SetMat4("view", view);
-		planetPBRShader.SetMat4("model", pbrModel);
-		planetPBRShader.SetVec3("viewPos", camera->position); // view(eye) position
-		planetPBRShader.SetMat3("normalMatrix", glm::transpose(glm::inverse(glm::mat3(pbrModel))));
-		planetPBRShader.SetVec3("lightPosition", lightPosition);
-		planetPBRShader.SetVec3("directionalLightDirection", directionalLightDirection);
-		RenderPBRMars(planetPBRShader, pbrSphere);
-
-		if (togglePBRNormal) {
+		// after a light switch the previous permutation is drawn until the new one is linked
+		if (Shader* planetPBRShader = planetPBRShaders.Select(sceneFeatures)) {
+			planetPBRShader->Bind();
+			planetPBRShader->SetMat4("model", pbrModel);
+			planetPBRShader->SetMat3("normalMatrix", glm::transpose(glm::inverse(glm::mat3(pbrModel))));
+			RenderPBRMars(*planetPBRShader, pbrSphere);
+		}
+
+		if (togglePBRNormal && geometryPBRShader.IsReady()) {
 			// enable planet normal appearance
 			geometryPBRShader.Bind();
-			geometryPBRShader.SetMat4("projection", projection);
-			geometryPBRShader.SetMat4("view", view);
 			geometryPBRShader.SetMat4("model", pbrModel);
 			RenderPBRMars(geometryPBRShader, pbrSphere);
 		}
@@ -159,15 +221,28 @@ int main()
 		// Using deltaTime to ensure frame-rate independent rotation
 		UpdateModelMatrices(scene_manager.GetDeltaTime());
 
-		rockShader.Bind();
-		rockShader.SetMat4("projection", projection);
-		rockShader.SetMat4("view", view);
-		RenderInstancingRocks(rockShader, rock);
+		if (instancingBuffer != 0 && rockShader.IsReady()) {
+			rockShader.Bind();
+			RenderInstancingRocks(rockShader, rock.Get(), projection, camera->position);
+		}
+
+#ifdef _DEBUG
+		// per-LOD instance counts, once a second, to tune rockLodScreenRadius against frame time
+		if (time - lastLodReport >= 1.0f) {
+			lastLodReport = time;
+			std::cout << "rock LOD instances:";
+			for (unsigned int l = 0; l < rockLodLevels; l++)
+				std::cout << " " << rockLodStats.instances[l];
+			std::cout << " (" << rockLodStats.triangles << " triangles, " << scene_manager.GetDeltaTime() * 1000.0f << " ms frame)\n";
+			TextureCache::Instance().PrintStats();
+			std::cout << "uniforms: " << uniformStats.lookups << " sets per frame, " << uniformStats.SavedCalls()
+				<< " driver calls saved (" << uniformStats.skipped << " inactive uniforms skipped)\n";
+		}
+#endif // _DEBUG
 
 		// 4. Render nanosuit.obj
 		// ----------------------
 		if (!enableNanosuitExplosion) {
-			nanosuitShader.Bind();
 			if (toggleNanosuitMovement) {
 				if (moveForward) nanosuitModel = glm::translate(nanosuitModel, glm::vec3(0.0f, 0.0f, +0.1f));
 				if (moveBackward) nanosuitModel = glm::translate(nanosuitModel, glm::vec3(0.0f, 0.0f, -0.1f));
@@ -177,28 +252,25 @@ int main()
 				if (moveDown) nanosuitModel = glm::translate(nanosuitModel, glm::vec3(0.0f, -0.1f, 0.0f));
 				nanosuitModel = glm::rotate(nanosuitModel, glm::radians(rotationAngle), glm::vec3(0.0f, 1.0f, 0.0f));
 			}
-			nanosuitShader.SetMat4("projection", projection);
-			nanosuitShader.SetMat4("view", view);
-			nanosuitShader.SetMat4("model", nanosuitModel);
-
-			nanosuitShader.SetVec3("viewPos", camera->position);
-			nanosuitShader.SetVec3("lightPosition", lightPosition);
-			nanosuitShader.SetVec3("directionalLightDirection", directionalLightDirection);
-			nanosuit.Render(nanosuitShader, { "texture_diffuse", "texture_specular" });
+			Shader* nanosuitShader = nanosuitShaders.Select(sceneFeatures);
+			if (nanosuit.IsReady() && nanosuitShader) {
+				nanosuitShader->Bind();
+				nanosuitShader->SetMat4("model", nanosuitModel);
+				nanosuit.Get().RenderBatched(*nanosuitShader, { "texture_diffuse", "texture_specular" });
+			}
 		}
 		else {
-			if (time - startNanosuitExplosionTime <= maxNanosuitExplosionDuration) {
+			// the geometry shader variant may still be building in the background, nothing is drawn until it is linked
+			if (time - startNanosuitExplosionTime <= maxNanosuitExplosionDuration && nanosuitExplosionShader.IsReady()) {
 				// enable nanosuit explosion
 				nanosuitExplosionShader.Bind();
-				nanosuitExplosionShader.SetMat4("projection", projection);
-				nanosuitExplosionShader.SetMat4("view", view);
 				nanosuitExplosionShader.SetMat4("model", nanosuitModel);
 
-				nanosuitExplosionShader.SetFloat("time", time);
 				nanosuitExplosionShader.SetFloat("startTime", startNanosuitExplosionTime);
 				nanosuitExplosionShader.SetFloat("duration", maxNanosuitExplosionDuration);
 
-				nanosuit.Render(nanosuitExplosionShader, { "texture_diffuse" });
+				if (nanosuit.IsReady())
+					nanosuit.Get().Render(nanosuitExplosionShader, { "texture_diffuse" });
 			}
 		}
 
@@ -207,67 +279,107 @@ int main()
 		model = glm::mat4(1.0f); // reset model matrix
 		model = glm::translate(model, lightPosition);
 		model = glm::scale(model, glm::vec3(0.5f));
-		bloomShader.Bind();
-		bloomShader.SetMat4("projection", projection);
-		bloomShader.SetMat4("view", view);
-		bloomShader.SetMat4("model", model);
-		RenderBloomLightSource(bloomShader, sphere);
+		if (bloomShader.IsReady()) {
+			bloomShader.Bind();
+			bloomShader.SetMat4("model", model);
+			RenderBloomLightSource(bloomShader, sphere);
+		}
 
 		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
 		glfwSwapBuffers(scene_manager.GetWindow());
 		glfwPollEvents();
+		uniformStats = Shader::EndFrame();
 	}
 
 	delete[] modelMatrices;
 	delete[] rotationAxis;
 	delete[] rotationSpeeds;
+	delete[] rockLods;
+	delete[] rockLodMatrices;
 	glfwTerminate();
 }
 
 void SetupStaticUniforms(Shader& skyboxShader, 
-	Shader& planetPBRShader, 
+	ShaderVariants& planetPBRShaders, 
 	Shader& geometryPBRShader, 
 	Shader& rockShader, 
-	Shader& nanosuitShader, 
+	ShaderVariants& nanosuitShaders, 
 	Shader& nanosuitExplosionShader, 
 	Shader& bloomShader)
 {
-	skyboxShader.Bind();
-	skyboxShader.SetInt("skybox", 0);
-
-	planetPBRShader.Bind();
-	planetPBRShader.SetInt("albedoMap", 0);
-	planetPBRShader.SetInt("normalMap", 1);
-	planetPBRShader.SetInt("metallicMap", 2);
-	planetPBRShader.SetInt("roughnessMap", 3);
-	planetPBRShader.SetInt("aoMap", 4);
-	planetPBRShader.SetFloat("roughnessScale", roughnessScale);
-	planetPBRShader.SetFloat("metallicScale", metallicScale);
-	planetPBRShader.SetVec3("albedoScale", albedoScale);
-	planetPBRShader.SetFloat("ka", Ka);
-	planetPBRShader.SetVec3("lightColor", lightColor);
-	planetPBRShader.SetVec3("directionalLightColor", directionalLightColor);
-	planetPBRShader.SetFloat("directionalLightScale", directionalLightScale);
-
-	geometryPBRShader.Bind();
-	geometryPBRShader.SetFloat("normal_magnitude", normal_magnitude);
-	geometryPBRShader.SetVec3("normal_color", normal_color);
-
-	rockShader.Bind();
-	rockShader.SetFloat("ka", Ka);
-
-	nanosuitShader.Bind();
-	nanosuitShader.SetVec3("lightColor", lightColor);
-	nanosuitShader.SetVec3("directionalLightColor", directionalLightColor);
-    nanosuitShader.SetFloat("directionalLightScale", directionalLightScale);
-	nanosuitShader.SetFloat("ka", Ka);
-	nanosuitShader.SetFloat("ks", Ks);
-	nanosuitShader.SetFloat("shininess", Ns);
-	nanosuitShader.SetFloat("kd", Kd);
-
-	nanosuitExplosionShader.Bind();
-	nanosuitExplosionShader.SetFloat("duration", maxNanosuitExplosionDuration);
-
-	bloomShader.Bind();
-	bloomShader.SetVec3("lightColor", lightColor);
-}
\ No newline at end of file
+	for (Shader* shader : { &skyboxShader, &geometryPBRShader, &rockShader, &nanosuitExplosionShader, &bloomShader })
+		shader->OnReady([](Shader& shader) { shader.SetUniformBlock("FrameData", kFrameDataBinding); });
+	for (ShaderVariants* variants : { &planetPBRShaders, &nanosuitShaders })
+		variants->OnReady([](Shader& shader, uint32_t) { shader.SetUniformBlock("FrameData", kFrameDataBinding); });
+
+	// each runs once its shader is linked, shaders are compiled with ShaderCompile::Async
+	skyboxShader.OnReady([](Shader& skyboxShader) {
+		skyboxShader.Bind();
+		skyboxShader.SetInt("skybox", 0);
+	});
+
+	// uniforms of features a permutation was built without are not set, they are compiled out
+	planetPBRShaders.OnReady([](Shader& planetPBRShader, uint32_t features) {
+		planetPBRShader.Bind();
+		planetPBRShader.SetInt("albedoMap", 0);
+		if (features & ShaderFeature::NORMAL_MAP)
+			planetPBRShader.SetInt("normalMap", 1);
+		planetPBRShader.SetInt("ormMap", 2);
+		if (features & ShaderFeature::PBR) {
+			planetPBRShader.SetFloat("roughnessScale", roughnessScale);
+			planetPBRShader.SetFloat("metallicScale", metallicScale);
+		}
+		planetPBRShader.SetVec3("albedoScale", albedoScale);
+		planetPBRShader.SetFloat("ka", Ka);
+		if (features & ShaderFeature::POINT_LIGHT)
+			planetPBRShader.SetVec3("lightColor", lightColor);
+		if (features & ShaderFeature::DIR_LIGHT) {
+			planetPBRShader.SetVec3("directionalLightColor", directionalLightColor);
+			planetPBRShader.SetFloat("directionalLightScale", directionalLightScale);
+		}
+	});
+
+	geometryPBRShader.OnReady([](Shader& geometryPBRShader) {
+		geometryPBRShader.Bind();
+		geometryPBRShader.SetFloat("normal_magnitude", normal_magnitude);
+		geometryPBRShader.SetVec3("normal_color", normal_color);
+	});
+
+	rockShader.OnReady([](Shader& rockShader) {
+		rockShader.Bind();
+		rockShader.SetFloat("ka", Ka);
+	});
+
+	nanosuitShaders.OnReady([](Shader& nanosuitShader, uint32_t features) {
+		nanosuitShader.Bind();
+		if (features & ShaderFeature::POINT_LIGHT)
+			nanosuitShader.SetVec3("lightColor", lightColor);
+		if (features & ShaderFeature::DIR_LIGHT) {
+			nanosuitShader.SetVec3("directionalLightColor", directionalLightColor);
+			nanosuitShader.SetFloat("directionalLightScale", directionalLightScale);
+		}
+		nanosuitShader.SetFloat("ka", Ka);
+		if ((features & ShaderFeature::SPECULAR_MAP) && (features & (ShaderFeature::POINT_LIGHT | ShaderFeature::DIR_LIGHT))) {
+			nanosuitShader.SetFloat("ks", Ks);
+			nanosuitShader.SetFloat("shininess", Ns);
+		}
+		if (features & (ShaderFeature::POINT_LIGHT | ShaderFeature::DIR_LIGHT))
+			nanosuitShader.SetFloat("kd", Kd);
+	});
+
+	nanosuitExplosionShader.OnReady([](Shader& nanosuitExplosionShader) {
+		nanosuitExplosionShader.Bind();
+		nanosuitExplosionShader.SetFloat("duration", maxNanosuitExplosionDuration);
+	});
+
+	bloomShader.OnReady([](Shader& bloomShader) {
+		bloomShader.Bind();
+		bloomShader.SetVec3("lightColor", lightColor);
+	});
+}
+
+uint32_t SceneShaderFeatures()
+{
+	return ShaderFeature::PBR | ShaderFeature::NORMAL_MAP | ShaderFeature::SPECULAR_MAP |
+		(enablePositionalLight ? ShaderFeature::POINT_LIGHT : 0u) | (enableDirectionalLight ? ShaderFeature::DIR_LIGHT : 0u);
+}
@@ -0,0 +1,158 @@
+// Read-only memory mapping of a whole file.
+// Loaders walk the mapped bytes in place instead of copying them through
+// std::ifstream / std::stringstream, so the OS pages the file in on demand.
+//
+// Usage Example:
+// MappedFile file("res/models/rock/rock.obj");
+// if (file.IsOpen())
+//     Parse(file.Data(), file.Data() + file.Size());
+
+#pragma once
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& path) { Open(path); }
+	~MappedFile() { Close(); }
+
+	// Move Semantics
+	MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other) {
+			Close();
+			std::swap(data, other.data);
+			std::swap(size, other.size);
+			std::swap(opened, other.opened);
+		}
+		return *this;
+	}
+
+	// Deleted Copy Semantics, the mapping is owned by exactly one object
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Maps the whole file read-only. Returns false if the file can not be opened or mapped.
+	// An empty file is reported as open with Size() == 0 and Data() == nullptr.
+	bool Open(const std::string& path);
+	void Close();
+
+	bool IsOpen() const { return opened; }
+	const char* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+	bool opened = false;
+};
+
+inline bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	if (fileSize.QuadPart > 0) {
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr) {
+			CloseHandle(file);
+			return false;
+		}
+		// The view keeps the mapping alive, both handles can be closed right away
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		CloseHandle(mapping);
+		if (data == nullptr) {
+			CloseHandle(file);
+			return false;
+		}
+	}
+	CloseHandle(file);
+	size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+
+	if (st.st_size > 0) {
+		void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+		data = static_cast<const char*>(view);
+	}
+	close(fd);
+	size = static_cast<size_t>(st.st_size);
+#endif
+
+	opened = true;
+	return true;
+}
+
+inline void MappedFile::Close()
+{
+	if (data) {
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap(const_cast<char*>(data), size);
+#endif
+	}
+	data = nullptr;
+	size = 0;
+	opened = false;
+}
+
+// FNV-1a, 64 bit, used to tell whether mapped files changed (mesh cache) or are duplicates (texture cache)
+inline uint64_t HashBytes(const char* data, size_t size)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+#endif // !MAPPED_FILE_H
@@ -1,4 +1,5 @@
-// Vertex has vec3 pos, vec3 normal, vec3 texCoords, no need for tangent & bitangent in this case.
+// Vertex has vec3 pos, vec3 normal, vec2 texCoords. Normal mapped meshes add a tangent per vertex (w = handedness,
+// the shader rebuilds the bitangent) as a separate stream at attribute location 7.
 // Texture will specify type, holding id
 // Optimize initialization by RVO with move semantics
 // Please do care the texture name in glsl code!
@@ -9,12 +10,18 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <algorithm>
+#include <cstdio>
 #include <vector>
 #include <string>
+#include <string_view>
 
 #include <GL/gl3w.h>
+#include <glm/gtc/packing.hpp>
 
 #include "shader.h"
+#include "texture_cache.h"
+#include "vertex_quantization.h"
 
 struct Vertex
 {
@@ -28,15 +35,50 @@ struct Texture
 	std::string type; // e.g., texture_diffuse, texture_specular
 	unsigned int id = 0;  // the texture id holding by opengl
 	std::string filepath; 
+	TextureHandle handle; // keeps id resident in TextureCache, empty until uploaded
+
+	// The id to bind for a draw. A cached texture's id changes when the residency budget evicts or restores its mips.
+	unsigned int Use() const { return handle ? handle.Use() : id; }
 };
 
+// One level of detail: a range of the mesh's index buffer, all levels share its vertex buffer
+struct MeshLod
+{
+	unsigned int indexOffset = 0; // in indices, not bytes
+	unsigned int indexCount = 0;
+	float error = 0.0f;           // simplification error relative to the mesh extent, 0 for LOD0
+};
+
+// Sampler uniform name type + suffix + number in buffer, without allocating; number 0 is left out
+inline std::string_view NumberedUniformName(char* buffer, size_t size, const std::string& type, const char* suffix, size_t number)
+{
+	int length = number != 0 ? std::snprintf(buffer, size, "%s%s%zu", type.c_str(), suffix, number) :
+		std::snprintf(buffer, size, "%s%s", type.c_str(), suffix);
+	return std::string_view(buffer, std::min(static_cast<size_t>(std::max(length, 0)), size - 1));
+}
+
 class Mesh
 {
 public:
 	Mesh() = delete;  // Deleted default constructor
+	// quantize uploads the compact 16-byte QuantizedVertex layout instead of Vertex,
+	// the float vertices stay available on the CPU side either way.
+	// tangents (one per vertex, w = handedness, see tangent_space.h) are optional and bound to
+	// attribute location 7, locations 3-6 are left for the instance matrix.
+	// layers (one per vertex) are optional texture array layers, bound to attribute location 8 as a uint,
+	// see Model::RenderBatched.
 	Mesh(const std::vector<Vertex>& vertices,
 		const std::vector<unsigned int>& indices,
-		const std::vector<Texture>& textures);  // Parameterized constructor
+		const std::vector<Texture>& textures,
+		bool quantize = false,
+		const std::vector<glm::vec4>& tangents = {},
+		const std::vector<uint16_t>& layers = {});  // Parameterized constructor
+	Mesh(std::vector<Vertex>&& vertices,
+		std::vector<unsigned int>&& indices,
+		const std::vector<Texture>& textures,
+		bool quantize = false,
+		std::vector<glm::vec4>&& tangents = {},
+		std::vector<uint16_t>&& layers = {});  // Takes over the vertex/index arrays without copying
 	~Mesh();  // Destructor
 
 	// Move Semantics
@@ -63,45 +105,100 @@ public:
 	//
 	void Render(Shader& shader, const std::vector<std::string>& textureTypesToUse = {}) const;
 
+	// Sets "positionScale" (xyz: dequantization scale, w: 1 if normals are octahedral encoded)
+	// and "positionOffset" for the vertex shader; identity for float meshes.
+	// Render calls it, call it yourself when drawing the VAO directly (e.g. instancing).
+	void SetVertexFormatUniforms(Shader& shader) const;
+
+	// Deletes the mesh's own buffers and draws from source's instead: LOD0 is the index range of source starting at
+	// indexOffset, already offset to where the vertices are in source's vertex buffer. Only LOD0 is drawable afterwards,
+	// GetLod still describes this mesh's own index array. See Model::BuildBatchedMesh.
+	void ShareBuffers(const Mesh& source, unsigned int indexOffset);
+
 	// Accessors
 	const unsigned int GetVAO() const { return VAO; }
+	bool HasTangents() const { return !tangents.empty(); }
+	// Level i of the LOD chain, clamped to the coarsest one. Without a chain LOD0 is the whole index buffer.
+	MeshLod GetLod(size_t i) const;
+	size_t GetLodCount() const { return lods.empty() ? 1 : lods.size(); }
+	bool IsQuantized() const { return quantized; }
+	const QuantizationError& GetQuantizationError() const { return quantizationError; }
 
 public:
 	// Public Members
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
 	std::vector<Texture> textures;
+	std::vector<glm::vec4> tangents; // per vertex, empty if the mesh was built without tangents
+	std::vector<uint16_t> layers; // per vertex texture array layer, empty unless the mesh draws from texture arrays
+	std::vector<MeshLod> lods; // back to back in indices, LOD0 first; empty if the mesh has a single level
 
 private:
 	void SetupMesh();  // Initialize OpenGL objects
 
 private:
 	unsigned int VAO = 0, VBO = 0, IBO = 0;
+	bool sharedVAO = false;           // VAO belongs to the mesh passed to ShareBuffers
+	unsigned int sharedIndexOffset = 0;
+
+	bool quantized = false;
+	glm::vec3 positionScale = glm::vec3(1.0f);
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	QuantizationError quantizationError;
 };
 
 Mesh::Mesh(const std::vector<Vertex>& _vertices,
 	const std::vector<unsigned int>& _indices,
-	const std::vector<Texture>& _textures)
+	const std::vector<Texture>& _textures,
+	bool quantize,
+	const std::vector<glm::vec4>& _tangents,
+	const std::vector<uint16_t>& _layers)
+	: quantized(quantize)
 {
 	this->vertices = _vertices;
 	this->indices = _indices;
 	this->textures = _textures;
+	this->tangents = _tangents;
+	this->layers = _layers;
+
+	SetupMesh();
+}
+
+Mesh::Mesh(std::vector<Vertex>&& _vertices,
+	std::vector<unsigned int>&& _indices,
+	const std::vector<Texture>& _textures,
+	bool quantize,
+	std::vector<glm::vec4>&& _tangents,
+	std::vector<uint16_t>&& _layers)
+	: quantized(quantize)
+{
+	this->vertices = std::move(_vertices);
+	this->indices = std::move(_indices);
+	this->textures = _textures;
+	this->tangents = std::move(_tangents);
+	this->layers = std::move(_layers);
 
 	SetupMesh();
 }
 
 Mesh::~Mesh()
 {
-	glDeleteVertexArrays(1, &VAO);
+	if (!sharedVAO)
+		glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &IBO);
 }
 
 Mesh::Mesh(Mesh&& other) noexcept
-	: VAO(other.VAO), VBO(other.VBO), IBO(other.IBO),
+	: VAO(other.VAO), VBO(other.VBO), IBO(other.IBO), sharedVAO(other.sharedVAO), sharedIndexOffset(other.sharedIndexOffset),
 	vertices(std::move(other.vertices)), 
 	indices(std::move(other.indices)),
-	textures(std::move(other.textures))
+	textures(std::move(other.textures)),
+	tangents(std::move(other.tangents)),
+	layers(std::move(other.layers)),
+	lods(std::move(other.lods)),
+	quantized(other.quantized), positionScale(other.positionScale), positionOffset(other.positionOffset),
+	quantizationError(other.quantizationError)
 {
 	// Invalidate the moved-from object's OpenGL handles
 	other.VAO = 0;
@@ -114,7 +211,8 @@ Mesh& Mesh::operator=(Mesh&& other) noexcept
 	// prevent duplication
 	if (this != &other) {
 		// Release any resources held by *this, otherwise memory leak possible
-		glDeleteVertexArrays(1, &VAO);
+		if (!sharedVAO)
+			glDeleteVertexArrays(1, &VAO);
 		glDeleteBuffers(1, &VBO);
 		glDeleteBuffers(1, &IBO);
 
@@ -122,9 +220,18 @@ Mesh& Mesh::operator=(Mesh&& other) noexcept
 		VAO = other.VAO;
 		VBO = other.VBO;
 		IBO = other.IBO;
+		sharedVAO = other.sharedVAO;
+		sharedIndexOffset = other.sharedIndexOffset;
 		vertices = std::move(other.vertices);
 		indices = std::move(other.indices);
 		textures = std::move(other.textures);
+		tangents = std::move(other.tangents);
+		layers = std::move(other.layers);
+		lods = std::move(other.lods);
+		quantized = other.quantized;
+		positionScale = other.positionScale;
+		positionOffset = other.positionOffset;
+		quantizationError = other.quantizationError;
 
 		// Invalidate the moved-from object's OpenGL handles
 		other.VAO = 0;
@@ -143,21 +250,71 @@ void Mesh::SetupMesh()
 
 		glBindVertexArray(VAO);
 
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+		// Tangents and layers, if any, follow the vertices in the same buffer
+		const bool hasTangents = tangents.size() == vertices.size() && !tangents.empty();
+		const bool hasLayers = layers.size() == vertices.size() && !layers.empty();
+		const size_t vertexBytes = vertices.size() * (quantized ? sizeof(QuantizedVertex) : sizeof(Vertex));
+		const size_t tangentBytes = hasTangents ? tangents.size() * (quantized ? sizeof(uint32_t) : sizeof(glm::vec4)) : 0;
+		const size_t layerBytes = hasLayers ? layers.size() * sizeof(uint16_t) : 0;
+
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes + tangentBytes + layerBytes, nullptr, GL_STATIC_DRAW);
+		if (!quantized) {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, vertices.data());
+
+			// vertex positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+			// vertex normals
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+			// vertex texture coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+
+			if (hasTangents) {
+				glBufferSubData(GL_ARRAY_BUFFER, vertexBytes, tangentBytes, tangents.data());
+				// vertex tangents, w = handedness
+				glEnableVertexAttribArray(7);
+				glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)vertexBytes);
+			}
+		}
+		else {
+			std::vector<QuantizedVertex> packed;
+			QuantizeVertices(vertices, packed, positionScale, positionOffset);
+			quantizationError = MeasureQuantizationError(vertices, packed, positionScale, positionOffset);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, packed.data());
+
+			// vertex positions, unorm16 inside the mesh bounds
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, position));
+			// vertex normals, octahedral snorm16
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, normal));
+			// vertex texture coords, half float
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, texCoords));
+
+			if (hasTangents) {
+				std::vector<uint32_t> packedTangents(tangents.size());
+				for (size_t i = 0; i < tangents.size(); i++)
+					packedTangents[i] = glm::packSnorm3x10_1x2(tangents[i]);
+				glBufferSubData(GL_ARRAY_BUFFER, vertexBytes, tangentBytes, packedTangents.data());
+				// vertex tangents, snorm 10:10:10 with a 2 bit handedness
+				glEnableVertexAttribArray(7);
+				glVertexAttribPointer(7, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(uint32_t), (void*)vertexBytes);
+			}
+		}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-		// vertex positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-		// vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-		// vertex texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+		if (hasLayers) {
+			glBufferSubData(GL_ARRAY_BUFFER, vertexBytes + tangentBytes, layerBytes, layers.data());
+			// texture array layer, an integer attribute
+			glEnableVertexAttribArray(8);
+			glVertexAttribIPointer(8, 1, GL_UNSIGNED_SHORT, sizeof(uint16_t), (void*)(vertexBytes + tangentBytes));
+		}
 
 		glBindVertexArray(0);
 	}
@@ -176,7 +333,7 @@ void Mesh::Render(Shader& shader, const std::vector<std::string>& textureTypesTo
 	for (int i = 0; i < textures.size(); i++) {
 		glActiveTexture(GL_TEXTURE0 + i);
 		// Get texture numberN in diffuse_textureN 
-		std::string name = textures[i].type;
+		const std::string& name = textures[i].type;
 
 		// Skip this texture if it's not in the list of types to use
 		if (!textureTypesToUse.empty() &&
@@ -184,27 +341,64 @@ void Mesh::Render(Shader& shader, const std::vector<std::string>& textureTypesTo
 			continue;
 		}
 
-		std::string number;
+		size_t number = 0;
 		if (name == "texture_diffuse")
-			number = std::to_string(diffuseNr++);
+			number = diffuseNr++;
 		else if (name == "texture_specular")
-			number = std::to_string(specularNr++);
+			number = specularNr++;
 		else if (name == "texture_normal")
-			number = std::to_string(normalNr++);
+			number = normalNr++;
 		else if (name == "texture_height")
-			number = std::to_string(heightNr++);
+			number = heightNr++;
 		else if (name == "texture_ambient")
-			number = std::to_string(ambientNr++);
+			number = ambientNr++;
 
 		// can change this line based on the specific shader code
-		shader.SetInt((name + number).c_str(), i);
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+		char uniformName[64];
+		shader.SetInt(NumberedUniformName(uniformName, sizeof(uniformName), name, "", number), i);
+		glBindTexture(GL_TEXTURE_2D, textures[i].Use());
 	}
 
-	// Draw mesh
+	SetVertexFormatUniforms(shader);
+
+	// Draw mesh, full detail
+	MeshLod lod = GetLod(0);
 	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+	glDrawElements(GL_TRIANGLES, (GLsizei)lod.indexCount, GL_UNSIGNED_INT,
+		(void*)((sharedIndexOffset + lod.indexOffset) * sizeof(unsigned int)));
 	glBindVertexArray(0);
 }
 
+void Mesh::ShareBuffers(const Mesh& source, unsigned int indexOffset)
+{
+	if (!sharedVAO)
+		glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &IBO);
+	VAO = source.VAO;
+	VBO = 0;
+	IBO = 0;
+	sharedVAO = true;
+	sharedIndexOffset = indexOffset;
+
+	// source quantizes all its vertices inside its own bounds
+	quantized = source.quantized;
+	positionScale = source.positionScale;
+	positionOffset = source.positionOffset;
+	quantizationError = source.quantizationError;
+}
+
+MeshLod Mesh::GetLod(size_t i) const
+{
+	if (lods.empty())
+		return MeshLod{ 0u, (unsigned int)indices.size(), 0.0f };
+	return lods[std::min(i, lods.size() - 1)];
+}
+
+void Mesh::SetVertexFormatUniforms(Shader& shader) const
+{
+	shader.SetVec4("positionScale", glm::vec4(positionScale, quantized ? 1.0f : 0.0f));
+	shader.SetVec3("positionOffset", positionOffset);
+}
+
 #endif // !MESH_H
\ No newline at end of file
@@ -0,0 +1,236 @@
+// Binary mesh cache (.ymesh) written beside an .obj file after it was parsed once.
+// Later loads map the cache and hand the vertex/index blobs to the GPU without touching the OBJ text.
+//
+// Layout (native endianness, every blob 4-byte aligned):
+//   YMeshHeader
+//   meshCount x { YMeshEntry, material name (padded to 4 bytes), Vertex[vertexCount], uint32[indexCount],
+//                 MeshLod[lodCount], vec4[tangentCount] }
+//
+// A cache is used only if its version, vertex size and build flags match, and the source .obj
+// has the recorded size and either the recorded mtime or (when only the mtime changed) the recorded hash.
+
+#pragma once
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh.h"
+
+constexpr uint32_t kYMeshMagic = 0x48534D59; // "YMSH"
+constexpr uint32_t kYMeshVersion = 3;
+
+// YMeshHeader::buildFlags bits, one per load option that changes the cached vertex/index data
+enum YMeshBuildFlags : uint32_t
+{
+	kYMeshOptimized = 1u << 0, // vertex cache / overdraw / fetch optimized (ModelLoadOptions::optimizeMeshes)
+	kYMeshTangents = 1u << 1,  // per-vertex tangents stored (ModelLoadOptions::generateTangents)
+	kYMeshLodLevelsShift = 8,  // bits 8..15: requested LOD levels (ModelLoadOptions::lodLevels), 0 if none
+};
+
+struct YMeshHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexSize;  // sizeof(Vertex) when written
+	uint32_t meshCount;
+	uint32_t buildFlags;  // load options that change the cached data
+	uint32_t reserved;
+	uint64_t sourceSize;
+	int64_t sourceMTime;
+	uint64_t sourceHash;
+};
+
+struct YMeshEntry
+{
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t materialLength;
+	uint32_t lodCount;     // 0 if the mesh has no LOD chain
+	uint32_t tangentCount; // 0 or vertexCount
+	uint32_t reserved;
+};
+
+// Identity of the .obj a cache was built from
+struct YMeshSourceInfo
+{
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	uint64_t hash = 0;
+};
+
+// One mesh in a cache. When read from a mapped cache the pointers point into the mapping.
+struct YMeshView
+{
+	const Vertex* vertices = nullptr;
+	uint32_t vertexCount = 0;
+	const unsigned int* indices = nullptr;
+	uint32_t indexCount = 0;
+	const MeshLod* lods = nullptr;
+	uint32_t lodCount = 0;
+	const glm::vec4* tangents = nullptr;
+	uint32_t tangentCount = 0;
+	std::string material; // 'usemtl' name bound to the mesh, empty if none
+};
+
+// Fills size and mtime of path, the hash is left untouched
+inline bool StatMeshSource(const std::string& path, YMeshSourceInfo& info)
+{
+	std::error_code ec;
+	auto size = std::filesystem::file_size(path, ec);
+	if (ec)
+		return false;
+	auto mtime = std::filesystem::last_write_time(path, ec);
+	if (ec)
+		return false;
+
+	info.size = static_cast<uint64_t>(size);
+	info.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+	return true;
+}
+
+/**
+ * Maps cachePath and checks it against sourcePath.
+ *
+ * @param cache Receives the mapping, it must outlive the returned views.
+ * @param meshes Receives one view per cached mesh.
+ * @return false if the cache is missing, corrupt or stale.
+ */
+inline bool OpenMeshCache(const std::string& cachePath, const std::string& sourcePath, uint32_t buildFlags,
+	MappedFile& cache, std::vector<YMeshView>& meshes)
+{
+	meshes.clear();
+
+	YMeshSourceInfo source;
+	if (!StatMeshSource(sourcePath, source) || !cache.Open(cachePath))
+		return false;
+
+	const char* p = cache.Data();
+	const char* end = p + cache.Size();
+	if (cache.Size() < sizeof(YMeshHeader))
+		return false;
+
+	YMeshHeader header;
+	std::memcpy(&header, p, sizeof(header));
+	p += sizeof(header);
+
+	if (header.magic != kYMeshMagic || header.version != kYMeshVersion ||
+		header.vertexSize != sizeof(Vertex) || header.buildFlags != buildFlags || header.sourceSize != source.size)
+		return false;
+
+	// Same size but touched (e.g. by a checkout): compare the contents before trusting the cache
+	if (header.sourceMTime != source.mtime) {
+		MappedFile sourceFile(sourcePath);
+		if (!sourceFile.IsOpen() || HashBytes(sourceFile.Data(), sourceFile.Size()) != header.sourceHash)
+			return false;
+	}
+
+	meshes.reserve(header.meshCount);
+	for (uint32_t i = 0; i < header.meshCount; i++) {
+		YMeshEntry entry;
+		if ((size_t)(end - p) < sizeof(entry))
+			return false;
+		std::memcpy(&entry, p, sizeof(entry));
+		p += sizeof(entry);
+
+		size_t materialBytes = (entry.materialLength + 3u) & ~size_t(3);
+		size_t vertexBytes = (size_t)entry.vertexCount * sizeof(Vertex);
+		size_t indexBytes = (size_t)entry.indexCount * sizeof(unsigned int);
+		size_t lodBytes = (size_t)entry.lodCount * sizeof(MeshLod);
+		size_t tangentBytes = (size_t)entry.tangentCount * sizeof(glm::vec4);
+		if (entry.tangentCount != 0 && entry.tangentCount != entry.vertexCount)
+			return false;
+		if ((size_t)(end - p) < materialBytes + vertexBytes + indexBytes + lodBytes + tangentBytes)
+			return false;
+
+		YMeshView view;
+		view.material.assign(p, entry.materialLength);
+		p += materialBytes;
+		view.vertices = reinterpret_cast<const Vertex*>(p);
+		view.vertexCount = entry.vertexCount;
+		p += vertexBytes;
+		view.indices = reinterpret_cast<const unsigned int*>(p);
+		view.indexCount = entry.indexCount;
+		p += indexBytes;
+		// The LODs index the same array, so this covers them too; a bad index would read past the VBO
+		for (uint32_t j = 0; j < view.indexCount; j++) {
+			if (view.indices[j] >= view.vertexCount)
+				return false;
+		}
+		view.lods = reinterpret_cast<const MeshLod*>(p);
+		view.lodCount = entry.lodCount;
+		p += lodBytes;
+		view.tangents = reinterpret_cast<const glm::vec4*>(p);
+		view.tangentCount = entry.tangentCount;
+		p += tangentBytes;
+		for (uint32_t l = 0; l < view.lodCount; l++) {
+			if ((uint64_t)view.lods[l].indexOffset + view.lods[l].indexCount > view.indexCount)
+				return false;
+		}
+		meshes.push_back(std::move(view));
+	}
+	return true;
+}
+
+/**
+ * Writes meshes to cachePath (through a temporary file, so readers never see a partial cache).
+ *
+ * @return false if the cache could not be written; the caller can carry on without it.
+ */
+inline bool WriteMeshCache(const std::string& cachePath, const YMeshSourceInfo& source, uint32_t buildFlags,
+	const std::vector<YMeshView>& meshes)
+{
+	const std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		YMeshHeader header = {};
+		header.magic = kYMeshMagic;
+		header.version = kYMeshVersion;
+		header.vertexSize = sizeof(Vertex);
+		header.meshCount = static_cast<uint32_t>(meshes.size());
+		header.buildFlags = buildFlags;
+		header.sourceSize = source.size;
+		header.sourceMTime = source.mtime;
+		header.sourceHash = source.hash;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		const char padding[4] = {};
+		for (const YMeshView& mesh : meshes) {
+			YMeshEntry entry = {};
+			entry.vertexCount = mesh.vertexCount;
+			entry.indexCount = mesh.indexCount;
+			entry.materialLength = static_cast<uint32_t>(mesh.material.size());
+			entry.lodCount = mesh.lodCount;
+			entry.tangentCount = mesh.tangentCount;
+			file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+			file.write(mesh.material.data(), mesh.material.size());
+			file.write(padding, (4 - mesh.material.size() % 4) % 4);
+			file.write(reinterpret_cast<const char*>(mesh.vertices), (std::streamsize)mesh.vertexCount * sizeof(Vertex));
+			file.write(reinterpret_cast<const char*>(mesh.indices), (std::streamsize)mesh.indexCount * sizeof(unsigned int));
+			file.write(reinterpret_cast<const char*>(mesh.lods), (std::streamsize)mesh.lodCount * sizeof(MeshLod));
+			file.write(reinterpret_cast<const char*>(mesh.tangents), (std::streamsize)mesh.tangentCount * sizeof(glm::vec4));
+		}
+		if (!file.good())
+			return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, cachePath, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
+
+#endif // !MESH_CACHE_H
@@ -0,0 +1,326 @@
+// Load-time reordering of indexed triangle meshes for the GPU vertex pipeline:
+//  1. OptimizeVertexCache: Tipsify (Sander, Nehab, Barczak 2007) triangle order for the post-transform cache.
+//  2. OptimizeOverdraw: splits the result into clusters and sorts them so outward facing ones draw first.
+//  3. OptimizeVertexFetch: renumbers vertices in first-use order so vertex fetch walks memory linearly.
+// AnalyzeVertexCache reports ACMR/ATVR to measure the effect.
+//
+// Usage Example:
+// OptimizeVertexCache(indices, vertices.size());
+// OptimizeOverdraw(indices, vertices);
+// OptimizeVertexFetch(vertices, indices);
+
+#pragma once
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// Size of the simulated FIFO post-transform cache, a conservative value for current GPUs
+constexpr unsigned int kVertexCacheSize = 16;
+
+struct VertexCacheStats
+{
+	size_t triangles = 0;
+	size_t vertices = 0;    // referenced vertices
+	size_t transformed = 0; // cache misses, i.e. vertex shader invocations
+
+	float ACMR() const { return triangles ? (float)transformed / (float)triangles : 0.0f; } // average cache miss ratio, >= 0.5
+	float ATVR() const { return vertices ? (float)transformed / (float)vertices : 0.0f; }  // average transform to vertex ratio, >= 1.0
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries over a triangle list
+inline VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount,
+	unsigned int cacheSize = kVertexCacheSize)
+{
+	VertexCacheStats stats;
+	stats.triangles = indices.size() / 3;
+
+	std::vector<size_t> cachedAt(vertexCount, 0); // timestamp + 1 when the vertex entered the cache, 0 = never
+	std::vector<bool> referenced(vertexCount, false);
+	size_t time = 0;
+	for (unsigned int index : indices) {
+		if (index >= vertexCount)
+			continue;
+		if (!referenced[index]) {
+			referenced[index] = true;
+			stats.vertices++;
+		}
+		if (cachedAt[index] == 0 || time - (cachedAt[index] - 1) >= cacheSize) {
+			cachedAt[index] = time + 1;
+			time++;
+			stats.transformed++;
+		}
+	}
+	return stats;
+}
+
+namespace mesh_optimizer_detail {
+
+	// Triangles adjacent to each vertex, CSR layout
+	struct Adjacency
+	{
+		std::vector<unsigned int> offsets; // vertexCount + 1
+		std::vector<unsigned int> triangles;
+	};
+
+	inline Adjacency BuildAdjacency(const std::vector<unsigned int>& indices, size_t vertexCount)
+	{
+		Adjacency adjacency;
+		adjacency.offsets.assign(vertexCount + 1, 0);
+		for (unsigned int index : indices)
+			adjacency.offsets[index + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			adjacency.offsets[v + 1] += adjacency.offsets[v];
+
+		adjacency.triangles.resize(indices.size());
+		std::vector<unsigned int> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+			adjacency.triangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+		return adjacency;
+	}
+
+	inline bool IndicesValid(const std::vector<unsigned int>& indices, size_t vertexCount)
+	{
+		if (indices.size() % 3 != 0)
+			return false;
+		for (unsigned int index : indices) {
+			if (index >= vertexCount)
+				return false;
+		}
+		return true;
+	}
+
+} // namespace mesh_optimizer_detail
+
+/**
+ * Reorders triangles for the post-transform vertex cache with Tipsify.
+ * Linear time; fans around the most recently used vertex that will still be in the cache.
+ *
+ * @param indices Triangle list, rewritten in place.
+ * @param vertexCount Number of vertices indices refers to.
+ */
+inline void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+	unsigned int cacheSize = kVertexCacheSize)
+{
+	using namespace mesh_optimizer_detail;
+	if (indices.empty() || !IndicesValid(indices, vertexCount))
+		return;
+
+	const Adjacency adjacency = BuildAdjacency(indices, vertexCount);
+	const size_t triangleCount = indices.size() / 3;
+
+	std::vector<unsigned int> live(vertexCount, 0); // triangles not yet emitted per vertex
+	for (unsigned int index : indices)
+		live[index]++;
+
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd; // recently referenced vertices
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+
+	size_t time = cacheSize + 1;
+	size_t cursor = 0; // next vertex to try when the dead-end stack runs dry
+	long long fanning = 0;
+
+	while (fanning >= 0) {
+		candidates.clear();
+		for (unsigned int a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; a++) {
+			unsigned int triangle = adjacency.triangles[a];
+			if (emitted[triangle])
+				continue;
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[triangle * 3 + k];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[triangle] = true;
+		}
+
+		// Next fanning vertex: the candidate that stays in cache longest while fanning around it
+		fanning = -1;
+		long long bestPriority = -1;
+		for (unsigned int v : candidates) {
+			if (live[v] == 0)
+				continue;
+			long long priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = (long long)(time - cacheTime[v]);
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fanning = v;
+			}
+		}
+
+		if (fanning == -1) {
+			while (!deadEnd.empty() && fanning == -1) {
+				unsigned int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					fanning = v;
+			}
+			while (fanning == -1 && cursor < vertexCount) {
+				if (live[cursor] > 0)
+					fanning = (long long)cursor;
+				cursor++;
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+/**
+ * Reorders clusters of triangles to reduce overdraw, keeping most of the vertex cache efficiency.
+ * The index buffer should already be cache optimized; it is cut where the simulated cache restarts
+ * and further where a cluster's ACMR stays within threshold of its parent, then clusters facing away
+ * from the mesh centre (likely occluders) are drawn first.
+ *
+ * @param threshold Allowed ACMR degradation, e.g. 1.05 for 5%.
+ */
+inline void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+	float threshold = 1.05f, unsigned int cacheSize = kVertexCacheSize)
+{
+	using namespace mesh_optimizer_detail;
+	const size_t vertexCount = vertices.size();
+	if (indices.empty() || !IndicesValid(indices, vertexCount))
+		return;
+
+	const size_t triangleCount = indices.size() / 3;
+
+	// Cache misses per triangle from a FIFO simulation, optionally restarting the cache at 'start'
+	std::vector<size_t> cachedAt(vertexCount, 0);
+	size_t time = 0;
+	auto triangleMisses = [&](size_t triangle) {
+		unsigned int misses = 0;
+		for (int k = 0; k < 3; k++) {
+			unsigned int v = indices[triangle * 3 + k];
+			if (cachedAt[v] == 0 || time - (cachedAt[v] - 1) >= cacheSize) {
+				cachedAt[v] = ++time;
+				misses++;
+			}
+		}
+		return misses;
+	};
+	auto flushCache = [&]() { time += cacheSize + 1; };
+
+	// Hard boundaries: triangles where the cache had to be refilled completely
+	std::vector<size_t> hard;
+	for (size_t t = 0; t < triangleCount; t++) {
+		if (triangleMisses(t) == 3 || t == 0)
+			hard.push_back(t);
+	}
+	hard.push_back(triangleCount);
+
+	// Soft boundaries: split hard clusters wherever the running ACMR is still within threshold
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); h++) {
+		size_t start = hard[h], end = hard[h + 1];
+
+		flushCache();
+		size_t clusterMisses = 0;
+		for (size_t t = start; t < end; t++)
+			clusterMisses += triangleMisses(t);
+		float clusterThreshold = threshold * (float)clusterMisses / (float)(end - start);
+
+		flushCache();
+		clusters.push_back(start);
+		size_t runStart = start, runMisses = 0;
+		for (size_t t = start; t < end; t++) {
+			runMisses += triangleMisses(t);
+			if (t + 1 < end && (float)runMisses / (float)(t - runStart + 1) <= clusterThreshold) {
+				clusters.push_back(t + 1);
+				runStart = t + 1;
+				runMisses = 0;
+				flushCache();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// Sort key per cluster: how far its centroid lies along its own (area weighted) normal from the mesh centre
+	glm::vec3 meshCenter(0.0f);
+	float meshArea = 0.0f;
+	const size_t clusterCount = clusters.size() - 1;
+	std::vector<glm::vec3> clusterCenter(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+	std::vector<float> clusterArea(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; c++) {
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0); // length = 2 * area
+			float area = glm::length(n);
+			glm::vec3 center = (p0 + p1 + p2) / 3.0f;
+			clusterCenter[c] += center * area;
+			clusterNormal[c] += n;
+			clusterArea[c] += area;
+			meshCenter += center * area;
+			meshArea += area;
+		}
+	}
+	if (meshArea > 0.0f)
+		meshCenter /= meshArea;
+
+	std::vector<float> sortKey(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; c++) {
+		if (clusterArea[c] <= 0.0f)
+			continue;
+		glm::vec3 center = clusterCenter[c] / clusterArea[c];
+		float normalLength = glm::length(clusterNormal[c]);
+		if (normalLength > 0.0f)
+			sortKey[c] = glm::dot(center - meshCenter, clusterNormal[c] / normalLength);
+	}
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (size_t c : order)
+		output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	indices.swap(output);
+}
+
+/**
+ * Renumbers vertices in the order the index buffer first references them, so vertex fetches
+ * walk the vertex buffer front to back. Unreferenced vertices are dropped.
+ */
+template<typename VertexType>
+void OptimizeVertexFetch(std::vector<VertexType>& vertices, std::vector<unsigned int>& indices)
+{
+	for (unsigned int index : indices) {
+		if (index >= vertices.size())
+			return; // invalid index buffer, leave the mesh alone
+	}
+
+	const unsigned int unused = 0xFFFFFFFFu;
+	std::vector<unsigned int> remap(vertices.size(), unused);
+	std::vector<VertexType> output;
+	output.reserve(vertices.size());
+
+	for (unsigned int& index : indices) {
+		if (remap[index] == unused) {
+			remap[index] = static_cast<unsigned int>(output.size());
+			output.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(output);
+}
+
+#endif // !MESH_OPTIMIZER_H
@@ -0,0 +1,471 @@
+// Quadric error metric simplification (Garland & Heckbert 1997) by edge collapse, used to build LOD chains.
+// Vertices are only ever collapsed onto one of their neighbours, never moved or created, so every level
+// indexes the original vertex buffer and a mesh's LODs can share its VBO and live back to back in its IBO.
+//
+// Seam aware: vertices sharing a position but not their normal/UV (attribute seams) collapse together,
+// only along the seam, and open borders only collapse along the border. Positions where more than two
+// seams meet are kept in place.
+//
+// Usage Example:
+// std::vector<MeshLod> lods;
+// GenerateLodChain(vertices, indices, 4, lods); // indices = LOD0 | LOD1 | LOD2 | LOD3
+// glDrawElements(GL_TRIANGLES, lods[2].indexCount, GL_UNSIGNED_INT, (void*)(lods[2].indexOffset * sizeof(unsigned int)));
+
+#pragma once
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "mesh_optimizer.h"
+
+// Each LOD keeps about this fraction of the previous level's triangles
+constexpr float kLodReduction = 0.5f;
+
+// Largest error a LOD may introduce, relative to the mesh extent
+constexpr float kLodMaxError = 0.05f;
+
+namespace mesh_simplifier_detail {
+
+	// Symmetric 4x4 matrix of the weighted squared distances to a set of planes
+	struct Quadric
+	{
+		double a2 = 0, ab = 0, ac = 0, ad = 0;
+		double b2 = 0, bc = 0, bd = 0;
+		double c2 = 0, cd = 0;
+		double d2 = 0;
+		double weight = 0;
+
+		// Plane n.x * x + n.y * y + n.z * z + d = 0 with unit normal n
+		static Quadric FromPlane(const glm::dvec3& n, double d, double weight)
+		{
+			Quadric q;
+			q.a2 = n.x * n.x * weight; q.ab = n.x * n.y * weight; q.ac = n.x * n.z * weight; q.ad = n.x * d * weight;
+			q.b2 = n.y * n.y * weight; q.bc = n.y * n.z * weight; q.bd = n.y * d * weight;
+			q.c2 = n.z * n.z * weight; q.cd = n.z * d * weight;
+			q.d2 = d * d * weight;
+			q.weight = weight;
+			return q;
+		}
+
+		Quadric& operator+=(const Quadric& o)
+		{
+			a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+			b2 += o.b2; bc += o.bc; bd += o.bd;
+			c2 += o.c2; cd += o.cd;
+			d2 += o.d2;
+			weight += o.weight;
+			return *this;
+		}
+
+		// Mean squared distance of p to the planes
+		double Error(const glm::dvec3& p) const
+		{
+			double e = a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+				+ b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+				+ c2 * p.z * p.z + 2 * cd * p.z
+				+ d2;
+			return e > 0.0 && weight > 0.0 ? e / weight : 0.0;
+		}
+	};
+
+	enum VertexKind : unsigned char
+	{
+		kManifold, // interior vertex with a single set of attributes
+		kBorder,   // on an open border of the mesh
+		kSeam,     // two vertices share the position, split by a normal/UV seam
+		kLocked,   // anything more complex, never collapsed
+	};
+
+	// Directed edges of a triangle list, to find the open (unpaired) ones.
+	// Built over vertex indices, or over positions when a position remap is given.
+	class EdgeSet
+	{
+	public:
+		void Build(const std::vector<unsigned int>& indices, const std::vector<unsigned int>* remap = nullptr)
+		{
+			edges.clear();
+			edges.reserve(indices.size());
+			for (size_t t = 0; t < indices.size(); t += 3) {
+				for (int k = 0; k < 3; k++) {
+					unsigned int a = indices[t + k], b = indices[t + (k + 1) % 3];
+					edges.insert(remap ? Key((*remap)[a], (*remap)[b]) : Key(a, b));
+				}
+			}
+		}
+
+		bool Has(unsigned int a, unsigned int b) const { return edges.count(Key(a, b)) != 0; }
+
+	private:
+		static uint64_t Key(unsigned int a, unsigned int b) { return ((uint64_t)a << 32) | b; }
+		std::unordered_set<uint64_t> edges;
+	};
+
+	// Maps every vertex to the first vertex with a bitwise identical position
+	inline void BuildPositionRemap(const std::vector<Vertex>& vertices, std::vector<unsigned int>& remap,
+		std::vector<unsigned int>& wedge)
+	{
+		struct PositionHash
+		{
+			size_t operator()(const glm::vec3& p) const
+			{
+				uint32_t bits[3];
+				std::memcpy(bits, &p, sizeof(bits));
+				return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+			}
+		};
+		struct PositionEqual
+		{
+			bool operator()(const glm::vec3& a, const glm::vec3& b) const { return std::memcmp(&a, &b, sizeof(a)) == 0; }
+		};
+
+		std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> firstAt;
+		firstAt.reserve(vertices.size());
+		remap.resize(vertices.size());
+		wedge.resize(vertices.size());
+		for (unsigned int v = 0; v < (unsigned int)vertices.size(); v++) {
+			auto inserted = firstAt.emplace(vertices[v].position, v);
+			remap[v] = inserted.first->second;
+			// wedge links the vertices of one position into a ring
+			if (inserted.second) {
+				wedge[v] = v;
+			}
+			else {
+				unsigned int first = inserted.first->second;
+				wedge[v] = wedge[first];
+				wedge[first] = v;
+			}
+		}
+	}
+
+	/**
+	 * Classifies every vertex. openOut/openIn count the directed edges leaving/entering a vertex
+	 * whose reverse does not exist, in attribute (index) space.
+	 */
+	inline void ClassifyVertices(const std::vector<unsigned int>& indices, const std::vector<unsigned int>& remap,
+		const std::vector<unsigned int>& wedge, std::vector<VertexKind>& kinds)
+	{
+		const size_t vertexCount = remap.size();
+
+		EdgeSet attributeEdges, positionEdges;
+		attributeEdges.Build(indices);
+		positionEdges.Build(indices, &remap);
+
+		std::vector<unsigned int> openOut(vertexCount, 0), openIn(vertexCount, 0);
+		std::vector<bool> positionOpen(vertexCount, false);
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = indices[t + k], b = indices[t + (k + 1) % 3];
+				if (!attributeEdges.Has(b, a)) {
+					openOut[a]++;
+					openIn[b]++;
+				}
+				if (!positionEdges.Has(remap[b], remap[a]))
+					positionOpen[remap[a]] = positionOpen[remap[b]] = true;
+			}
+		}
+
+		kinds.assign(vertexCount, kLocked);
+		for (unsigned int v = 0; v < (unsigned int)vertexCount; v++) {
+			if (remap[v] != v)
+				continue; // classified with its position's first vertex
+
+			unsigned int wedgeCount = 1;
+			for (unsigned int w = wedge[v]; w != v; w = wedge[w])
+				wedgeCount++;
+
+			VertexKind kind = kLocked;
+			if (wedgeCount == 1) {
+				if (openOut[v] == 0 && openIn[v] == 0)
+					kind = kManifold;
+				else if (openOut[v] == 1 && openIn[v] == 1)
+					kind = kBorder;
+			}
+			else if (wedgeCount == 2 && !positionOpen[v]) {
+				unsigned int w = wedge[v];
+				if (openOut[v] == 1 && openIn[v] == 1 && openOut[w] == 1 && openIn[w] == 1)
+					kind = kSeam;
+			}
+
+			kinds[v] = kind;
+			for (unsigned int w = wedge[v]; w != v; w = wedge[w])
+				kinds[w] = kind;
+		}
+	}
+
+	// Vertex of position 'target' connected to 'from' by an open attribute edge, or ~0u
+	inline unsigned int FindSeamPartner(unsigned int from, unsigned int target, const std::vector<unsigned int>& wedge,
+		const EdgeSet& edges)
+	{
+		unsigned int w = target;
+		do {
+			if (edges.Has(from, w) != edges.Has(w, from))
+				return w;
+			w = wedge[w];
+		} while (w != target);
+		return ~0u;
+	}
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double error;
+	};
+
+} // namespace mesh_simplifier_detail
+
+/**
+ * Simplifies a triangle list by collapsing the edges with the smallest quadric error first,
+ * until targetIndexCount is reached or every remaining collapse would exceed targetError.
+ *
+ * @param indices Triangle list, replaced by the simplified one.
+ * @param targetError Largest allowed error relative to the mesh extent, e.g. 0.01 for 1%.
+ * @param resultError If not null, receives the error of the result, relative to the mesh extent.
+ * @return The new index count.
+ */
+inline size_t SimplifyMesh(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+	size_t targetIndexCount, float targetError = kLodMaxError, float* resultError = nullptr)
+{
+	using namespace mesh_simplifier_detail;
+	if (resultError)
+		*resultError = 0.0f;
+	if (indices.size() <= targetIndexCount || !mesh_optimizer_detail::IndicesValid(indices, vertices.size()))
+		return indices.size();
+
+	const size_t vertexCount = vertices.size();
+
+	// Work in a unit box so errors are relative to the mesh extent
+	glm::vec3 boundsMin, boundsMax;
+	ComputeBounds(vertices, boundsMin, boundsMax);
+	glm::vec3 size = boundsMax - boundsMin;
+	double extent = std::max(std::max(size.x, size.y), size.z);
+	double invExtent = extent > 0.0 ? 1.0 / extent : 0.0;
+	std::vector<glm::dvec3> positions(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		positions[v] = glm::dvec3(vertices[v].position - boundsMin) * invExtent;
+
+	std::vector<unsigned int> remap, wedge;
+	std::vector<VertexKind> kinds;
+	BuildPositionRemap(vertices, remap, wedge);
+	ClassifyVertices(indices, remap, wedge, kinds);
+
+	// Plane quadric of every triangle, area weighted, plus edge planes perpendicular to
+	// borders and seams so collapses along them keep their outline
+	const double kEdgeWeight = 10.0;
+	std::vector<Quadric> quadrics(vertexCount);
+	{
+		EdgeSet attributeEdges;
+		attributeEdges.Build(indices);
+
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			const glm::dvec3& p0 = positions[indices[t + 0]];
+			const glm::dvec3& p1 = positions[indices[t + 1]];
+			const glm::dvec3& p2 = positions[indices[t + 2]];
+			glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+			double length = glm::length(n);
+			if (length <= 0.0)
+				continue;
+			n /= length;
+			Quadric plane = Quadric::FromPlane(n, -glm::dot(n, p0), length * 0.5);
+			for (int k = 0; k < 3; k++)
+				quadrics[remap[indices[t + k]]] += plane;
+
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = indices[t + k], b = indices[t + (k + 1) % 3];
+				if (attributeEdges.Has(b, a))
+					continue;
+				glm::dvec3 edge = positions[b] - positions[a];
+				double edgeLength = glm::length(edge);
+				glm::dvec3 edgeNormal = glm::cross(edge, n);
+				double normalLength = glm::length(edgeNormal);
+				if (normalLength <= 0.0)
+					continue;
+				edgeNormal /= normalLength;
+				Quadric edgePlane = Quadric::FromPlane(edgeNormal, -glm::dot(edgeNormal, positions[a]), edgeLength * kEdgeWeight);
+				quadrics[remap[a]] += edgePlane;
+				quadrics[remap[b]] += edgePlane;
+			}
+		}
+	}
+
+	const double errorLimit = (double)targetError * targetError;
+	double resultErrorSquared = 0.0;
+
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> collapseRemap(vertexCount);
+	std::vector<bool> locked(vertexCount);
+	std::vector<unsigned int> triangleOffsets, triangleList; // triangles around each position, CSR
+	EdgeSet edges;
+
+	while (indices.size() > targetIndexCount) {
+		edges.Build(indices);
+
+		// Candidate collapses along every triangle edge, both directions
+		collapses.clear();
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				unsigned int e[2] = { indices[t + k], indices[t + (k + 1) % 3] };
+				bool open = !edges.Has(e[1], e[0]);
+				// A paired edge appears in two triangles, evaluate it once
+				if (!open && e[0] > e[1])
+					continue;
+				for (int dir = 0; dir < 2; dir++) {
+					unsigned int from = e[dir], to = e[1 - dir];
+					VertexKind fromKind = kinds[from], toKind = kinds[to];
+					if (remap[from] == remap[to] || fromKind == kLocked)
+						continue;
+					if (fromKind == kBorder && !(open && (toKind == kBorder || toKind == kLocked)))
+						continue;
+					if (fromKind == kSeam && !(open && (toKind == kSeam || toKind == kLocked)))
+						continue;
+
+					Quadric q = quadrics[remap[from]];
+					q += quadrics[remap[to]];
+					collapses.push_back({ from, to, q.Error(positions[to]) });
+				}
+			}
+		}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		// Triangles around each position, for the flip test
+		triangleOffsets.assign(vertexCount + 1, 0);
+		for (unsigned int index : indices)
+			triangleOffsets[remap[index] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			triangleOffsets[v + 1] += triangleOffsets[v];
+		triangleList.resize(indices.size());
+		{
+			std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++)
+				triangleList[fill[remap[indices[i]]]++] = (unsigned int)(i / 3);
+		}
+
+		// Rejects collapses that would turn a triangle around 'from' over
+		auto flips = [&](unsigned int from, unsigned int to) {
+			unsigned int fromPosition = remap[from], toPosition = remap[to];
+			for (unsigned int a = triangleOffsets[fromPosition]; a < triangleOffsets[fromPosition + 1]; a++) {
+				size_t t = (size_t)triangleList[a] * 3;
+				unsigned int r[3] = { remap[indices[t]], remap[indices[t + 1]], remap[indices[t + 2]] };
+				if (r[0] == toPosition || r[1] == toPosition || r[2] == toPosition)
+					continue; // collapses to nothing
+				glm::dvec3 p[3] = { positions[r[0]], positions[r[1]], positions[r[2]] };
+				glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				for (int k = 0; k < 3; k++) {
+					if (r[k] == fromPosition)
+						p[k] = positions[toPosition];
+				}
+				glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+				if (glm::dot(before, after) <= 0.25 * glm::length(before) * glm::length(after))
+					return true;
+			}
+			return false;
+		};
+
+		// Marks the one-ring of a position so neighbouring collapses wait for the next pass
+		auto lockRing = [&](unsigned int position) {
+			for (unsigned int a = triangleOffsets[position]; a < triangleOffsets[position + 1]; a++) {
+				size_t t = (size_t)triangleList[a] * 3;
+				for (int k = 0; k < 3; k++)
+					locked[remap[indices[t + k]]] = true;
+			}
+		};
+
+		for (unsigned int v = 0; v < (unsigned int)vertexCount; v++)
+			collapseRemap[v] = v;
+		std::fill(locked.begin(), locked.end(), false);
+
+		const size_t trianglesToRemove = (indices.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		for (const Collapse& collapse : collapses) {
+			if (collapse.error > errorLimit || removed >= trianglesToRemove)
+				break;
+
+			unsigned int from = collapse.from, to = collapse.to;
+			unsigned int fromPosition = remap[from], toPosition = remap[to];
+			if (locked[fromPosition] || locked[toPosition] || flips(from, to))
+				continue;
+
+			if (kinds[from] == kSeam) {
+				// The other side of the seam moves along with it
+				unsigned int partner = wedge[from];
+				unsigned int partnerTo = FindSeamPartner(partner, to, wedge, edges);
+				if (partnerTo == ~0u || partnerTo == to)
+					continue;
+				collapseRemap[from] = to;
+				collapseRemap[partner] = partnerTo;
+			}
+			else {
+				// Every wedge of a manifold or border position is that position itself
+				collapseRemap[from] = to;
+			}
+
+			quadrics[toPosition] += quadrics[fromPosition];
+			lockRing(fromPosition);
+			lockRing(toPosition);
+			resultErrorSquared = std::max(resultErrorSquared, collapse.error);
+			removed += kinds[from] == kBorder ? 1 : 2;
+		}
+
+		// Rewrite the triangles, dropping the ones that collapsed
+		size_t before = indices.size();
+		size_t write = 0;
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			unsigned int a = collapseRemap[indices[t]], b = collapseRemap[indices[t + 1]], c = collapseRemap[indices[t + 2]];
+			if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+				continue;
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+
+		if (write == before)
+			break; // nothing left within the error limit
+	}
+
+	if (resultError)
+		*resultError = (float)std::sqrt(resultErrorSquared);
+	return indices.size();
+}
+
+/**
+ * Appends up to levels - 1 simplified copies of the LOD0 triangle list in indices, each with about
+ * kLodReduction of the previous level's triangles, and describes every level in lods.
+ * Stops early when a level cannot be reduced enough within kLodMaxError.
+ *
+ * @param indices LOD0 triangle list on input, all levels back to back on output.
+ */
+inline void GenerateLodChain(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
+	unsigned int levels, std::vector<MeshLod>& lods)
+{
+	lods.clear();
+	lods.push_back({ 0u, (unsigned int)indices.size(), 0.0f });
+
+	std::vector<unsigned int> level(indices);
+	for (unsigned int i = 1; i < levels; i++) {
+		size_t previousCount = level.size();
+		size_t target = (size_t)(previousCount / 3 * kLodReduction) * 3;
+		float error = 0.0f;
+		SimplifyMesh(level, vertices, target, kLodMaxError, &error);
+		if (level.empty() || level.size() > previousCount * 0.9f)
+			break; // not worth another level
+
+		OptimizeVertexCache(level, vertices.size());
+		lods.push_back({ (unsigned int)indices.size(), (unsigned int)level.size(), std::max(error, lods.back().error) });
+		indices.insert(indices.end(), level.begin(), level.end());
+	}
+}
+
+#endif // !MESH_SIMPLIFIER_H
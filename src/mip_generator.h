@@ -0,0 +1,261 @@
+// CPU mip chain generation for 8-bit textures, replacing glGenerateMipmap.
+// Each level is filtered from the previous one in linear float space with the separable
+// [1 3 3 1] / 8 kernel (wrapping at the edges, like GL_REPEAT), which aliases far less than
+// glGenerateMipmap's 2x2 box:
+//   MipFilter::Color   RGB is sRGB encoded: decoded to linear, filtered, re-encoded; alpha is linear
+//   MipFilter::Linear  data maps (roughness, metallic, ao), filtered as stored
+//   MipFilter::Normal  tangent space normal maps, unpacked to [-1, 1] and renormalized per level
+// The filter runs on one RGBA float vector per texel, SSE2 when the compiler targets it.
+//
+// Usage Example:
+// MipChain mips;
+// GenerateMipChain(pixels, width, height, components, MipFilter::Color, mips);
+// for (const MipLevel& level : mips.levels)
+//     Upload(mips.data.data() + level.offset, level.width, level.height);
+
+#pragma once
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+enum class MipFilter
+{
+	Color,
+	Linear,
+	Normal,
+};
+
+// One level of a MipChain inside MipChain::data
+struct MipLevel
+{
+	int width = 0, height = 0;
+	size_t offset = 0;
+	size_t size = 0;
+};
+
+// Levels 1..n of an image (level 0 stays with the caller), same component count as the source
+struct MipChain
+{
+	int components = 0;
+	std::vector<MipLevel> levels; // largest first, down to 1x1
+	std::vector<uint8_t> data;
+
+	size_t LevelCount() const { return levels.size() + 1; } // including level 0
+};
+
+/**
+ * Builds every level below the source image down to 1x1.
+ *
+ * @param components 1 (gray), 2 (gray, alpha), 3 (RGB) or 4 (RGBA), as returned by stbi_load.
+ */
+inline void GenerateMipChain(const uint8_t* pixels, int width, int height, int components, MipFilter filter, MipChain& chain);
+
+namespace mip_generator_detail
+{
+	// sRGB <-> linear, exact for decoding, within half a step for encoding
+	inline const float* SRGBToLinearTable()
+	{
+		static const std::vector<float> table = []() {
+			std::vector<float> values(256);
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			return values;
+		}();
+		return table.data();
+	}
+
+	constexpr int kLinearToSRGBSteps = 8192;
+
+	inline const uint8_t* LinearToSRGBTable()
+	{
+		static const std::vector<uint8_t> table = []() {
+			std::vector<uint8_t> values(kLinearToSRGBSteps + 1);
+			for (int i = 0; i <= kLinearToSRGBSteps; i++) {
+				float l = static_cast<float>(i) / kLinearToSRGBSteps;
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				values[i] = static_cast<uint8_t>(std::lround(std::min(std::max(c, 0.0f), 1.0f) * 255.0f));
+			}
+			return values;
+		}();
+		return table.data();
+	}
+
+	inline uint8_t ToUnorm8(float value)
+	{
+		return static_cast<uint8_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 255.0f));
+	}
+
+	// 8-bit texels -> RGBA float in the space the filter works in
+	inline void Unpack(const uint8_t* pixels, size_t count, int components, MipFilter filter, float* rgba)
+	{
+		const float* toLinear = SRGBToLinearTable();
+		for (size_t i = 0; i < count; i++) {
+			const uint8_t* p = pixels + i * components;
+			uint8_t c[4];
+			switch (components) {
+			case 1: c[0] = c[1] = c[2] = p[0]; c[3] = 255; break;
+			case 2: c[0] = c[1] = c[2] = p[0]; c[3] = p[1]; break;
+			case 3: c[0] = p[0]; c[1] = p[1]; c[2] = p[2]; c[3] = 255; break;
+			default: c[0] = p[0]; c[1] = p[1]; c[2] = p[2]; c[3] = p[3]; break;
+			}
+			float* out = rgba + i * 4;
+			for (int k = 0; k < 3; k++) {
+				if (filter == MipFilter::Color) out[k] = toLinear[c[k]];
+				else if (filter == MipFilter::Normal) out[k] = c[k] / 127.5f - 1.0f;
+				else out[k] = c[k] / 255.0f;
+			}
+			out[3] = c[3] / 255.0f;
+		}
+	}
+
+	// Renormalizes the xyz of every texel, flat (zero) normals become +z
+	inline void Renormalize(float* rgba, size_t count)
+	{
+		for (size_t i = 0; i < count; i++) {
+			float* n = rgba + i * 4;
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length > 1e-6f) {
+				n[0] /= length; n[1] /= length; n[2] /= length;
+			}
+			else {
+				n[0] = 0.0f; n[1] = 0.0f; n[2] = 1.0f;
+			}
+		}
+	}
+
+	// RGBA float -> 8-bit texels with the source's component count
+	inline void Pack(const float* rgba, size_t count, int components, MipFilter filter, uint8_t* pixels)
+	{
+		const uint8_t* toSRGB = LinearToSRGBTable();
+		for (size_t i = 0; i < count; i++) {
+			const float* in = rgba + i * 4;
+			uint8_t c[4];
+			for (int k = 0; k < 3; k++) {
+				if (filter == MipFilter::Color) {
+					float l = std::min(std::max(in[k], 0.0f), 1.0f);
+					c[k] = toSRGB[static_cast<int>(l * kLinearToSRGBSteps + 0.5f)];
+				}
+				else if (filter == MipFilter::Normal) {
+					c[k] = ToUnorm8(in[k] * 0.5f + 0.5f);
+				}
+				else {
+					c[k] = ToUnorm8(in[k]);
+				}
+			}
+			c[3] = ToUnorm8(in[3]);
+
+			uint8_t* p = pixels + i * components;
+			switch (components) {
+			case 1: p[0] = c[0]; break;
+			case 2: p[0] = c[0]; p[1] = c[3]; break;
+			case 3: p[0] = c[0]; p[1] = c[1]; p[2] = c[2]; break;
+			default: p[0] = c[0]; p[1] = c[1]; p[2] = c[2]; p[3] = c[3]; break;
+			}
+		}
+	}
+
+	// out = (a + 3b + 3c + d) / 8 for one RGBA texel
+	inline void Filter4(const float* a, const float* b, const float* c, const float* d, float* out)
+	{
+#ifdef MIP_GENERATOR_SSE2
+		__m128 three = _mm_set1_ps(3.0f), eighth = _mm_set1_ps(0.125f);
+		__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(d)),
+			_mm_mul_ps(three, _mm_add_ps(_mm_loadu_ps(b), _mm_loadu_ps(c))));
+		_mm_storeu_ps(out, _mm_mul_ps(sum, eighth));
+#else
+		for (int k = 0; k < 4; k++)
+			out[k] = (a[k] + 3.0f * (b[k] + c[k]) + d[k]) * 0.125f;
+#endif
+	}
+
+	inline int Wrap(int i, int size) { return ((i % size) + size) % size; }
+
+	// Halves a linear RGBA float image, horizontally then vertically. A dimension of 1 is kept.
+	inline void Downsample(const std::vector<float>& source, int width, int height, std::vector<float>& target,
+		int& targetWidth, int& targetHeight)
+	{
+		targetWidth = std::max(width / 2, 1);
+		targetHeight = std::max(height / 2, 1);
+
+		std::vector<float> rows(static_cast<size_t>(targetWidth) * height * 4);
+		for (int y = 0; y < height; y++) {
+			const float* in = source.data() + static_cast<size_t>(y) * width * 4;
+			float* out = rows.data() + static_cast<size_t>(y) * targetWidth * 4;
+			for (int x = 0; x < targetWidth; x++) {
+				if (width == 1) {
+					std::copy(in, in + 4, out + x * 4);
+					continue;
+				}
+				int center = 2 * x;
+				Filter4(in + Wrap(center - 1, width) * 4, in + center * 4, in + Wrap(center + 1, width) * 4,
+					in + Wrap(center + 2, width) * 4, out + x * 4);
+			}
+		}
+
+		target.resize(static_cast<size_t>(targetWidth) * targetHeight * 4);
+		size_t rowFloats = static_cast<size_t>(targetWidth) * 4;
+		for (int y = 0; y < targetHeight; y++) {
+			float* out = target.data() + y * rowFloats;
+			if (height == 1) {
+				std::copy(rows.begin(), rows.begin() + rowFloats, out);
+				continue;
+			}
+			int center = 2 * y;
+			const float* r0 = rows.data() + Wrap(center - 1, height) * rowFloats;
+			const float* r1 = rows.data() + center * rowFloats;
+			const float* r2 = rows.data() + Wrap(center + 1, height) * rowFloats;
+			const float* r3 = rows.data() + Wrap(center + 2, height) * rowFloats;
+			for (size_t i = 0; i < rowFloats; i += 4)
+				Filter4(r0 + i, r1 + i, r2 + i, r3 + i, out + i);
+		}
+	}
+}
+
+inline void GenerateMipChain(const uint8_t* pixels, int width, int height, int components, MipFilter filter, MipChain& chain)
+{
+	using namespace mip_generator_detail;
+
+	chain = MipChain();
+	chain.components = components;
+	if (pixels == nullptr || width <= 0 || height <= 0 || (width == 1 && height == 1))
+		return;
+
+	std::vector<float> level(static_cast<size_t>(width) * height * 4), next;
+	Unpack(pixels, static_cast<size_t>(width) * height, components, filter, level.data());
+
+	int levelWidth = width, levelHeight = height;
+	while (levelWidth > 1 || levelHeight > 1) {
+		int nextWidth, nextHeight;
+		Downsample(level, levelWidth, levelHeight, next, nextWidth, nextHeight);
+		size_t count = static_cast<size_t>(nextWidth) * nextHeight;
+		if (filter == MipFilter::Normal)
+			Renormalize(next.data(), count);
+
+		MipLevel mip;
+		mip.width = nextWidth;
+		mip.height = nextHeight;
+		mip.offset = chain.data.size();
+		mip.size = count * components;
+		chain.data.resize(mip.offset + mip.size);
+		Pack(next.data(), count, components, filter, chain.data.data() + mip.offset);
+		chain.levels.push_back(mip);
+
+		level.swap(next);
+		levelWidth = nextWidth;
+		levelHeight = nextHeight;
+	}
+}
+
+#endif // !MIP_GENERATOR_H
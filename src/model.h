@@ -7,9 +7,12 @@
 #include "stb_image.h"
 #endif 
 
+#include <algorithm>
+#include <future>
 #include <vector>
 #include <unordered_map>
 #include <string>
+#include <memory>
 #include <fstream>
 #include <sstream>
 #include <tuple>
@@ -19,23 +22,139 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <GL/gl3w.h>
 
+#include "mapped_file.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "obj_parser.h"
 #include "shader.h"
+#include "tangent_space.h"
+#include "texture_array.h"
+#include "texture_compression.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+#include "timer.h"
+
+// Options controlling how Model loads its OBJ file.
+struct ModelLoadOptions
+{
+	// Worker threads parsing the OBJ text in line-aligned chunks. 0 uses one per hardware
+	// thread, 1 forces the serial parser. Files below two 1 MB chunks are always parsed serially.
+	unsigned int parseThreads = 0;
+
+	// Worker threads decoding the MTL textures, one file per task. 0 uses one per hardware thread.
+	unsigned int textureThreads = 0;
+
+	// Read meshes from the .ymesh cache beside the .obj when it is up to date,
+	// and (re)write the cache after parsing otherwise.
+	bool useMeshCache = true;
+
+	// Reorder each mesh's triangles for the post-transform vertex cache and overdraw,
+	// then its vertices for fetch locality, before upload. Done once, the cache stores the result.
+	bool optimizeMeshes = true;
+
+	// Upload 16-byte quantized vertices (unorm16 position, octahedral normal, half float UVs)
+	// instead of 32-byte float ones. The shaders dequantize with Mesh::SetVertexFormatUniforms.
+	bool quantizeVertices = false;
+
+	// Levels of detail generated per mesh by quadric simplification, each with about half the
+	// triangles of the previous one. 1 disables the LOD chain. Stored in the mesh cache.
+	unsigned int lodLevels = 1;
+
+	// Generate per-vertex tangents (MikkTSpace conventions) for normal mapped shaders,
+	// bound at attribute location 7. Stored in the mesh cache.
+	bool generateTangents = false;
+
+	// Block compress each MTL texture into a .dds beside it (BC5 normal maps, BC4 single channel,
+	// BC1/BC7 color, see texture_compression.h) when it is missing or older than the image.
+	// An up to date .dds is always preferred, whether or not this is set.
+	bool compressTextures = false;
+
+	// Create each texture from its mip tail and let TextureStreamer::Update upload the finer levels
+	// over the following frames, instead of uploading it whole in one UploadNext step.
+	bool streamTextures = false;
+
+	// Pack the MTL textures into GL_TEXTURE_2D_ARRAYs and merge the meshes into one vertex buffer with a
+	// per-vertex layer index, so RenderBatched draws every group of materials whose maps match in type, size
+	// and format with one call and no rebinding. The arrays belong to the model rather than TextureCache and
+	// upload whole (streamTextures does not apply); TextureCache counts them against its budget, but cannot evict
+	// them. The meshes' own textures become views of their layers, and Render draws them from the merged buffer.
+	bool textureArrays = false;
+};
+
+// Size and timing figures gathered while loading a model, used to track load throughput.
+struct ModelLoadStats
+{
+	size_t fileBytes = 0;             // size of the .obj file
+	unsigned int parseThreads = 0;    // threads that parsed the OBJ text, 1 for the serial parser
+	bool fromCache = false;           // meshes came from the .ymesh cache, nothing was parsed
+	long long parseMicroseconds = 0;  // text -> attribute/corner arrays
+	long long totalMicroseconds = 0;  // including mesh construction, excluding MTL textures and GPU upload
+	long long uploadMicroseconds = 0; // creating the textures, VAOs and buffers on the GL thread
+
+	size_t textureCount = 0;                // MTL texture files decoded (resident ones are skipped)
+	size_t textureBytes = 0;                // their decoded pixels or compressed blocks
+	unsigned int textureThreads = 0;        // workers used for decoding
+	long long textureMicroseconds = 0;      // wall time decoding them
+	long long textureDecodeMicroseconds = 0; // summed over the files, textureMicroseconds on a single thread
+
+	size_t referencedVertices = 0;    // face corners in the file
+	size_t uniqueVertices = 0;        // vertices actually stored after (v, vt, vn) deduplication
+
+	VertexCacheStats vertexCacheBefore; // simulated post-transform cache, file order
+	VertexCacheStats vertexCacheAfter;  // and after optimizeMeshes
+
+	QuantizationError quantizationError; // worst case over all meshes when quantizeVertices is set
+
+	std::vector<size_t> lodTriangles;    // triangles per LOD level, summed over all meshes
+
+	double ParseBytesPerSecond() const
+	{
+		return parseMicroseconds > 0 ? (double)fileBytes * 1e6 / (double)parseMicroseconds : 0.0;
+	}
 
-/**
- * Loads a texture from a file and returns its OpenGL texture ID.
- * Assumes an OpenGL context is available and properly set up.
- *
- * @param textureFilepath Path to the texture file.
- * @return OpenGL texture ID for the loaded texture.
- */
-static unsigned int LoadTexture(const std::string& path, bool isHDR = false);
+	size_t VertexBytesSaved() const { return (referencedVertices - uniqueVertices) * sizeof(Vertex); }
+};
+
+// CPU side of one mesh, built without a GL context and turned into a Mesh on the GL thread.
+struct MeshData
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec4> tangents; // empty unless generateTangents
+	std::vector<MeshLod> lods;       // empty unless lodLevels > 1
+	std::string material;            // 'usemtl' name, empty if none
+};
+
+// Everything Model::LoadData produces: meshes, material textures (ids still 0) and their decoded images.
+struct ModelData
+{
+	std::vector<MeshData> meshes;
+	std::unordered_map<std::string, std::vector<Texture>> materials;
+	std::vector<TextureImage> images; // one per distinct texture file not yet in TextureCache, every one with textureArrays
+	ModelLoadStats stats;
+};
+
+// Materials RenderBatched draws together: their maps share one TextureArray per texture, a material's layer
+// is the same in each of them, and their meshes one index range of the batched mesh.
+struct MaterialBatch
+{
+	std::vector<std::string> types;     // texture type of each array, e.g. texture_diffuse
+	std::vector<TextureArray> arrays;
+	std::vector<std::string> materials; // layer order
+	unsigned int indexOffset = 0;       // in the batched mesh's indices
+	unsigned int indexCount = 0;
+};
 
 class Model
 {
 public:
-	Model(const std::string& objFilePath) {
-		LoadOBJ(objFilePath);
+	// Loads and uploads synchronously. See AsyncModelLoader for loading in the background.
+	Model(const std::string& objFilePath, const ModelLoadOptions& loadOptions = ModelLoadOptions())
+		: options(loadOptions) {
+		BeginUpload(LoadData(objFilePath, loadOptions));
+		while (UploadNext()) {}
 	}
 
 	 // Draws the model using the provided shader.
@@ -45,115 +164,628 @@ public:
 	 //  - To draw the model using all available textures:
 	 //      model.draw(shader);
 	void Render(Shader& shader, const std::vector<std::string>& textureTypeToUse = {}) {
-		for (unsigned int i = 0; i < meshes.size(); i++) 
+		for (unsigned int i = 0; i < meshes.size(); i++)
 			meshes[i].Render(shader, textureTypeToUse);
 	}
-	
+
+	/**
+	 * Draws the model with one call per MaterialBatch, a single one when all its materials match (textureArrays only).
+	 * The arrays are bound as "texture_diffuse_arrayN", "texture_specular_arrayN", ... (sampler2DArray), and
+	 * the vertex shader reads the layer from the uint attribute at location 8.
+	 */
+	void RenderBatched(Shader& shader, const std::vector<std::string>& textureTypeToUse = {});
+
 	std::vector<Mesh>& GetMesh() { return this->meshes; }
 	const std::vector<Mesh>& GetMesh() const { return this->meshes; }
-private:
+	const ModelLoadStats& GetLoadStats() const { return this->loadStats; }
+	const std::vector<MaterialBatch>& GetBatches() const { return this->batches; }
+
 	/**
-	 * Loads an OBJ file and constructs meshes from it.
+	 * Does all the CPU work of loading an OBJ file: reads the MTL file and decodes its textures,
+	 * then parses the OBJ (or reads the mesh cache) into MeshData. Touches no OpenGL state,
+	 * so it may run on any thread.
 	 * Each 'o' line in the OBJ file starts a new mesh.
 	 * Faces within an object are grouped into a single mesh.
 	 *
 	 * @param objFilePath Path to the OBJ file.
 	 */
-	void LoadOBJ(const std::string& objPath);
+	static ModelData LoadData(const std::string& objFilePath, const ModelLoadOptions& options);
+
+private:
+	friend class AsyncModelLoader;
+
+	// For AsyncModelLoader, which uploads the data step by step
+	explicit Model(const ModelLoadOptions& loadOptions) : options(loadOptions) {}
+
+	// Takes over data for the following UploadNext calls.
+	void BeginUpload(ModelData&& data);
+
+	// Uploads one texture or one mesh of the pending data (GL thread only).
+	// Returns false once everything is uploaded.
+	bool UploadNext();
+
+	// Builds one MeshData per 'o' record from the parsed OBJ arrays.
+	// Corners sharing the same (v, vt, vn) triplet within a mesh share one vertex.
+	static void BuildMeshes(const ObjData& data, const ModelLoadOptions& options, ModelData& model);
+
+	// Runs the mesh optimizer on one mesh's arrays and accumulates its ACMR/ATVR statistics.
+	static void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, ModelLoadStats& stats);
+
+	// Decodes the texture files on a thread pool, skipping those already in TextureCache unless they go into texture arrays.
+	// model.images keeps the order of paths, so UploadNext uploads them in MTL order.
+	// With compressTextures set, missing .dds files are built first (on the same threads).
+	static void DecodeTextures(const std::vector<std::string>& paths, const ModelLoadOptions& options, ModelData& model);
+
+	// Groups the pending materials into batches by the type, size and format of their maps and creates the arrays
+	void PlanBatches();
+
+	// Merges the LOD0 triangles of all meshes into batchedMesh, batch by batch, and lets the meshes draw from it
+	// instead of their own buffers
+	void BuildBatchedMesh();
+
+	// Collects the per-mesh quantization error and LOD triangle counts into loadStats
+	void GatherMeshStats();
+	void PrintMeshStats() const;
+
+	// YMeshBuildFlags matching the options
+	static uint32_t CacheBuildFlags(const ModelLoadOptions& options) {
+		return (options.optimizeMeshes ? kYMeshOptimized : 0u) | (options.generateTangents ? kYMeshTangents : 0u) |
+			(options.lodLevels > 1 ? std::min(options.lodLevels, 255u) << kYMeshLodLevelsShift : 0u);
+	}
+
+	// Reads the meshes straight from an up-to-date .ymesh cache, returns false if there is none.
+	static bool LoadMeshCache(const std::string& cacheFilePath, const std::string& objFilePath,
+		const ModelLoadOptions& options, ModelData& model);
+
+	// Writes the meshes to the .ymesh cache, source is the mapped .obj they were built from.
+	static void SaveMeshCache(const std::string& cacheFilePath, const std::string& objFilePath, const MappedFile& source,
+		const ModelLoadOptions& options, const ModelData& model);
 
 	/**
 	 * Loads material properties from an MTL file and maps them to texture objects.
 	 * This mapping aids in assigning materials to faces in the OBJ file.
+	 * The textures are only named here, DecodeTextures and UploadNext fill in their ids.
 	 *
 	 * @param mtlFilePath Path to the MTL file.
+	 * @param texturePaths Receives every distinct map_* path, in file order.
 	 * @return A map from material names to their corresponding textures.
 	 */
-	std::unordered_map<std::string, std::vector<Texture>> LoadMTL(const std::string& mtlFilePath);
+	static std::unordered_map<std::string, std::vector<Texture>> LoadMTL(const std::string& mtlFilePath,
+		std::vector<std::string>& texturePaths);
 
 private:
 	//std::vector<Mesh>* meshes;
 	std::vector<Mesh>meshes;;
+	ModelLoadOptions options;
+	ModelLoadStats loadStats;
+
+	// Upload state, see BeginUpload/UploadNext
+	ModelData pending;
+	size_t uploadedImages = 0;
+	size_t uploadedMeshes = 0;
+	std::unordered_map<std::string, TextureHandle> textureHandles; // path -> cached texture
+
+	// textureArrays state, see PlanBatches
+	struct MaterialLayer
+	{
+		size_t batch = 0;
+		int layer = 0;
+		std::vector<int> arrays; // per material texture, index into the batch's arrays or -1 if it has no data
+	};
+	std::unordered_map<std::string, MaterialLayer> materialLayers; // material name -> layer
+	std::vector<MaterialBatch> batches;
+	std::unique_ptr<Mesh> batchedMesh;
 };
 
-void Model::LoadOBJ(const std::string& objFilePath)
+ModelData Model::LoadData(const std::string& objFilePath, const ModelLoadOptions& options)
 {
 	std::string baseName = objFilePath.substr(0, objFilePath.find_last_of("."));
 	std::string mtlFilePath = baseName + ".mtl";
 
-	std::unordered_map<std::string, std::vector<Texture>> materialTextures = LoadMTL(mtlFilePath);
+	std::string cacheFilePath = baseName + ".ymesh";
 
-	std::ifstream file(objFilePath);
-	if (!file.is_open()) {
+	ModelData model;
+	ModelLoadStats& loadStats = model.stats;
+	std::vector<std::string> texturePaths;
+	model.materials = LoadMTL(mtlFilePath, texturePaths);
+	DecodeTextures(texturePaths, options, model);
+
+	Timer timer;
+	timer.start();
+
+	if (options.useMeshCache && LoadMeshCache(cacheFilePath, objFilePath, options, model)) {
+		loadStats.fromCache = true;
+		loadStats.totalMicroseconds = timer.elapsedMicroseconds();
+#ifdef _DEBUG
+		std::cout << "Load model success!\n";
+		std::cout << "  " << objFilePath << ": " << model.meshes.size() << " meshes from " << cacheFilePath << " in "
+			<< loadStats.totalMicroseconds / 1000.0 << " ms\n";
+#endif
+		return model;
+	}
+
+	MappedFile file(objFilePath);
+	if (!file.IsOpen()) {
 		throw std::runtime_error("Could not open OBJ file: " + objFilePath);
 	}
 
-	std::vector<glm::vec3> positions;
-	std::vector<glm::vec3> normals;
-	std::vector<glm::vec2> texCoords;
-	std::vector<Vertex> vertices;
-	std::vector<unsigned int> indices;
-	std::vector<Texture> textures;
+	ObjData data;
+	loadStats.parseThreads = ParseOBJParallel(file.Data(), file.Data() + file.Size(), data, options.parseThreads);
+	loadStats.fileBytes = file.Size();
+	loadStats.parseMicroseconds = timer.elapsedMicroseconds();
 
-	std::string line;
-	while (getline(file, line)) {
-		std::stringstream ss(line);
-		std::string prefix;
-		ss >> prefix;
-		if (prefix == "o") {
-			if (!vertices.empty()) {
-				meshes.emplace_back(Mesh(vertices, indices, textures));
-				vertices.clear();
-				indices.clear();
-				textures.clear();
+	BuildMeshes(data, options, model);
+	loadStats.totalMicroseconds = timer.elapsedMicroseconds();
+
+	if (options.useMeshCache)
+		SaveMeshCache(cacheFilePath, objFilePath, file, options, model);
+
+#ifdef _DEBUG
+	std::cout << "Load model success!\n";
+	std::cout << "  " << objFilePath << ": " << loadStats.fileBytes / (1024.0 * 1024.0) << " MB parsed in "
+		<< loadStats.parseMicroseconds / 1000.0 << " ms (" << loadStats.ParseBytesPerSecond() / (1024.0 * 1024.0)
+		<< " MB/s, " << loadStats.parseThreads << " threads), " << loadStats.totalMicroseconds / 1000.0 << " ms total\n";
+	std::cout << "  " << loadStats.uniqueVertices << " unique / " << loadStats.referencedVertices
+		<< " referenced vertices, " << loadStats.VertexBytesSaved() / 1024.0 << " KB vertex data saved\n";
+	if (options.optimizeMeshes) {
+		std::cout << "  ACMR " << loadStats.vertexCacheBefore.ACMR() << " -> " << loadStats.vertexCacheAfter.ACMR()
+			<< ", ATVR " << loadStats.vertexCacheBefore.ATVR() << " -> " << loadStats.vertexCacheAfter.ATVR() << "\n";
+	}
+#endif
+	return model;
+}
+
+void Model::BeginUpload(ModelData&& data)
+{
+	pending = std::move(data);
+	loadStats = pending.stats;
+	uploadedImages = 0;
+	uploadedMeshes = 0;
+	textureHandles.clear();
+	meshes.reserve(pending.meshes.size());
+	if (options.textureArrays)
+		PlanBatches();
+}
+
+bool Model::UploadNext()
+{
+	Timer timer;
+	timer.start();
+
+	if (uploadedImages < pending.images.size()) {
+		TextureImage& image = pending.images[uploadedImages++];
+		if (options.textureArrays) {
+			// Into the layer of every material using it
+			for (auto& entry : materialLayers) {
+				const std::vector<Texture>& textures = pending.materials[entry.first];
+				for (size_t i = 0; i < textures.size(); i++) {
+					if (entry.second.arrays[i] >= 0 && textures[i].filepath == image.path)
+						batches[entry.second.batch].arrays[entry.second.arrays[i]].SetLayer(entry.second.layer, image);
+				}
 			}
 		}
-		else if (prefix == "v") {
-			glm::vec3 position;
-			ss >> position.x >> position.y >> position.z;
-			positions.push_back(position);
+		else {
+			TextureHandle& handle = textureHandles[image.path];
+			// A file that failed to decode stays unbound instead of being retried for every mesh
+			if (image.HasData())
+				handle = options.streamTextures ? TextureCache::Instance().Stream(std::move(image)) : TextureCache::Instance().Load(image);
 		}
-		else if (prefix == "vt") {
-			glm::vec2 texCoord;
-			ss >> texCoord.x >> texCoord.y;
-			texCoords.emplace_back(texCoord.x, 1.0f - texCoord.y); // Flip the v coordinate
+		image.FreePixels();
+	}
+	else if (uploadedMeshes < pending.meshes.size()) {
+		MeshData& data = pending.meshes[uploadedMeshes++];
+		std::vector<Texture> textures;
+		if (options.textureArrays) {
+			// Views of the material's layers, a map without data stays unbound
+			textures = pending.materials[data.material];
+			const MaterialLayer& material = materialLayers[data.material];
+			for (size_t i = 0; i < textures.size(); i++) {
+				MaterialBatch& batch = batches[material.batch];
+				textures[i].id = material.arrays[i] >= 0 ? batch.arrays[material.arrays[i]].View(material.layer) : 0;
+			}
 		}
-		else if (prefix == "vn") {
-			glm::vec3 normal;
-			ss >> normal.x >> normal.y >> normal.z;
-			normals.push_back(normal);
+		else if (!data.material.empty()) {
+			textures = pending.materials[data.material];
+			for (Texture& texture : textures) {
+				// Files skipped by DecodeTextures were resident already, Load finds them by path; a .dds written since
+				// the MTL was read is what the cache holds, loading the image would upload a second, uncompressed copy
+				auto it = textureHandles.find(texture.filepath);
+				if (it == textureHandles.end()) {
+					TextureHandle handle = TextureCache::Instance().Load(PreferCompressedTexture(texture.filepath));
+					it = textureHandles.emplace(texture.filepath, std::move(handle)).first;
+				}
+				texture.handle = it->second;
+				texture.id = texture.handle.Id();
+			}
 		}
-		else if (prefix == "usemtl") {
-			std::string materialName;
-			ss >> materialName;
-			textures = materialTextures[materialName];
+		meshes.emplace_back(Mesh(std::move(data.vertices), std::move(data.indices), textures, options.quantizeVertices,
+			std::move(data.tangents)));
+		meshes.back().lods = std::move(data.lods);
+	}
+
+	loadStats.uploadMicroseconds += timer.elapsedMicroseconds();
+
+	if (uploadedImages < pending.images.size() || uploadedMeshes < pending.meshes.size())
+		return true;
+
+	if (options.textureArrays) {
+		Timer batchTimer;
+		batchTimer.start();
+		BuildBatchedMesh();
+		loadStats.uploadMicroseconds += batchTimer.elapsedMicroseconds();
+	}
+	pending = ModelData();
+	materialLayers.clear();
+	textureHandles.clear();
+	GatherMeshStats();
+#ifdef _DEBUG
+	std::cout << "  uploaded " << meshes.size() << " meshes in " << loadStats.uploadMicroseconds / 1000.0 << " ms\n";
+	if (options.textureArrays) {
+		size_t arrayCount = 0, arrayBytes = 0;
+		for (const MaterialBatch& batch : batches) {
+			arrayCount += batch.arrays.size();
+			for (const TextureArray& array : batch.arrays)
+				arrayBytes += array.Bytes();
 		}
-		else if (prefix == "f") {
-			for (int i = 0; i < 3; i++) {
-				unsigned int vIdx, vtIdx, vnIdx;
-				char slash;
-				ss >> vIdx >> slash >> vtIdx >> slash >> vnIdx;
-				vIdx--; vtIdx--; vnIdx--;
-				Vertex vertex = {
-					positions[vIdx], // Position
-					normals[vnIdx], // Normal
-					texCoords[vtIdx] // Texture Coordinate
-				};
-				vertices.push_back(vertex);
-				indices.push_back(static_cast<unsigned int>(vertices.size() - 1));
+		std::cout << "  batched into " << batches.size() << " draws, " << arrayCount << " texture arrays ("
+			<< arrayBytes / (1024.0 * 1024.0) << " MB)\n";
+	}
+	PrintMeshStats();
+	TextureCache::Instance().PrintStats();
+#endif
+	return false;
+}
+
+void Model::RenderBatched(Shader& shader, const std::vector<std::string>& textureTypeToUse)
+{
+	if (!batchedMesh)
+		return;
+
+	batchedMesh->SetVertexFormatUniforms(shader);
+	glBindVertexArray(batchedMesh->GetVAO());
+	for (const MaterialBatch& batch : batches) {
+		// Numbered per type like Mesh::Render, starting from texture_diffuse_array1
+		for (size_t i = 0; i < batch.arrays.size(); i++) {
+			const std::string& type = batch.types[i];
+			if (!textureTypeToUse.empty() &&
+				std::find(textureTypeToUse.begin(), textureTypeToUse.end(), type) == textureTypeToUse.end()) {
+				continue;
+			}
+			size_t number = 1 + std::count(batch.types.begin(), batch.types.begin() + i, type);
+			char uniformName[64];
+			glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
+			shader.SetInt(NumberedUniformName(uniformName, sizeof(uniformName), type, "_array", number), static_cast<int>(i));
+			glBindTexture(GL_TEXTURE_2D_ARRAY, batch.arrays[i].Id());
+		}
+		glDrawElements(GL_TRIANGLES, (GLsizei)batch.indexCount, GL_UNSIGNED_INT, (void*)(batch.indexOffset * sizeof(unsigned int)));
+	}
+	glBindVertexArray(0);
+}
+
+void Model::PlanBatches()
+{
+	batches.clear();
+	materialLayers.clear();
+
+	std::unordered_map<std::string, const TextureImage*> images; // MTL path -> decoded file
+	for (const TextureImage& image : pending.images)
+		images[image.path] = &image;
+
+	// (type, format) of every map with data, in material order; materials with equal ones share a batch
+	typedef std::vector<std::pair<std::string, TextureArrayFormat>> Signature;
+	std::vector<Signature> signatures;
+	for (const MeshData& mesh : pending.meshes) {
+		if (materialLayers.count(mesh.material))
+			continue;
+
+		MaterialLayer material;
+		Signature signature;
+		for (const Texture& texture : pending.materials[mesh.material]) {
+			auto it = images.find(texture.filepath);
+			TextureArrayFormat format;
+			if (it != images.end() && DescribeTextureImage(*it->second, format)) {
+				material.arrays.push_back(static_cast<int>(signature.size()));
+				signature.emplace_back(texture.type, format);
+			}
+			else {
+				material.arrays.push_back(-1);
+			}
+		}
+
+		material.batch = std::find(signatures.begin(), signatures.end(), signature) - signatures.begin();
+		if (material.batch == signatures.size()) {
+			signatures.push_back(signature);
+			batches.emplace_back();
+		}
+		MaterialBatch& batch = batches[material.batch];
+		material.layer = static_cast<int>(batch.materials.size());
+		batch.materials.push_back(mesh.material);
+		materialLayers[mesh.material] = std::move(material);
+	}
+
+	for (size_t i = 0; i < batches.size(); i++) {
+		MaterialBatch& batch = batches[i];
+		for (const auto& map : signatures[i]) {
+			batch.types.push_back(map.first);
+			batch.arrays.emplace_back(map.second, static_cast<int>(batch.materials.size()));
+		}
+	}
+}
+
+void Model::BuildBatchedMesh()
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec4> tangents;
+	std::vector<uint16_t> layers;
+	std::vector<unsigned int> meshIndexOffsets(meshes.size(), 0);
+	bool hasTangents = std::all_of(meshes.begin(), meshes.end(), [](const Mesh& mesh) { return mesh.HasTangents(); });
+
+	for (size_t b = 0; b < batches.size(); b++) {
+		MaterialBatch& batch = batches[b];
+		batch.indexOffset = static_cast<unsigned int>(indices.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const MaterialLayer& material = materialLayers[pending.meshes[i].material];
+			if (material.batch != b)
+				continue;
+
+			const Mesh& mesh = meshes[i];
+			unsigned int baseVertex = static_cast<unsigned int>(vertices.size());
+			MeshLod lod = mesh.GetLod(0);
+			meshIndexOffsets[i] = static_cast<unsigned int>(indices.size());
+			for (unsigned int k = 0; k < lod.indexCount; k++)
+				indices.push_back(baseVertex + mesh.indices[lod.indexOffset + k]);
+			vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+			if (hasTangents)
+				tangents.insert(tangents.end(), mesh.tangents.begin(), mesh.tangents.end());
+			layers.insert(layers.end(), mesh.vertices.size(), static_cast<uint16_t>(material.layer));
+		}
+		batch.indexCount = static_cast<unsigned int>(indices.size()) - batch.indexOffset;
+	}
+
+	if (vertices.empty())
+		return;
+	batchedMesh.reset(new Mesh(std::move(vertices), std::move(indices), {}, options.quantizeVertices,
+		std::move(tangents), std::move(layers)));
+	// Render draws every mesh from its range of the batched buffers, so the geometry is on the GPU only once
+	for (size_t i = 0; i < meshes.size(); i++)
+		meshes[i].ShareBuffers(*batchedMesh, meshIndexOffsets[i]);
+}
+
+void Model::BuildMeshes(const ObjData& data, const ModelLoadOptions& options, ModelData& model)
+{
+	ModelLoadStats& loadStats = model.stats;
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::string material;
+
+	ObjIndexTable vertexTable;
+	vertexTable.Reset(data.positions.size());
+
+	auto flushMesh = [&]() {
+		loadStats.uniqueVertices += vertices.size();
+		if (options.optimizeMeshes)
+			OptimizeMesh(vertices, indices, loadStats);
+		MeshData mesh;
+		if (options.lodLevels > 1)
+			GenerateLodChain(vertices, indices, options.lodLevels, mesh.lods);
+		if (options.generateTangents)
+			GenerateTangents(vertices, indices.data(), mesh.lods.empty() ? indices.size() : mesh.lods[0].indexCount, mesh.tangents);
+		mesh.vertices = std::move(vertices);
+		mesh.indices = std::move(indices);
+		mesh.material = material;
+		model.meshes.push_back(std::move(mesh));
+		vertices.clear();
+		indices.clear();
+		material.clear();
+		vertexTable.Reset(0); // grows on demand, objects are usually much smaller than the file
+	};
+
+	size_t eventIdx = 0;
+	for (size_t i = 0; i <= data.corners.size(); i++) {
+		// Apply the 'o' / 'usemtl' records that precede this corner
+		for (; eventIdx < data.events.size() && data.events[eventIdx].corner == i; eventIdx++) {
+			const ObjEvent& event = data.events[eventIdx];
+			if (event.type == ObjEvent::Object) {
+				if (!vertices.empty())
+					flushMesh();
 			}
+			else {
+				material = event.name;
+			}
+		}
+		if (i == data.corners.size())
+			break;
+
+		const ObjIndex& corner = data.corners[i];
+		bool inserted = false;
+		unsigned int index = vertexTable.FindOrInsert(corner, static_cast<unsigned int>(vertices.size()), inserted);
+		if (inserted) {
+			Vertex vertex = {
+				(size_t)corner.v < data.positions.size() ? data.positions[corner.v] : glm::vec3(0.0f), // Position
+				(size_t)corner.vn < data.normals.size() ? data.normals[corner.vn] : glm::vec3(0.0f), // Normal
+				(size_t)corner.vt < data.texCoords.size() ? data.texCoords[corner.vt] : glm::vec2(0.0f) // Texture Coordinate
+			};
+			vertices.push_back(vertex);
+		}
+		indices.push_back(index);
+	}
+
+	if (!vertices.empty())
+		flushMesh();
+
+	loadStats.referencedVertices = data.corners.size();
+}
+
+void Model::OptimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, ModelLoadStats& loadStats)
+{
+	VertexCacheStats before = AnalyzeVertexCache(indices, vertices.size());
+
+	OptimizeVertexCache(indices, vertices.size());
+	OptimizeOverdraw(indices, vertices);
+	OptimizeVertexFetch(vertices, indices);
+
+	VertexCacheStats after = AnalyzeVertexCache(indices, vertices.size());
+
+	loadStats.vertexCacheBefore.triangles += before.triangles;
+	loadStats.vertexCacheBefore.vertices += before.vertices;
+	loadStats.vertexCacheBefore.transformed += before.transformed;
+	loadStats.vertexCacheAfter.triangles += after.triangles;
+	loadStats.vertexCacheAfter.vertices += after.vertices;
+	loadStats.vertexCacheAfter.transformed += after.transformed;
+}
+
+void Model::DecodeTextures(const std::vector<std::string>& paths, const ModelLoadOptions& options, ModelData& model)
+{
+	for (const std::string& path : paths) {
+		// Texture arrays are built from the files, resident 2D textures are no use to them. The cache keys a compressed
+		// texture by its .dds, which may have been written after the MTL named the image
+		if (options.textureArrays || !TextureCache::Instance().Contains(PreferCompressedTexture(path))) {
+			model.images.emplace_back();
+			model.images.back().path = path;
 		}
 	}
+	if (model.images.empty())
+		return;
+
+	ModelLoadStats& loadStats = model.stats;
+	Timer timer;
+	timer.start();
+
+	const bool compress = options.compressTextures;
+	unsigned int threadCount = options.textureThreads;
+	if (threadCount == 0)
+		threadCount = ThreadPool::HardwareThreads();
+	threadCount = std::min(threadCount, static_cast<unsigned int>(model.images.size()));
+	{
+		// Each task writes only its own image, nothing else is shared
+		ThreadPool pool(threadCount);
+		std::vector<std::future<void>> results;
+		results.reserve(model.images.size());
+		for (TextureImage& image : model.images) {
+			results.push_back(pool.Submit([&image, compress]() {
+				// Keep the MTL path, UploadNext looks the texture up by it
+				Timer taskTimer;
+				taskTimer.start();
+				std::string path = image.path;
+				DecodeTexture(compress ? PreferCompressedTexture(path, true) : path, image);
+				image.path = path;
+				image.decodeMicroseconds = taskTimer.elapsedMicroseconds(); // including the .dds build
+			}));
+		}
+		for (std::future<void>& result : results)
+			result.get();
+	}
 
-	if (!vertices.empty()) {
-		meshes.emplace_back(Mesh(vertices, indices, textures));
+	loadStats.textureCount = model.images.size();
+	loadStats.textureThreads = threadCount;
+	loadStats.textureMicroseconds = timer.elapsedMicroseconds();
+	for (const TextureImage& image : model.images) {
+		loadStats.textureDecodeMicroseconds += image.decodeMicroseconds;
+		if (image.IsCompressed())
+			loadStats.textureBytes += image.compressed.data.size();
+		else if (image.pixels)
+			loadStats.textureBytes += static_cast<size_t>(image.width) * image.height * image.components;
 	}
 
 #ifdef _DEBUG
-	std::cout << "Load model success!\n";
+	std::cout << "  " << loadStats.textureCount << " textures (" << loadStats.textureBytes / (1024.0 * 1024.0)
+		<< " MB) decoded in " << loadStats.textureMicroseconds / 1000.0 << " ms on " << loadStats.textureThreads
+		<< " threads, " << loadStats.textureDecodeMicroseconds / 1000.0 << " ms summed\n";
+	for (const TextureImage& image : model.images) {
+		std::cout << "    " << image.path << ": " << image.width << "x" << image.height << "x" << image.components
+			<< " in " << image.decodeMicroseconds / 1000.0 << " ms\n";
+	}
 #endif
 }
 
-std::unordered_map<std::string, std::vector<Texture>> Model::LoadMTL(const std::string& mtlFilePath) 
+void Model::GatherMeshStats()
+{
+	QuantizationError& total = loadStats.quantizationError;
+	for (const Mesh& mesh : meshes) {
+		const QuantizationError& error = mesh.GetQuantizationError();
+		total.maxPosition = std::max(total.maxPosition, error.maxPosition);
+		total.maxNormalDegrees = std::max(total.maxNormalDegrees, error.maxNormalDegrees);
+		total.maxTexCoord = std::max(total.maxTexCoord, error.maxTexCoord);
+
+		if (loadStats.lodTriangles.size() < mesh.GetLodCount())
+			loadStats.lodTriangles.resize(mesh.GetLodCount(), 0);
+		for (size_t i = 0; i < mesh.GetLodCount(); i++)
+			loadStats.lodTriangles[i] += mesh.GetLod(i).indexCount / 3;
+	}
+}
+
+void Model::PrintMeshStats() const
+{
+	if (loadStats.lodTriangles.size() > 1) {
+		std::cout << "  LOD triangles:";
+		for (size_t triangles : loadStats.lodTriangles)
+			std::cout << " " << triangles;
+		std::cout << "\n";
+	}
+
+	if (!options.quantizeVertices)
+		return;
+
+	size_t vertexCount = 0;
+	for (const Mesh& mesh : meshes)
+		vertexCount += mesh.vertices.size();
+
+	std::cout << "  quantized vertices: " << vertexCount * sizeof(QuantizedVertex) / 1024.0 << " KB instead of "
+		<< vertexCount * sizeof(Vertex) / 1024.0 << " KB, max error: position " << loadStats.quantizationError.maxPosition
+		<< ", normal " << loadStats.quantizationError.maxNormalDegrees << " deg, uv " << loadStats.quantizationError.maxTexCoord << "\n";
+}
+
+bool Model::LoadMeshCache(const std::string& cacheFilePath, const std::string& objFilePath,
+	const ModelLoadOptions& options, ModelData& model)
+{
+	MappedFile cache;
+	std::vector<YMeshView> views;
+	if (!OpenMeshCache(cacheFilePath, objFilePath, CacheBuildFlags(options), cache, views))
+		return false;
+
+	for (const YMeshView& view : views) {
+		MeshData mesh;
+		mesh.vertices.assign(view.vertices, view.vertices + view.vertexCount);
+		mesh.indices.assign(view.indices, view.indices + view.indexCount);
+		mesh.tangents.assign(view.tangents, view.tangents + view.tangentCount);
+		mesh.lods.assign(view.lods, view.lods + view.lodCount);
+		mesh.material = view.material;
+		model.stats.uniqueVertices += view.vertexCount;
+		model.stats.referencedVertices += view.lodCount ? view.lods[0].indexCount : view.indexCount;
+		model.meshes.push_back(std::move(mesh));
+	}
+	return true;
+}
+
+void Model::SaveMeshCache(const std::string& cacheFilePath, const std::string& objFilePath, const MappedFile& source,
+	const ModelLoadOptions& options, const ModelData& model)
+{
+	YMeshSourceInfo info;
+	if (!StatMeshSource(objFilePath, info))
+		return;
+	info.hash = HashBytes(source.Data(), source.Size());
+
+	std::vector<YMeshView> views(model.meshes.size());
+	for (size_t i = 0; i < model.meshes.size(); i++) {
+		const MeshData& mesh = model.meshes[i];
+		views[i].vertices = mesh.vertices.data();
+		views[i].vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		views[i].indices = mesh.indices.data();
+		views[i].indexCount = static_cast<uint32_t>(mesh.indices.size());
+		views[i].lods = mesh.lods.data();
+		views[i].lodCount = static_cast<uint32_t>(mesh.lods.size());
+		views[i].tangents = mesh.tangents.data();
+		views[i].tangentCount = static_cast<uint32_t>(mesh.tangents.size());
+		views[i].material = mesh.material;
+	}
+
+	if (!WriteMeshCache(cacheFilePath, info, CacheBuildFlags(options), views))
+		std::cerr << "Failed to write mesh cache: " << cacheFilePath << std::endl;
+}
+
+std::unordered_map<std::string, std::vector<Texture>> Model::LoadMTL(const std::string& mtlFilePath,
+	std::vector<std::string>& texturePaths)
 {
 	std::unordered_map<std::string, std::vector<Texture>> materials;
 	std::ifstream file(mtlFilePath);
@@ -183,8 +815,9 @@ std::unordered_map<std::string, std::vector<Texture>> Model::LoadMTL(const std::
 			Texture texture;
 			std::string filepath;
 			ss >> filepath;
-			// Construct full path by appending directory to the texture filename
-			filepath = directory + filepath;
+			// Construct full path by appending directory to the texture filename,
+			// an up to date block compressed .dds replaces the image
+			filepath = PreferCompressedTexture(directory + filepath);
             // Map the MTL file keys to standard texture types
             if (key == "map_Ka") {
                 texture.type = "texture_ambient";
@@ -196,8 +829,10 @@ std::unordered_map<std::string, std::vector<Texture>> Model::LoadMTL(const std::
 				texture.type = "texture_height";
 			}
 			texture.filepath = filepath;
-			texture.id = LoadTexture(filepath); // Load texture and get ID
+			texture.id = 0; // decoded by DecodeTextures, uploaded by UploadNext
 			currentTextures.push_back(texture);
+			if (std::find(texturePaths.begin(), texturePaths.end(), filepath) == texturePaths.end())
+				texturePaths.push_back(filepath);
 		}
 	}
 
@@ -208,56 +843,4 @@ std::unordered_map<std::string, std::vector<Texture>> Model::LoadMTL(const std::
 	return materials;
 }
 
-static unsigned int LoadTexture(const std::string& path, bool isHDR)
-{
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	void* data;
-
-	// Using stbi_load or stbi_loadf for different texture type
-	if (!isHDR) {
-		data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-	}
-	else {
-		stbi_set_flip_vertically_on_load(true);
-		data = stbi_loadf(path.c_str(), &width, &height, &nrComponents, 0);
-	}
-
-	if (data) {
-		GLenum format;
-		GLenum dataType = (isHDR) ? GL_FLOAT : GL_UNSIGNED_BYTE; // Set GL_FLOAT or GL_UNSIGNED_BYTE for different texture data type
-		GLint internalFormat; // Using 16-bit float format for HDR, otherwise internalFormat equals to format
-
-		if (nrComponents == 1) format = internalFormat = GL_RED;
-		else if (nrComponents == 3) format = internalFormat = GL_RGB;
-		else if (nrComponents == 4) format = internalFormat = GL_RGBA;
-		else std::cerr << "Invalid texture format: Unsupported number of components!\n";
-
-		if (isHDR) internalFormat = GL_RGB16F;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, dataType, data);
-		if (!isHDR)
-			glGenerateMipmap(GL_TEXTURE_2D);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		if (!isHDR)
-			stbi_image_free(data);
-		else
-			stbi_image_free((float*)data);
-	}
-	else {
-		std::cerr << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-		return -1;
-	}
-
-	return textureID;
-}
-
 #endif // !MODEL_H
\ No newline at end of file
@@ -0,0 +1,435 @@
+// Pointer-based tokenizer for Wavefront OBJ text.
+// Works directly on a [begin, end) byte range (usually a MappedFile), parses numbers
+// with std::from_chars (locale independent) and does not allocate per line.
+// Only 'o', 'usemtl', 'v', 'vt', 'vn' and 'f' records are interpreted, others are skipped.
+//
+// Faces are fan-triangulated, each corner referring to the position/texcoord/normal
+// arrays by a 0-based index (-1 when the corner does not specify that attribute).
+
+#pragma once
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "thread_pool.h"
+
+// Files are split into at most one chunk per this many bytes, smaller files are parsed serially
+constexpr size_t kMinParseChunkBytes = 1 << 20;
+
+// One face corner, indices are 0-based into ObjData arrays, -1 if absent
+struct ObjIndex
+{
+	int v = -1;
+	int vt = -1;
+	int vn = -1;
+};
+
+// 'o' and 'usemtl' records, positioned by the first corner that follows them
+struct ObjEvent
+{
+	enum Type { Object, Material };
+
+	Type type;
+	size_t corner; // index into ObjData::corners
+	std::string name;
+};
+
+struct ObjData
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> texCoords;
+	std::vector<ObjIndex> corners; // three per triangle
+	std::vector<ObjEvent> events;  // sorted by corner
+
+	// Set when data holds one chunk of a larger file (see ParseOBJParallel). Negative OBJ indices
+	// are then resolved against this chunk's counts and listed in relativeFixups
+	// (as corner * 3 + attribute) so MergeOBJChunks can rebase them.
+	bool chunkLocal = false;
+	std::vector<size_t> relativeFixups;
+};
+
+namespace obj_tokenizer {
+
+	inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p))
+			++p;
+		return p;
+	}
+
+	inline const char* SkipToken(const char* p, const char* end)
+	{
+		while (p < end && !IsSpace(*p))
+			++p;
+		return p;
+	}
+
+	// Returns a pointer to the '\n' terminating the line starting at p, or end
+	inline const char* FindLineEnd(const char* p, const char* end)
+	{
+		const void* nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+		return nl ? static_cast<const char*>(nl) : end;
+	}
+
+	inline bool TokenEquals(const char* begin, const char* end, const char* keyword)
+	{
+		size_t length = std::strlen(keyword);
+		return static_cast<size_t>(end - begin) == length && std::memcmp(begin, keyword, length) == 0;
+	}
+
+	// Parses one float, leaves value untouched on malformed input.
+	// std::from_chars does not accept a leading '+', which some exporters write.
+	inline const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		p = SkipSpaces(p, end);
+		if (p < end && *p == '+')
+			++p;
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc())
+			return SkipToken(p, end);
+		return result.ptr;
+	}
+
+	inline const char* ParseInt(const char* p, const char* end, int& value, bool& ok)
+	{
+		if (p < end && *p == '+')
+			++p;
+		auto result = std::from_chars(p, end, value);
+		ok = result.ec == std::errc();
+		return ok ? result.ptr : p;
+	}
+
+	// Converts a 1-based (or negative, relative) OBJ index into a 0-based one
+	inline int ResolveIndex(int index, size_t count)
+	{
+		if (index > 0)
+			return index - 1;
+		if (index < 0)
+			return static_cast<int>(count) + index;
+		return -1;
+	}
+
+	// Parses one "v", "v/vt", "v//vn" or "v/vt/vn" corner.
+	// Returns false if the position index is missing; relativeMask gets bit 0/1/2 set for
+	// a negative v/vt/vn index (resolved against the counts parsed so far).
+	inline bool ParseCorner(const char*& p, const char* end, const ObjData& data, ObjIndex& corner, int& relativeMask)
+	{
+		int value = 0;
+		bool ok = false;
+		relativeMask = 0;
+		p = ParseInt(p, end, value, ok);
+		if (!ok || value == 0) {
+			p = SkipToken(p, end);
+			return false;
+		}
+		corner.v = ResolveIndex(value, data.positions.size());
+		relativeMask |= (value < 0) ? 1 : 0;
+
+		if (p < end && *p == '/') {
+			++p;
+			if (p < end && *p != '/') {
+				p = ParseInt(p, end, value, ok);
+				if (ok && value != 0) {
+					corner.vt = ResolveIndex(value, data.texCoords.size());
+					relativeMask |= (value < 0) ? 2 : 0;
+				}
+			}
+			if (p < end && *p == '/') {
+				++p;
+				p = ParseInt(p, end, value, ok);
+				if (ok && value != 0) {
+					corner.vn = ResolveIndex(value, data.normals.size());
+					relativeMask |= (value < 0) ? 4 : 0;
+				}
+			}
+		}
+		p = SkipToken(p, end);
+		return true;
+	}
+
+	inline void PushCorner(ObjData& data, const ObjIndex& corner, int relativeMask)
+	{
+		if (data.chunkLocal && relativeMask) {
+			for (int attribute = 0; attribute < 3; attribute++) {
+				if (relativeMask & (1 << attribute))
+					data.relativeFixups.push_back(data.corners.size() * 3 + attribute);
+			}
+		}
+		data.corners.push_back(corner);
+	}
+
+	inline void ParseFace(const char* p, const char* end, ObjData& data)
+	{
+		// Fan triangulation: (0, 1, 2), (0, 2, 3), ...
+		ObjIndex first, previous;
+		int firstMask = 0, previousMask = 0;
+		int count = 0;
+		p = SkipSpaces(p, end);
+		while (p < end) {
+			ObjIndex corner;
+			int mask = 0;
+			bool valid = ParseCorner(p, end, data, corner, mask);
+			p = SkipSpaces(p, end);
+			if (!valid)
+				continue;
+
+			if (count >= 2) {
+				PushCorner(data, first, firstMask);
+				PushCorner(data, previous, previousMask);
+				PushCorner(data, corner, mask);
+			}
+			if (count == 0) {
+				first = corner;
+				firstMask = mask;
+			}
+			previous = corner;
+			previousMask = mask;
+			count++;
+		}
+	}
+
+} // namespace obj_tokenizer
+
+// Open-addressing (linear probing) map from a (v, vt, vn) corner to the vertex built for it.
+// Used to emit each distinct corner once and reference it through the index buffer.
+class ObjIndexTable
+{
+public:
+	// Drops all entries and sizes the table for about expectedCount distinct corners
+	void Reset(size_t expectedCount)
+	{
+		size_t capacity = 16;
+		while (capacity < expectedCount * 2)
+			capacity <<= 1;
+		slots.assign(capacity, Slot());
+		count = 0;
+	}
+
+	// Returns the vertex stored for key, or stores and returns newVertex if key is not present yet
+	unsigned int FindOrInsert(const ObjIndex& key, unsigned int newVertex, bool& inserted)
+	{
+		if (slots.empty() || (count + 1) * 2 > slots.size())
+			Grow();
+
+		size_t mask = slots.size() - 1;
+		for (size_t i = Hash(key) & mask;; i = (i + 1) & mask) {
+			Slot& slot = slots[i];
+			if (slot.vertex == kEmpty) {
+				slot.key = key;
+				slot.vertex = newVertex;
+				count++;
+				inserted = true;
+				return newVertex;
+			}
+			if (slot.key.v == key.v && slot.key.vt == key.vt && slot.key.vn == key.vn) {
+				inserted = false;
+				return slot.vertex;
+			}
+		}
+	}
+
+	size_t Size() const { return count; }
+
+private:
+	static constexpr unsigned int kEmpty = 0xFFFFFFFFu;
+
+	struct Slot
+	{
+		ObjIndex key;
+		unsigned int vertex = kEmpty;
+	};
+
+	static size_t Hash(const ObjIndex& key)
+	{
+		// Combine the three indices and finish with a murmur3 style avalanche
+		unsigned int h = (unsigned int)key.v * 0x9E3779B1u;
+		h ^= (unsigned int)key.vt * 0x85EBCA77u + (h << 6) + (h >> 2);
+		h ^= (unsigned int)key.vn * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+		h ^= h >> 16; h *= 0x85EBCA6Bu;
+		h ^= h >> 13; h *= 0xC2B2AE35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	void Grow()
+	{
+		std::vector<Slot> old = std::move(slots);
+		slots.assign(old.empty() ? 16 : old.size() * 2, Slot());
+		size_t mask = slots.size() - 1;
+		for (const Slot& slot : old) {
+			if (slot.vertex == kEmpty)
+				continue;
+			size_t i = Hash(slot.key) & mask;
+			while (slots[i].vertex != kEmpty)
+				i = (i + 1) & mask;
+			slots[i] = slot;
+		}
+	}
+
+	std::vector<Slot> slots; // power-of-two sized
+	size_t count = 0;
+};
+
+/**
+ * Parses the OBJ text in [begin, end) and appends its records to data.
+ * Vertex data only allocates when the output arrays grow; 'o'/'usemtl' names are copied.
+ *
+ * @param begin First byte of the OBJ text.
+ * @param end One past the last byte of the OBJ text.
+ * @param data Output arrays, corners index into data's own attribute arrays.
+ */
+inline void ParseOBJ(const char* begin, const char* end, ObjData& data)
+{
+	using namespace obj_tokenizer;
+
+	const char* p = begin;
+	while (p < end) {
+		const char* lineEnd = FindLineEnd(p, end);
+		p = SkipSpaces(p, lineEnd);
+		const char* keyEnd = SkipToken(p, lineEnd);
+
+		if (TokenEquals(p, keyEnd, "v")) {
+			glm::vec3 position(0.0f);
+			const char* q = ParseFloat(keyEnd, lineEnd, position.x);
+			q = ParseFloat(q, lineEnd, position.y);
+			ParseFloat(q, lineEnd, position.z);
+			data.positions.push_back(position);
+		}
+		else if (TokenEquals(p, keyEnd, "vt")) {
+			glm::vec2 texCoord(0.0f);
+			const char* q = ParseFloat(keyEnd, lineEnd, texCoord.x);
+			ParseFloat(q, lineEnd, texCoord.y);
+			data.texCoords.emplace_back(texCoord.x, 1.0f - texCoord.y); // Flip the v coordinate
+		}
+		else if (TokenEquals(p, keyEnd, "vn")) {
+			glm::vec3 normal(0.0f);
+			const char* q = ParseFloat(keyEnd, lineEnd, normal.x);
+			q = ParseFloat(q, lineEnd, normal.y);
+			ParseFloat(q, lineEnd, normal.z);
+			data.normals.push_back(normal);
+		}
+		else if (TokenEquals(p, keyEnd, "f")) {
+			ParseFace(keyEnd, lineEnd, data);
+		}
+		else if (TokenEquals(p, keyEnd, "o") || TokenEquals(p, keyEnd, "usemtl")) {
+			const char* nameBegin = SkipSpaces(keyEnd, lineEnd);
+			const char* nameEnd = SkipToken(nameBegin, lineEnd);
+			ObjEvent::Type type = (*p == 'o') ? ObjEvent::Object : ObjEvent::Material;
+			data.events.push_back({ type, data.corners.size(), std::string(nameBegin, nameEnd) });
+		}
+
+		p = (lineEnd < end) ? lineEnd + 1 : end;
+	}
+}
+
+/**
+ * Appends chunks (parsed in file order with chunkLocal set) to data: attribute arrays are
+ * concatenated, relative face indices and event positions are rebased onto the merged arrays.
+ * The result is identical to parsing the whole range with ParseOBJ. Chunks are emptied.
+ */
+inline void MergeOBJChunks(std::vector<ObjData>& chunks, ObjData& data)
+{
+	size_t positionCount = data.positions.size(), normalCount = data.normals.size();
+	size_t texCoordCount = data.texCoords.size(), cornerCount = data.corners.size();
+	for (const ObjData& chunk : chunks) {
+		positionCount += chunk.positions.size();
+		normalCount += chunk.normals.size();
+		texCoordCount += chunk.texCoords.size();
+		cornerCount += chunk.corners.size();
+	}
+	data.positions.reserve(positionCount);
+	data.normals.reserve(normalCount);
+	data.texCoords.reserve(texCoordCount);
+	data.corners.reserve(cornerCount);
+
+	for (ObjData& chunk : chunks) {
+		const int bases[3] = {
+			static_cast<int>(data.positions.size()),
+			static_cast<int>(data.texCoords.size()),
+			static_cast<int>(data.normals.size())
+		};
+		const size_t cornerBase = data.corners.size();
+
+		data.positions.insert(data.positions.end(), chunk.positions.begin(), chunk.positions.end());
+		data.normals.insert(data.normals.end(), chunk.normals.begin(), chunk.normals.end());
+		data.texCoords.insert(data.texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+		data.corners.insert(data.corners.end(), chunk.corners.begin(), chunk.corners.end());
+
+		for (size_t fixup : chunk.relativeFixups) {
+			ObjIndex& corner = data.corners[cornerBase + fixup / 3];
+			int* members[3] = { &corner.v, &corner.vt, &corner.vn };
+			*members[fixup % 3] += bases[fixup % 3];
+		}
+
+		for (ObjEvent& event : chunk.events) {
+			event.corner += cornerBase;
+			data.events.push_back(std::move(event));
+		}
+
+		chunk = ObjData(); // release the chunk's memory early
+	}
+}
+
+/**
+ * Parses [begin, end) like ParseOBJ, but splits it into line-aligned chunks parsed on
+ * threadCount worker threads, then merges them in file order. Produces exactly the same
+ * ObjData as the serial parse. Falls back to ParseOBJ when threadCount is 1 or the
+ * range is smaller than two kMinParseChunkBytes chunks.
+ *
+ * @param threadCount Worker threads to use, 0 for one per hardware thread.
+ * @return the threads that parsed, 1 if it fell back to ParseOBJ.
+ */
+inline unsigned int ParseOBJParallel(const char* begin, const char* end, ObjData& data, unsigned int threadCount)
+{
+	if (threadCount == 0)
+		threadCount = ThreadPool::HardwareThreads();
+
+	const size_t size = static_cast<size_t>(end - begin);
+	const size_t chunkCount = std::min<size_t>(threadCount, size / kMinParseChunkBytes);
+	if (chunkCount <= 1) {
+		ParseOBJ(begin, end, data);
+		return 1;
+	}
+
+	// Chunk boundaries, each moved forward to the start of the next line
+	std::vector<const char*> bounds;
+	bounds.reserve(chunkCount + 1);
+	bounds.push_back(begin);
+	for (size_t i = 1; i < chunkCount; i++) {
+		const char* p = std::max(begin + size * i / chunkCount, bounds.back());
+		p = obj_tokenizer::FindLineEnd(p, end);
+		bounds.push_back(p < end ? p + 1 : end);
+	}
+	bounds.push_back(end);
+
+	std::vector<ObjData> chunks(chunkCount);
+	{
+		ThreadPool pool(static_cast<unsigned int>(chunkCount));
+		std::vector<std::future<void>> results;
+		results.reserve(chunkCount);
+		for (size_t i = 0; i < chunkCount; i++) {
+			chunks[i].chunkLocal = true;
+			results.push_back(pool.Submit([&chunks, &bounds, i]() {
+				ParseOBJ(bounds[i], bounds[i + 1], chunks[i]);
+			}));
+		}
+		for (std::future<void>& result : results)
+			result.get();
+	}
+
+	MergeOBJChunks(chunks, data);
+	return static_cast<unsigned int>(chunkCount);
+}
+
+#endif // !OBJ_PARSER_H
@@ -0,0 +1,216 @@
+// Binary program cache (.yprog): linked shader programs saved with glGetProgramBinary, one file per program,
+// and restored with glProgramBinary on later runs instead of compiling and linking the GLSL again.
+// A file is named after its key, a hash of the program's sources and the GL vendor, renderer and version
+// strings, so edited shaders and driver updates simply miss. A binary the driver rejects anyway falls back to
+// compiling, and the fresh binary replaces it. Drivers without a binary format (Mesa while its own shader disk
+// cache is disabled) save nothing, and every run compiles.
+//
+// Layout (native endianness):
+//   YProgramHeader
+//   binary[binarySize]
+//
+// Usage Example:
+// ProgramCache::Instance().SetDirectory("res/shaders/cache"); // before creating any Shader, "" disables it
+// Shader shader("vertexShaderPath", "fragmentShaderPath");     // restored from the cache from the second run on
+// ProgramCache::Instance().PrintStats();
+//
+// GL thread only.
+
+#pragma once
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <GL/gl3w.h>
+
+#include "mapped_file.h"
+
+constexpr uint32_t kYProgramMagic = 0x47525059; // "YPRG"
+constexpr uint32_t kYProgramVersion = 1;
+
+struct YProgramHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;          // ProgramCache::Key of the program
+	uint32_t binaryFormat; // from glGetProgramBinary
+	uint32_t binarySize;
+};
+
+struct ProgramCacheStats
+{
+	size_t restored = 0;              // programs loaded from a binary
+	size_t compiled = 0;              // programs compiled and linked from source
+	size_t rejected = 0;              // binaries the driver refused, compiled instead
+	size_t written = 0;               // binaries saved
+	long long restoreMicroseconds = 0;
+	long long compileMicroseconds = 0;
+};
+
+class ProgramCache
+{
+public:
+	static ProgramCache& Instance()
+	{
+		static ProgramCache instance;
+		return instance;
+	}
+
+	ProgramCache(const ProgramCache&) = delete;
+	ProgramCache& operator=(const ProgramCache&) = delete;
+
+	// Directory of the .yprog files, created on the first save; "" disables the cache
+	void SetDirectory(const std::string& path) { directory = path; }
+	bool IsEnabled() const { return !directory.empty(); }
+
+	// Hash of the program's stage sources (empty for missing stages) and the driver identity
+	static uint64_t Key(const std::vector<std::string>& sources);
+
+	/**
+	 * Restores program from the binary cached under key.
+	 *
+	 * @return true if the driver accepted the binary and the program is linked; false leaves it empty to be
+	 *         compiled as usual.
+	 */
+	bool Load(unsigned int program, uint64_t key);
+
+	// Saves the binary of linked program under key (set GL_PROGRAM_BINARY_RETRIEVABLE_HINT before linking)
+	bool Save(unsigned int program, uint64_t key);
+
+	// Time spent creating a program, restored from the cache or compiled
+	void Record(bool restored, long long microseconds);
+
+	const ProgramCacheStats& GetStats() const { return stats; }
+	void PrintStats() const;
+
+private:
+	ProgramCache() = default;
+
+	std::string PathOf(uint64_t key) const;
+
+private:
+	std::string directory;
+	ProgramCacheStats stats;
+};
+
+uint64_t ProgramCache::Key(const std::vector<std::string>& sources)
+{
+	std::string identity;
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const GLubyte* value = glGetString(name);
+		identity += value ? reinterpret_cast<const char*>(value) : "";
+		identity += '\n';
+	}
+	for (const std::string& source : sources) {
+		identity += source;
+		identity += '\0'; // a stage boundary, so moving text between stages changes the key
+	}
+	return HashBytes(identity.data(), identity.size());
+}
+
+bool ProgramCache::Load(unsigned int program, uint64_t key)
+{
+	MappedFile file;
+	if (!IsEnabled() || !file.Open(PathOf(key)) || file.Size() < sizeof(YProgramHeader))
+		return false;
+
+	YProgramHeader header;
+	std::memcpy(&header, file.Data(), sizeof(header));
+	if (header.magic != kYProgramMagic || header.version != kYProgramVersion || header.key != key ||
+		header.binarySize != file.Size() - sizeof(header)) {
+		return false;
+	}
+
+	glProgramBinary(program, header.binaryFormat, file.Data() + sizeof(header), static_cast<GLsizei>(header.binarySize));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		stats.rejected++;
+		return false;
+	}
+	return true;
+}
+
+bool ProgramCache::Save(unsigned int program, uint64_t key)
+{
+	GLint linked = GL_FALSE, length = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (!IsEnabled() || linked != GL_TRUE || length <= 0)
+		return false;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	if (length <= 0)
+		return false;
+
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+	const std::string path = PathOf(key);
+	const std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		YProgramHeader header = {};
+		header.magic = kYProgramMagic;
+		header.version = kYProgramVersion;
+		header.key = key;
+		header.binaryFormat = format;
+		header.binarySize = static_cast<uint32_t>(length);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), length);
+		file.close(); // flushes, so a full disk shows up here
+		if (!file) {
+			std::filesystem::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	stats.written++;
+	return true;
+}
+
+void ProgramCache::Record(bool restored, long long microseconds)
+{
+	if (restored) {
+		stats.restored++;
+		stats.restoreMicroseconds += microseconds;
+	}
+	else {
+		stats.compiled++;
+		stats.compileMicroseconds += microseconds;
+	}
+}
+
+void ProgramCache::PrintStats() const
+{
+	std::cout << "program cache" << (IsEnabled() ? "" : " (disabled)") << ": " << stats.restored << " programs restored in "
+		<< stats.restoreMicroseconds / 1000.0 << " ms, " << stats.compiled << " compiled in " << stats.compileMicroseconds / 1000.0
+		<< " ms, " << stats.rejected << " binaries rejected, " << stats.written << " written\n";
+}
+
+std::string ProgramCache::PathOf(uint64_t key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.yprog", static_cast<unsigned long long>(key));
+	return (std::filesystem::path(directory) / name).string();
+}
+
+#endif // !PROGRAM_CACHE_H
@@ -17,6 +17,7 @@
 #include <GLFW/glfw3.h>
 #include "camera.h"
 #include "config.h"
+#include "texture_cache.h"
 
 // A utility class holding window pointer & camera object
 // 
@@ -240,6 +241,13 @@ void SceneManager::key_callback(GLFWwindow* window, int key, int scancode, int a
 		if (key == GLFW_KEY_N) {
 			togglePBRNormal = !togglePBRNormal;
 		}
+		// press p/l to switch the positional/directional light, the first switch builds the shader permutations
+		if (key == GLFW_KEY_P) {
+			enablePositionalLight = !enablePositionalLight;
+		}
+		if (key == GLFW_KEY_L) {
+			enableDirectionalLight = !enableDirectionalLight;
+		}
 	}
 	// Handle key release events
 	else if (action == GLFW_RELEASE) {
@@ -297,54 +305,8 @@ void SceneManager::ProcessInput()
 // Loading HDR texture when isHDR is true
 unsigned int SceneManager::LoadTexture(const std::string& path, bool isHDR)
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	void* data;
-
-	// Using stbi_load or stbi_loadf for different texture type
-	if (!isHDR) {
-		data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-	}
-	else {
-		stbi_set_flip_vertically_on_load(true);
-		data = stbi_loadf(path.c_str(), &width, &height, &nrComponents, 0);
-	}
-
-	if (data) {
-		GLenum format;
-		GLenum dataType = (isHDR) ? GL_FLOAT : GL_UNSIGNED_BYTE; // Set GL_FLOAT or GL_UNSIGNED_BYTE for different texture data type
-		GLint internalFormat; // Using 16-bit float format for HDR, otherwise internalFormat equals to format
-
-		if (nrComponents == 1) format = internalFormat = GL_RED;
-		else if (nrComponents == 3) format = internalFormat = GL_RGB;
-		else if (nrComponents == 4) format = internalFormat = GL_RGBA;
-		else std::cerr << "Invalid texture format: Unsupported number of components!\n";
-
-		if (isHDR) internalFormat = GL_RGB16F;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, dataType, data);
-		if (!isHDR)
-			glGenerateMipmap(GL_TEXTURE_2D);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		if (!isHDR)
-			stbi_image_free(data);
-		else
-			stbi_image_free((float*)data);
-	}
-	else {
-		std::cerr << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-		return -1;
-	}
-
-	return textureID;
+	// Shared with the model and PBR loaders, the texture stays resident for the rest of the program
+	return TextureCache::Instance().Load(path, isHDR).Detach();
 }
 
 void SceneManager::CheckFramebufferStatus(unsigned int fbo, const std::string& framebufferName)
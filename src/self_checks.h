@@ -0,0 +1,299 @@
+// Correctness checks of the project's own decoders, encoders and parsers on inputs built in memory, for the cases
+// the files under res/ do not cover (corrupt streams, unusual block layouts, serial vs chunked parsing). Run from main with runSelfChecks
+// (config.h); prints one line per check and returns false if any failed. CPU only, no GL context is needed.
+//
+// Usage Example:
+// if (!RunSelfChecks())
+//     std::cerr << "self checks failed\n";
+
+#pragma once
+#ifndef SELF_CHECKS_H
+#define SELF_CHECKS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "block_compression.h"
+#include "obj_parser.h"
+#include "png_decoder.h"
+
+namespace self_checks_detail
+{
+	inline bool Report(const char* name, bool passed)
+	{
+		std::cout << "  " << name << (passed ? ": ok" : ": FAILED") << "\n";
+		return passed;
+	}
+
+	// Least significant bit first, as deflate packs its header fields
+	struct BitWriter
+	{
+		std::vector<uint8_t> bytes;
+		int used = 8; // bits used in the last byte
+
+		void Put(uint32_t value, int n)
+		{
+			for (int i = 0; i < n; i++) {
+				if (used == 8) {
+					bytes.push_back(0);
+					used = 0;
+				}
+				bytes.back() |= static_cast<uint8_t>(((value >> i) & 1) << used);
+				used++;
+			}
+		}
+	};
+
+	inline void AppendBE32(std::vector<uint8_t>& out, uint32_t value)
+	{
+		for (int shift = 24; shift >= 0; shift -= 8)
+			out.push_back(static_cast<uint8_t>(value >> shift));
+	}
+
+	inline uint32_t CRC32(const uint8_t* data, size_t size)
+	{
+		uint32_t crc = 0xFFFFFFFFu;
+		for (size_t i = 0; i < size; i++) {
+			crc ^= data[i];
+			for (int k = 0; k < 8; k++)
+				crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+		}
+		return crc ^ 0xFFFFFFFFu;
+	}
+
+	inline void AppendChunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& payload)
+	{
+		AppendBE32(png, static_cast<uint32_t>(payload.size()));
+		size_t start = png.size();
+		png.insert(png.end(), type, type + 4);
+		png.insert(png.end(), payload.begin(), payload.end());
+		AppendBE32(png, CRC32(png.data() + start, png.size() - start));
+	}
+
+	/**
+	 * zlib stream of raw in stored blocks of at most blockSize bytes, like zlib level 0 or incompressible data.
+	 * emptyFixedBlock starts it with an empty fixed Huffman block, so the first stored block is not byte aligned.
+	 */
+	inline std::vector<uint8_t> StoredZlib(const std::vector<uint8_t>& raw, size_t blockSize, bool emptyFixedBlock)
+	{
+		BitWriter writer;
+		writer.Put(0x78, 8);
+		writer.Put(0x01, 8);
+		if (emptyFixedBlock) {
+			writer.Put(0, 1);
+			writer.Put(1, 2);
+			writer.Put(0, 7); // end of block, code 256
+		}
+		for (size_t offset = 0; offset < raw.size(); offset += blockSize) {
+			size_t length = std::min(blockSize, raw.size() - offset);
+			writer.Put(offset + length == raw.size() ? 1 : 0, 1);
+			writer.Put(0, 2);
+			writer.used = 8; // pad to a byte boundary
+			writer.Put(static_cast<uint32_t>(length), 16);
+			writer.Put(static_cast<uint32_t>(length) ^ 0xFFFF, 16);
+			writer.bytes.insert(writer.bytes.end(), raw.begin() + offset, raw.begin() + offset + length);
+		}
+
+		uint32_t a = 1, b = 0;
+		for (uint8_t byte : raw) {
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		AppendBE32(writer.bytes, (b << 16) | a);
+		return writer.bytes;
+	}
+
+	// RGB PNG of noise, filter type None, whose IDAT is the given zlib stream of its rows
+	inline std::vector<uint8_t> NoisePNG(int width, int height, size_t blockSize, bool emptyFixedBlock)
+	{
+		std::vector<uint8_t> raw;
+		uint32_t state = 12345;
+		for (int y = 0; y < height; y++) {
+			raw.push_back(0);
+			for (int x = 0; x < width * 3; x++) {
+				state = state * 1664525u + 1013904223u;
+				raw.push_back(static_cast<uint8_t>(state >> 24));
+			}
+		}
+
+		std::vector<uint8_t> png(png_detail::kSignature, png_detail::kSignature + 8);
+		std::vector<uint8_t> header;
+		AppendBE32(header, static_cast<uint32_t>(width));
+		AppendBE32(header, static_cast<uint32_t>(height));
+		header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bits, RGB, deflate, adaptive filters, not interlaced
+		AppendChunk(png, "IHDR", header);
+		AppendChunk(png, "IDAT", StoredZlib(raw, blockSize, emptyFixedBlock));
+		AppendChunk(png, "IEND", {});
+		return png;
+	}
+
+	// DecodePNG itself (not the stb fallback) must accept png and give stb_image's pixels
+	inline bool DecodesLikeStb(const std::vector<uint8_t>& png)
+	{
+		PNGInfo info;
+		if (!ReadPNGInfo(png.data(), png.size(), info))
+			return false;
+		std::vector<uint8_t> pixels(info.RowBytes() * info.height);
+		if (!DecodePNG(png.data(), png.size(), info, pixels.data(), info.RowBytes()))
+			return false;
+
+		int width = 0, height = 0, components = 0;
+		unsigned char* reference = stbi_load_from_memory(png.data(), static_cast<int>(png.size()), &width, &height, &components, 0);
+		bool same = reference && width == info.width && height == info.height && components == info.components &&
+			std::memcmp(reference, pixels.data(), pixels.size()) == 0;
+		stbi_image_free(reference);
+		return same;
+	}
+
+	// OBJ text of strips of quads and triangles, about size bytes: 'o' and 'usemtl' records, faces with v/vt/vn,
+	// v//vn and v corners, positive and negative indices
+	inline std::string StripsOBJ(size_t size)
+	{
+		std::string obj = "# strips\n";
+		char line[128];
+		size_t vertices = 0;
+		for (int strip = 0; obj.size() < size; strip++) {
+			std::snprintf(line, sizeof(line), "o strip%d\nusemtl material%d\n", strip, strip % 3);
+			obj += line;
+			for (int i = 0; i < 64; i++) {
+				std::snprintf(line, sizeof(line), "v %d.5 %d %f\nvt %f %f\nvn 0 %d 1\n", i, strip, i * 0.01, i / 64.0, strip % 7 / 7.0, i & 1);
+				obj += line;
+			}
+			size_t first = vertices + 1;
+			vertices += 64;
+			for (int i = 0; i + 2 < 64; i += 2) {
+				size_t a = first + i;
+				if (i % 6 == 0)
+					std::snprintf(line, sizeof(line), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", a, a, a, a + 1, a + 1, a + 1, a + 3, a + 3, a + 3, a + 2, a + 2, a + 2);
+				else if (i % 6 == 2)
+					std::snprintf(line, sizeof(line), "f -%d//-%d -%d//-%d -%d//-%d\n", 64 - i, 64 - i, 63 - i, 63 - i, 62 - i, 62 - i);
+				else
+					std::snprintf(line, sizeof(line), "f %zu %zu %zu\n", a, a + 2, a + 1);
+				obj += line;
+			}
+		}
+		return obj;
+	}
+
+	inline bool SameOBJData(const ObjData& a, const ObjData& b)
+	{
+		auto sameCorner = [](const ObjIndex& x, const ObjIndex& y) { return x.v == y.v && x.vt == y.vt && x.vn == y.vn; };
+		auto sameEvent = [](const ObjEvent& x, const ObjEvent& y) { return x.type == y.type && x.corner == y.corner && x.name == y.name; };
+		return a.positions == b.positions && a.normals == b.normals && a.texCoords == b.texCoords &&
+			std::equal(a.corners.begin(), a.corners.end(), b.corners.begin(), b.corners.end(), sameCorner) &&
+			std::equal(a.events.begin(), a.events.end(), b.events.begin(), b.events.end(), sameEvent);
+	}
+}
+
+// png_decoder.h: stored block layouts and malformed dynamic Huffman headers
+inline bool CheckPNGDecoder()
+{
+	using namespace self_checks_detail;
+	bool passed = true;
+	passed &= Report("png stored blocks of 65535 bytes", DecodesLikeStb(NoisePNG(256, 256, 65535, false)));
+	passed &= Report("png unaligned stored blocks of 4093 bytes", DecodesLikeStb(NoisePNG(256, 256, 4093, true)));
+
+	// Dynamic block with HLIT 288 and HDIST 32, whose code lengths (all zero, run length 18 only) fill all 320
+	// entries; RFC 1951 allows at most 286 and 30
+	BitWriter writer;
+	writer.Put(0x78, 8);
+	writer.Put(0x01, 8);
+	writer.Put(1, 1);
+	writer.Put(2, 2);
+	writer.Put(31, 5);
+	writer.Put(31, 5);
+	writer.Put(0, 4);  // 4 code length codes, for 16, 17, 18, 0
+	writer.Put(0, 3);
+	writer.Put(0, 3);
+	writer.Put(1, 3);  // 18: code 1
+	writer.Put(1, 3);  // 0: code 0
+	for (int repeat : { 138, 138, 33, 11 }) {
+		writer.Put(1, 1);
+		writer.Put(static_cast<uint32_t>(repeat - 11), 7);
+	}
+	writer.bytes.resize(writer.bytes.size() + 64, 0);
+	std::vector<uint8_t> out(1024 + png_detail::kCopySlack);
+	passed &= Report("png rejects 288 literal and 32 distance codes", !png_detail::Inflate(writer.bytes.data(), writer.bytes.size(), out.data(), 1024));
+	return passed;
+}
+
+// block_compression.h: encode, decode and compare a gradient and a solid color in every format. 18x10 texels, so
+// the edge blocks repeat the last row and column. The bounds are RMSE in 0..255 units, the solid bounds allow for
+// BC1/BC3's 565 endpoints.
+inline bool CheckBlockCompression()
+{
+	using namespace self_checks_detail;
+	const int width = 18, height = 10;
+	std::vector<uint8_t> gradient(width * height * 4), solid(width * height * 4);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			uint8_t* texel = &gradient[(y * width + x) * 4];
+			texel[0] = static_cast<uint8_t>(x * 14);
+			texel[1] = static_cast<uint8_t>(y * 25);
+			texel[2] = static_cast<uint8_t>(255 - x * 7);
+			texel[3] = static_cast<uint8_t>((x + y) * 9);
+			const uint8_t color[4] = { 200, 60, 30, 128 };
+			std::memcpy(&solid[(y * width + x) * 4], color, 4);
+		}
+	}
+
+	struct Bound
+	{
+		BlockFormat format;
+		const char* name;
+		double gradient, solid;
+	};
+	const Bound bounds[] = {
+		{ BlockFormat::BC1, "bc1", 12.0, 3.0 },
+		{ BlockFormat::BC3, "bc3", 12.0, 3.0 },
+		{ BlockFormat::BC4, "bc4", 2.0, 0.5 },
+		{ BlockFormat::BC5, "bc5", 3.0, 0.5 },
+		{ BlockFormat::BC7, "bc7", 12.0, 0.5 },
+	};
+
+	bool passed = true;
+	for (const Bound& bound : bounds) {
+		CompressedImage image;
+		CompressImage(gradient.data(), width, height, 4, bound.format, image, MipFilter::Color, false);
+		CompressionError gradientError = MeasureCompressionError(gradient.data(), width, height, 4, image);
+		CompressImage(solid.data(), width, height, 4, bound.format, image, MipFilter::Color, false);
+		CompressionError solidError = MeasureCompressionError(solid.data(), width, height, 4, image);
+
+		std::string name = std::string(bound.name) + " round trip, rmse " + std::to_string(gradientError.rmse) + " gradient, " +
+			std::to_string(solidError.rmse) + " solid";
+		passed &= Report(name.c_str(), image.levels.size() == 1 && gradientError.psnr > 0.0 &&
+			gradientError.rmse <= bound.gradient && solidError.rmse <= bound.solid);
+	}
+	return passed;
+}
+
+// obj_parser.h: the chunked parse of a file several kMinParseChunkBytes long must equal the serial one
+inline bool CheckOBJParser()
+{
+	using namespace self_checks_detail;
+	std::string obj = StripsOBJ(4 * kMinParseChunkBytes + 12345);
+	ObjData serial, parallel;
+	ParseOBJ(obj.data(), obj.data() + obj.size(), serial);
+	unsigned int threads = ParseOBJParallel(obj.data(), obj.data() + obj.size(), parallel, 4);
+
+	std::string name = "obj parse on " + std::to_string(threads) + " threads equals the serial parse, " +
+		std::to_string(serial.corners.size() / 3) + " triangles";
+	return Report(name.c_str(), threads == 4 && !serial.corners.empty() && SameOBJData(serial, parallel));
+}
+
+// Every check, false if any failed
+inline bool RunSelfChecks()
+{
+	std::cout << "self checks:\n";
+	bool passed = CheckPNGDecoder();
+	passed &= CheckBlockCompression();
+	passed &= CheckOBJParser();
+	std::cout << "self checks " << (passed ? "passed" : "FAILED") << "\n";
+	return passed;
+}
+
+#endif // !SELF_CHECKS_H
@@ -2,48 +2,158 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <unordered_set>
+#include <vector>
 
 #include <GL/gl3w.h>
 #include <glm/glm.hpp>
 
+#include "program_cache.h"
+#include "timer.h"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 // The Shader class encapsulates OpenGL shader programs.
 // It provides functionalities for creating, compiling, and linking shaders,
 // as well as setting uniform variables.
+// Linked programs are restored from ProgramCache when it is enabled, see program_cache.h.
+//
+// ShaderCompile::Async only submits the compile and link, so constructing several shaders hands them all to the
+// driver before anything waits for one; with GL_KHR_parallel_shader_compile they build on the driver's threads.
+// Status queries are deferred until the program is done: IsReady polls GL_COMPLETION_STATUS_KHR without blocking
+// (without the extension it finishes the program at once), Shader::PollPending does so for every pending shader.
 // 
 // Usage Example:
 // Shader shader("vertexShaderPath", "fragmentShaderPath");
 // Shader shader("vertexShaderPath", "fragmentShaderPath", "geometryShaderPath");
+// Shader heavy("vertexShaderPath", "fragmentShaderPath", "geometryShaderPath", ShaderCompile::Async);
+// Shader variant("vertexShaderPath", "fragmentShaderPath", "", ShaderCompile::Blocking, "#define DIR_LIGHT\n"); // see shader_variants.h
+// heavy.OnReady([](Shader& shader) { shader.Bind(); shader.SetInt("texture_diffuse1", 0); });
+// if (heavy.IsReady()) { ... } // draw with it once it is linked
 // 
 // shader.Bind();
 // shader.SetVec3("some_uniform", glm::vec3(1.0f, 0.0f, 0.0f));
+// UniformHandle model = shader.GetUniform("model"); // once, then no lookup at all
+// shader.SetMat4(model, glm::mat4(1.0f));
 // shader.Unbind();
 // ------------------
+
+// Location of an active uniform, from Shader::GetUniform
+struct UniformHandle
+{
+	GLint location = -1;
+
+	bool IsValid() const { return location != -1; }
+};
+
+// Driver calls the uniform table saved, see Shader::EndFrame
+struct UniformStats
+{
+	size_t lookups = 0;  // setter calls, each of which used to run glGetUniformLocation
+	size_t skipped = 0;  // sets of uniforms the program does not have, whose glUniform call is left out too
+
+	size_t SavedCalls() const { return lookups + skipped; }
+};
+
+// When the constructor waits for a Shader's program
+enum class ShaderCompile
+{
+	Blocking, // linked when the constructor returns
+	Async,    // submitted only, see Shader::IsReady
+};
+
 class Shader
 {
 public:
 	Shader() = delete;
 
-	Shader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const std::string& geometryShaderPath = "")
+	// defines are inserted after the #version line of every stage
+	Shader(const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const std::string& geometryShaderPath = "",
+		ShaderCompile compile = ShaderCompile::Blocking, const std::string& defines = "")
+		: m_paths(vertexShaderPath + "\n" + fragmentShaderPath + "\n" + geometryShaderPath)
 	{
-		const auto& [vertexSource, fragmentSource, geometrySource] = ParseShader(vertexShaderPath, fragmentShaderPath, geometryShaderPath);
+		auto [vertexSource, fragmentSource, geometrySource] = ParseShader(vertexShaderPath, fragmentShaderPath, geometryShaderPath);
+		if (!defines.empty()) {
+			for (std::string* source : { &vertexSource, &fragmentSource, &geometrySource })
+				InjectDefines(*source, defines);
+			m_paths += "\n" + defines;
+		}
 		m_rendererID = CreateShader(vertexSource, fragmentSource, geometrySource);
+		Pending().push_back(this);
 
-#ifdef _DEBUG
-		std::cout << "successfully create and compile shader: \n" << vertexShaderPath <<
-			"\n" << fragmentShaderPath << "\n" << geometryShaderPath << "\n";
-#endif 
+		// A program restored from the cache is linked already
+		if (compile == ShaderCompile::Blocking || !m_stages[0])
+			Finish();
 	}
 
 	~Shader()
 	{
+		if (m_pending)
+			Pending().erase(std::find(Pending().begin(), Pending().end(), this));
+		for (unsigned int stage : m_stages) {
+			if (stage)
+				glDeleteShader(stage);
+		}
 		glDeleteProgram(m_rendererID);
 	}
 
+	// Pending shaders are tracked by address
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
+	// True once the program is linked and its uniforms are known, without blocking where the driver builds
+	// programs in parallel; the program's OnReady callbacks run in the call that finishes it.
+	bool IsReady()
+	{
+		if (m_pending && (!ParallelCompileSupported() || IsLinkCompleted()))
+			Finish();
+		return !m_pending;
+	}
+
+	// Blocks until the program is linked
+	void Wait()
+	{
+		if (m_pending)
+			Finish();
+	}
+
+	// Runs setup (e.g. static uniforms) once the program is linked, right away if it is already
+	void OnReady(std::function<void(Shader&)> setup)
+	{
+		if (m_pending)
+			m_readyCallbacks.push_back(std::move(setup));
+		else
+			setup(*this);
+	}
+
+	// Polls every pending ShaderCompile::Async shader, as IsReady does, and returns how many are still building
+	static size_t PollPending()
+	{
+		std::vector<Shader*> pending = Pending(); // Finish removes shaders from the list
+		for (Shader* shader : pending)
+			shader->IsReady();
+		return Pending().size();
+	}
+
+	// Lets the driver compile on as many threads as it likes, false without GL_KHR/ARB_parallel_shader_compile.
+	// Checked by the first Shader created.
+	static bool ParallelCompileSupported()
+	{
+		static const bool supported = EnableParallelCompile();
+		return supported;
+	}
+
 	void Bind() const
 	{
 		glUseProgram(m_rendererID);
@@ -59,84 +169,67 @@ public:
 		return m_rendererID;
 	}
 
-	void SetVec3(const std::string& _name, const glm::vec3& value)
+	// Location of an active uniform in the table ReflectUniforms builds after link, -1 (and a warning in debug
+	// builds) if the program has none by that name. Handles belong to this shader's program only.
+	UniformHandle GetUniform(std::string_view _name)
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
+		auto it = std::lower_bound(m_uniforms.begin(), m_uniforms.end(), _name,
+			[](const UniformEntry& entry, std::string_view name) { return entry.name < name; });
+		if (it != m_uniforms.end() && it->name == _name)
+			return UniformHandle{ it->location };
 
 #ifdef _DEBUG
-		if (location == -1 && warnedUniforms.find(_name) == warnedUniforms.end()) {
+		if (m_warnedUniforms.find(std::string(_name)) == m_warnedUniforms.end()) {
 			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-			warnedUniforms.insert(_name);
+			m_warnedUniforms.insert(std::string(_name));
 		}
 #endif
-		glUniform3fv(location, 1, &value[0]);
+		return UniformHandle{};
 	}
 
-	void SetVec3(const std::string& _name, float _x, float _y, float _z)
+	// The setters take a name, looked up in the table without calling GL or allocating, or a handle from GetUniform
+	void SetVec4(std::string_view _name, const glm::vec4& value) { SetVec4(GetUniform(_name), value); }
+	void SetVec4(UniformHandle uniform, const glm::vec4& value)
 	{
-		glm::vec3 value(_x, _y, _z);
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
-
-#ifdef _DEBUG
-		if (location == -1 && warnedUniforms.find(_name) == warnedUniforms.end()) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-			warnedUniforms.insert(_name);
-		}
-#endif
-		glUniform3fv(location, 1, &value[0]);
+		if (CountSet(uniform))
+			glUniform4fv(uniform.location, 1, &value[0]);
 	}
 
-	void SetVec2(const std::string& _name, const glm::vec2& value)
+	void SetVec3(std::string_view _name, const glm::vec3& value) { SetVec3(GetUniform(_name), value); }
+	void SetVec3(UniformHandle uniform, const glm::vec3& value)
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
-
-#ifdef _DEBUG
-		if (location == -1 && warnedUniforms.find(_name) == warnedUniforms.end()) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-			warnedUniforms.insert(_name);
-		}
-#endif
-		glUniform2fv(location, 1, &value[0]);
+		if (CountSet(uniform))
+			glUniform3fv(uniform.location, 1, &value[0]);
 	}
 
-	void SetMat4(const std::string& _name, const glm::mat4& _mat)
-	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
+	void SetVec3(std::string_view _name, float _x, float _y, float _z) { SetVec3(GetUniform(_name), glm::vec3(_x, _y, _z)); }
 
-#ifdef _DEBUG
-		if (location == -1 && warnedUniforms.find(_name) == warnedUniforms.end()) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-			warnedUniforms.insert(_name);
-		}
-#endif
-		glUniformMatrix4fv(location, 1, GL_FALSE, &_mat[0][0]);
+	void SetVec2(std::string_view _name, const glm::vec2& value) { SetVec2(GetUniform(_name), value); }
+	void SetVec2(UniformHandle uniform, const glm::vec2& value)
+	{
+		if (CountSet(uniform))
+			glUniform2fv(uniform.location, 1, &value[0]);
 	}
 
-	void SetMat3(const std::string& _name, const glm::mat3& _mat)
+	void SetMat4(std::string_view _name, const glm::mat4& _mat) { SetMat4(GetUniform(_name), _mat); }
+	void SetMat4(UniformHandle uniform, const glm::mat4& _mat)
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
-
-#ifdef _DEBUG
-		if (location == -1 && warnedUniforms.find(_name) == warnedUniforms.end()) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-			warnedUniforms.insert(_name);
-		}
-#endif
-
-		glUniformMatrix3fv(location, 1, GL_FALSE, &_mat[0][0]);
+		if (CountSet(uniform))
+			glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &_mat[0][0]);
 	}
 
-	void SetFloat(const std::string& _name, float _value)
+	void SetMat3(std::string_view _name, const glm::mat3& _mat) { SetMat3(GetUniform(_name), _mat); }
+	void SetMat3(UniformHandle uniform, const glm::mat3& _mat)
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
+		if (CountSet(uniform))
+			glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &_mat[0][0]);
+	}
 
-#ifdef _DEBUG
-		if (location == -1 && warnedUniforms.find(_name) == warnedUniforms.end()) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-			warnedUniforms.insert(_name);
-		}
-#endif
-		glUniform1f(location, _value);
+	void SetFloat(std::string_view _name, float _value) { SetFloat(GetUniform(_name), _value); }
+	void SetFloat(UniformHandle uniform, float _value)
+	{
+		if (CountSet(uniform))
+			glUniform1f(uniform.location, _value);
 	}
 
 	
@@ -149,17 +242,19 @@ public:
     // @param _name The name of the uniform variable in the shader.
     // @param _value The integer or boolean value to set the uniform variable to.
     //
-	void SetInt(const std::string& _name, int _value)
+	void SetInt(std::string_view _name, int _value) { SetInt(GetUniform(_name), _value); }
+	void SetInt(UniformHandle uniform, int _value)
 	{
-		GLint location = glGetUniformLocation(m_rendererID, _name.c_str());
+		if (CountSet(uniform))
+			glUniform1i(uniform.location, _value);
+	}
 
-#ifdef _DEBUG
-		if (location == -1 && warnedUniforms.find(_name) == warnedUniforms.end()) {
-			std::cerr << "Warning: Uniform '" << _name << "' not found or shader program not linked.\n";
-			warnedUniforms.insert(_name);
-		}
-#endif
-		glUniform1i(location, _value);
+	// Calls the table saved since the last EndFrame, over all shaders; returns them and starts counting again
+	static UniformStats EndFrame()
+	{
+		UniformStats frame = FrameStats();
+		FrameStats() = UniformStats{};
+		return frame;
 	}
 
 	void SetUniformBlock(const std::string& _name, const int bindingPoint) const
@@ -174,21 +269,105 @@ public:
 	}
 
 private:
+	// Name and location of an active uniform; arrays appear as "name", "name[0]" and every "name[i]"
+	struct UniformEntry
+	{
+		std::string name;
+		GLint location;
+	};
+
+	// Fills the table, sorted by name, with every active uniform outside uniform blocks
+	void ReflectUniforms()
+	{
+		m_uniforms.clear();
+		GLint linked = GL_FALSE, count = 0, maxLength = 0;
+		glGetProgramiv(m_rendererID, GL_LINK_STATUS, &linked);
+		if (linked != GL_TRUE)
+			return;
+		glGetProgramiv(m_rendererID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(m_rendererID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::vector<char> buffer(std::max(maxLength, 1));
+		for (GLint i = 0; i < count; i++) {
+			GLint size = 0;
+			GLenum type = 0;
+			GLsizei length = 0;
+			glGetActiveUniform(m_rendererID, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length, &size, &type, buffer.data());
+			std::string name(buffer.data(), length);
+			GLint location = glGetUniformLocation(m_rendererID, name.c_str());
+			if (location == -1)
+				continue; // member of a uniform block
+
+			m_uniforms.push_back({ name, location });
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+				std::string base = name.substr(0, name.size() - 3);
+				m_uniforms.push_back({ base, location });
+				for (GLint element = 1; element < size; element++) {
+					std::string elementName = base + "[" + std::to_string(element) + "]";
+					m_uniforms.push_back({ elementName, glGetUniformLocation(m_rendererID, elementName.c_str()) });
+				}
+			}
+		}
+		std::sort(m_uniforms.begin(), m_uniforms.end(), [](const UniformEntry& a, const UniformEntry& b) { return a.name < b.name; });
+	}
+
+	// Counts the lookup a setter saved, false if there is nothing to set
+	static bool CountSet(UniformHandle uniform)
+	{
+		UniformStats& stats = FrameStats();
+		stats.lookups++;
+		if (uniform.IsValid())
+			return true;
+		stats.skipped++;
+		return false;
+	}
+
+	static UniformStats& FrameStats()
+	{
+		static UniformStats stats;
+		return stats;
+	}
+
+	// Inserts defines after the #version line, followed by a #line directive so compile errors keep the file's line numbers
+	static void InjectDefines(std::string& source, const std::string& defines)
+	{
+		if (source.empty())
+			return;
+		size_t version = source.find("#version");
+		size_t insert = version == std::string::npos ? 0 : source.find('\n', version);
+		insert = insert == std::string::npos ? source.size() : insert + 1;
+		size_t nextLine = static_cast<size_t>(std::count(source.begin(), source.begin() + insert, '\n')) + 1;
+
+		std::string block = defines;
+		if (!block.empty() && block.back() != '\n')
+			block += '\n';
+		if (insert == source.size() && !source.empty() && source.back() != '\n')
+			block.insert(block.begin(), '\n');
+		block += "#line " + std::to_string(nextLine) + "\n";
+		source.insert(insert, block);
+	}
+
+	// Submits the compile; its status is only queried in Finish, so the driver never has to stop for it
 	unsigned int CompileShader(unsigned int type, const std::string& source)
 	{
 		unsigned int id = glCreateShader(type);
 		const char* src = source.c_str();
 		glShaderSource(id, 1, &src, nullptr);
 		glCompileShader(id);
+		return id;
+	}
 
 #ifdef _DEBUG
-		int result;
+	void CheckCompileStatus(unsigned int id)
+	{
+		int result, type;
 		glGetShaderiv(id, GL_COMPILE_STATUS, &result);
+		glGetShaderiv(id, GL_SHADER_TYPE, &type);
 
 		if (result == GL_FALSE) {
 			int length;
 			glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
-			std::vector<char> message(length);
+			std::vector<char> message(std::max(length, 1));
 			glGetShaderInfoLog(id, length, &length, message.data());
 			std::string errorMessage = "Failed to compile ";
 
@@ -199,12 +378,95 @@ private:
 			
 			errorMessage += " shader: ";
 			errorMessage += message.data();
-			glDeleteShader(id);
 
 			std::cout << errorMessage << "\n";
 		}
+	}
 #endif 
-		return id;
+
+	bool IsLinkCompleted() const
+	{
+		GLint completed = GL_FALSE;
+		glGetProgramiv(m_rendererID, GL_COMPLETION_STATUS_KHR, &completed);
+		return completed == GL_TRUE;
+	}
+
+	// The deferred half of CreateShader: status queries, cache and uniform table, then the OnReady callbacks
+	void Finish()
+	{
+		if (m_pending)
+			Pending().erase(std::find(Pending().begin(), Pending().end(), this));
+		m_pending = false;
+
+		GLint linked = GL_TRUE; // a program restored from the cache is linked
+		if (m_stages[0]) {
+			for (unsigned int& stage : m_stages) {
+				if (!stage)
+					continue;
+#ifdef _DEBUG
+				CheckCompileStatus(stage);
+#endif
+				glDetachShader(m_rendererID, stage);
+				glDeleteShader(stage);
+				stage = 0;
+			}
+
+			glGetProgramiv(m_rendererID, GL_LINK_STATUS, &linked);
+			if (linked == GL_TRUE) {
+#ifdef _DEBUG
+				glValidateProgram(m_rendererID);
+#endif
+				ProgramCache& cache = ProgramCache::Instance();
+				if (cache.IsEnabled())
+					cache.Save(m_rendererID, m_cacheKey);
+			}
+			else {
+				int length = 0;
+				glGetProgramiv(m_rendererID, GL_INFO_LOG_LENGTH, &length);
+				std::vector<char> message(std::max(length, 1));
+				glGetProgramInfoLog(m_rendererID, length, &length, message.data());
+				std::cerr << "Failed to link shader program:\n" << m_paths << "\n" << message.data() << "\n";
+			}
+			ProgramCache::Instance().Record(false, m_buildTimer.elapsedMicroseconds());
+		}
+		ReflectUniforms();
+
+#ifdef _DEBUG
+		if (linked == GL_TRUE)
+			std::cout << "successfully create and compile shader: \n" << m_paths << "\n";
+#endif 
+
+		std::vector<std::function<void(Shader&)>> callbacks;
+		callbacks.swap(m_readyCallbacks);
+		for (auto& setup : callbacks)
+			setup(*this);
+	}
+
+	static std::vector<Shader*>& Pending()
+	{
+		static std::vector<Shader*> pending;
+		return pending;
+	}
+
+	static bool EnableParallelCompile()
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		const char* function = nullptr;
+		for (GLint i = 0; i < count && !function; i++) {
+			const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+			if (extension && std::strcmp(extension, "GL_KHR_parallel_shader_compile") == 0)
+				function = "glMaxShaderCompilerThreadsKHR";
+			else if (extension && std::strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)
+				function = "glMaxShaderCompilerThreadsARB";
+		}
+		// gl3w only loads core functions
+		typedef void (APIENTRY* MaxShaderCompilerThreads)(GLuint count);
+		MaxShaderCompilerThreads maxThreads = function ? reinterpret_cast<MaxShaderCompilerThreads>(gl3wGetProcAddress(function)) : nullptr;
+		if (!maxThreads)
+			return false;
+		maxThreads(0xFFFFFFFFu); // as many as the implementation wants
+		return true;
 	}
 
 	std::tuple<std::string, std::string, std::string> ParseShader(const std::string& vertexShaderPath,
@@ -242,10 +504,22 @@ private:
 		return std::make_tuple(vShaderStream.str(), fShaderStream.str(), gShaderStream.str());
 	}
 
+	// Restores the program from the cache, or submits its compile and link, leaving the shader pending
 	unsigned int CreateShader(const std::string& vertexShader,
 		const std::string& fragmentShader, const std::string& geometryShader)
 	{
+		ParallelCompileSupported(); // before the first compile, so it can use the driver's threads
+		m_pending = true;
+		m_buildTimer.start();
 		unsigned int program = glCreateProgram();
+
+		ProgramCache& cache = ProgramCache::Instance();
+		m_cacheKey = cache.IsEnabled() ? ProgramCache::Key({ vertexShader, fragmentShader, geometryShader }) : 0;
+		if (cache.IsEnabled() && cache.Load(program, m_cacheKey)) {
+			cache.Record(true, m_buildTimer.elapsedMicroseconds());
+			return program;
+		}
+
 		unsigned int vs = CompileShader(GL_VERTEX_SHADER, vertexShader);
 		unsigned int fs = CompileShader(GL_FRAGMENT_SHADER, fragmentShader);
 
@@ -256,20 +530,27 @@ private:
 		}
 		glAttachShader(program, vs);
 		glAttachShader(program, fs);
+		if (cache.IsEnabled())
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(program);
-		glValidateProgram(program);
-
-		glDeleteShader(vs);
-		glDeleteShader(fs);
-		if (gs)
-			glDeleteShader(gs);
 
+		// Deleted by Finish, after their compile status was read
+		m_stages[0] = vs;
+		m_stages[1] = fs;
+		m_stages[2] = gs;
 		return program;
 	}
 
 private:
 	unsigned int m_rendererID; // Unique identifier for the OpenGL shader program
-	std::unordered_set<std::string> warnedUniforms; // Set to keep track of uniform variables that have already triggered a warning
+	std::vector<UniformEntry> m_uniforms; // active uniforms sorted by name, see ReflectUniforms
+	std::string m_paths;                // source files and defines, for messages
+	bool m_pending = false;             // submitted, Finish has not run yet
+	unsigned int m_stages[3] = {};      // vertex, fragment, geometry shaders until Finish; all 0 if restored
+	uint64_t m_cacheKey = 0;            // ProgramCache::Key of the sources
+	Timer m_buildTimer;                 // from submission to Finish, for ProgramCache::Record
+	std::vector<std::function<void(Shader&)>> m_readyCallbacks; // OnReady setups to run in Finish
+	std::unordered_set<std::string> m_warnedUniforms; // Set to keep track of uniform variables that have already triggered a warning
 };
 
 #endif // !SHADER_H
\ No newline at end of file
@@ -0,0 +1,129 @@
+// Permutations of one shader, selected by a ShaderFeature bitmask: every set bit becomes a #define after the
+// #version line (PBR, NORMAL_MAP, ...), and the shader's #ifdef blocks for features that are off are not compiled
+// at all instead of being branched over. Each permutation is built the first time it is requested, with
+// ShaderCompile::Async, and kept for the lifetime of the ShaderVariants; the binaries land in ProgramCache under
+// their own keys since the defines are part of the source.
+// Bits outside the features a shader supports are dropped, so one scene wide mask can be passed to every shader
+// without building identical permutations.
+//
+// Usage Example:
+// ShaderVariants planet("planet_pbr.vert", "planet_pbr.frag", "", ShaderFeature::PBR | ShaderFeature::NORMAL_MAP | ShaderFeature::DIR_LIGHT);
+// planet.OnReady([](Shader& shader, uint32_t features) { shader.Bind(); shader.SetInt("albedoMap", 0); });
+// if (Shader* shader = planet.Select(ShaderFeature::PBR | ShaderFeature::DIR_LIGHT)) // nullptr until one is linked
+//     RenderPBRMars(*shader, sphere);
+//
+// GL thread only.
+
+#pragma once
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shader.h"
+
+// Optional shader features, one bit each; the enumerator name is the #define the shaders test
+namespace ShaderFeature
+{
+	enum : uint32_t
+	{
+		PBR = 1u << 0,          // Cook-Torrance specular, Lambert diffuse only without it
+		NORMAL_MAP = 1u << 1,   // normals from the normal map instead of the interpolated vertex normal
+		POINT_LIGHT = 1u << 2,  // the positional light
+		DIR_LIGHT = 1u << 3,    // the directional light
+		SPECULAR_MAP = 1u << 4, // specular highlights scaled by the specular map
+	};
+
+	constexpr size_t kCount = 5;
+	constexpr const char* kNames[kCount] = { "PBR", "NORMAL_MAP", "POINT_LIGHT", "DIR_LIGHT", "SPECULAR_MAP" };
+
+	// "#define PBR\n#define DIR_LIGHT\n" for PBR | DIR_LIGHT
+	inline std::string Defines(uint32_t features)
+	{
+		std::string defines;
+		for (size_t i = 0; i < kCount; i++) {
+			if (features & (1u << i)) {
+				defines += "#define ";
+				defines += kNames[i];
+				defines += '\n';
+			}
+		}
+		return defines;
+	}
+}
+
+class ShaderVariants
+{
+public:
+	// supportedFeatures: the ShaderFeature bits the sources test, any others are ignored
+	ShaderVariants(const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const std::string& geometryShaderPath,
+		uint32_t supportedFeatures)
+		: vertexPath(vertexShaderPath), fragmentPath(fragmentShaderPath), geometryPath(geometryShaderPath), supported(supportedFeatures)
+	{
+	}
+
+	ShaderVariants(const ShaderVariants&) = delete;
+	ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+	// Runs setup on every permutation once it is linked, including those built later; features are its bits
+	void OnReady(std::function<void(Shader&, uint32_t)> setup);
+
+	// The permutation of features, submitted on the first request; it can be drawn with once IsReady. Requesting
+	// one ahead of its first draw (e.g. at startup) gives the driver time to build it.
+	Shader& Get(uint32_t features);
+
+	/**
+	 * The permutation of features if it is linked, otherwise the last permutation Select returned, so switching a
+	 * feature keeps drawing the old permutation until the new one is built.
+	 *
+	 * @return nullptr while no permutation was ready yet.
+	 */
+	Shader* Select(uint32_t features);
+
+	size_t Count() const { return variants.size(); }
+
+private:
+	std::string vertexPath, fragmentPath, geometryPath;
+	uint32_t supported = 0;
+	std::unordered_map<uint32_t, std::unique_ptr<Shader>> variants; // by features & supported
+	std::vector<std::function<void(Shader&, uint32_t)>> setups;
+	Shader* selected = nullptr; // last result of Select
+};
+
+void ShaderVariants::OnReady(std::function<void(Shader&, uint32_t)> setup)
+{
+	for (auto& [features, shader] : variants) {
+		uint32_t bits = features;
+		shader->OnReady([setup, bits](Shader& ready) { setup(ready, bits); });
+	}
+	setups.push_back(std::move(setup));
+}
+
+Shader& ShaderVariants::Get(uint32_t features)
+{
+	features &= supported;
+	auto it = variants.find(features);
+	if (it != variants.end())
+		return *it->second;
+
+	std::unique_ptr<Shader> shader = std::make_unique<Shader>(vertexPath, fragmentPath, geometryPath, ShaderCompile::Async,
+		ShaderFeature::Defines(features));
+	for (const auto& setup : setups)
+		shader->OnReady([setup, features](Shader& ready) { setup(ready, features); });
+	return *variants.emplace(features, std::move(shader)).first->second;
+}
+
+Shader* ShaderVariants::Select(uint32_t features)
+{
+	Shader& shader = Get(features);
+	if (shader.IsReady())
+		selected = &shader;
+	return selected;
+}
+
+#endif // !SHADER_VARIANTS_H
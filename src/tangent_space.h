@@ -0,0 +1,107 @@
+// Per-vertex tangent frames for normal mapping, generated at load time.
+// Follows the MikkTSpace conventions so normal maps baked by common tools line up:
+//  - per triangle tangent/bitangent from the UV derivatives, projected onto each corner's normal plane
+//    and weighted by the corner angle
+//  - tangent.w holds the handedness, the shader rebuilds bitangent = tangent.w * cross(normal, tangent)
+//    from the interpolated (unnormalized) vectors
+// Unlike MikkTSpace, vertices are never split: a vertex whose triangles disagree on handedness gets the
+// averaged frame. Meshes are deduplicated by (position, uv, normal), so this only affects mirrored UVs.
+//
+// Usage Example:
+// std::vector<glm::vec4> tangents;
+// GenerateTangents(vertices, indices.data(), indices.size(), tangents);
+
+#pragma once
+#ifndef TANGENT_SPACE_H
+#define TANGENT_SPACE_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * Computes one tangent per vertex of an indexed triangle list.
+ * Attributes are read from interleaved arrays, each stride bytes apart.
+ *
+ * @param tangents Receives vertexCount tangents, xyz unit tangent, w handedness (+1 or -1).
+ */
+inline void GenerateTangents(const glm::vec3* positions, const glm::vec3* normals, const glm::vec2* texCoords,
+	size_t stride, size_t vertexCount, const unsigned int* indices, size_t indexCount, glm::vec4* tangents)
+{
+	auto position = [&](unsigned int v) { return *reinterpret_cast<const glm::vec3*>(reinterpret_cast<const char*>(positions) + v * stride); };
+	auto normal = [&](unsigned int v) { return *reinterpret_cast<const glm::vec3*>(reinterpret_cast<const char*>(normals) + v * stride); };
+	auto texCoord = [&](unsigned int v) { return *reinterpret_cast<const glm::vec2*>(reinterpret_cast<const char*>(texCoords) + v * stride); };
+
+	std::vector<glm::vec3> tangentSum(vertexCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> bitangentSum(vertexCount, glm::vec3(0.0f));
+
+	for (size_t t = 0; t + 2 < indexCount; t += 3) {
+		unsigned int v[3] = { indices[t], indices[t + 1], indices[t + 2] };
+		if (v[0] >= vertexCount || v[1] >= vertexCount || v[2] >= vertexCount)
+			continue;
+
+		glm::vec3 p[3] = { position(v[0]), position(v[1]), position(v[2]) };
+		glm::vec2 uv[3] = { texCoord(v[0]), texCoord(v[1]), texCoord(v[2]) };
+		glm::vec3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+		glm::vec2 d1 = uv[1] - uv[0], d2 = uv[2] - uv[0];
+
+		float det = d1.x * d2.y - d2.x * d1.y;
+		if (std::abs(det) < 1e-20f)
+			continue; // no UV area, the triangle does not define a frame
+		glm::vec3 faceTangent = (e1 * d2.y - e2 * d1.y) / det;
+		glm::vec3 faceBitangent = (e2 * d1.x - e1 * d2.x) / det;
+
+		for (int k = 0; k < 3; k++) {
+			glm::vec3 a = p[(k + 1) % 3] - p[k], b = p[(k + 2) % 3] - p[k];
+			float lengths = glm::length(a) * glm::length(b);
+			if (lengths <= 0.0f)
+				continue; // zero area corner (e.g. strip degenerates)
+			float angle = std::acos(glm::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f));
+
+			// Project onto the corner's normal plane before weighting, as MikkTSpace does
+			glm::vec3 n = normal(v[k]);
+			glm::vec3 tangent = faceTangent - n * glm::dot(n, faceTangent);
+			glm::vec3 bitangent = faceBitangent - n * glm::dot(n, faceBitangent);
+			float tangentLength = glm::length(tangent), bitangentLength = glm::length(bitangent);
+			if (tangentLength > 0.0f)
+				tangentSum[v[k]] += tangent / tangentLength * angle;
+			if (bitangentLength > 0.0f)
+				bitangentSum[v[k]] += bitangent / bitangentLength * angle;
+		}
+	}
+
+	for (size_t i = 0; i < vertexCount; i++) {
+		glm::vec3 n = normal((unsigned int)i);
+		// Gram-Schmidt against the vertex normal
+		glm::vec3 tangent = tangentSum[i] - n * glm::dot(n, tangentSum[i]);
+		float length = glm::length(tangent);
+		if (length > 1e-12f) {
+			tangent /= length;
+		}
+		else {
+			// No usable UVs around this vertex: any vector perpendicular to the normal
+			glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+			tangent = glm::cross(n, axis);
+			float axisLength = glm::length(tangent);
+			tangent = axisLength > 0.0f ? tangent / axisLength : glm::vec3(1.0f, 0.0f, 0.0f);
+		}
+		float handedness = glm::dot(glm::cross(n, tangent), bitangentSum[i]) < 0.0f ? -1.0f : 1.0f;
+		tangents[i] = glm::vec4(tangent, handedness);
+	}
+}
+
+// Convenience overload for vertex structs with position, normal and texCoords members (e.g. Vertex)
+template<typename VertexType>
+void GenerateTangents(const std::vector<VertexType>& vertices, const unsigned int* indices, size_t indexCount,
+	std::vector<glm::vec4>& tangents)
+{
+	tangents.resize(vertices.size());
+	if (vertices.empty())
+		return;
+	GenerateTangents(&vertices[0].position, &vertices[0].normal, &vertices[0].texCoords, sizeof(VertexType),
+		vertices.size(), indices, indexCount, tangents.data());
+}
+
+#endif // !TANGENT_SPACE_H
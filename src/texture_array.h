@@ -0,0 +1,212 @@
+// GL_TEXTURE_2D_ARRAY built from decoded texture files, so meshes with different materials can be drawn
+// without rebinding textures: the shader picks the material with the layer coordinate instead.
+// Every layer has the same size, level count and internal format (see DescribeTextureImage), and gets the
+// image's whole mip chain or its compressed levels, like TextureCache uploads a 2D texture.
+// View(layer) returns a GL_TEXTURE_2D texture view of one layer (GL 4.3), for shaders that still sample a
+// single material through a plain sampler2D; the views share the array's storage.
+// Arrays are owned by their creator and not shared; TextureCache counts their bytes towards its budget but cannot
+// evict them, so the cached 2D textures lose mips first.
+//
+// Usage Example:
+// TextureArrayFormat format;
+// DescribeTextureImage(image, format);
+// TextureArray array(format, 4);
+// array.SetLayer(0, image);
+// glBindTexture(GL_TEXTURE_2D_ARRAY, array.Id()); // texture(sampler2DArray, vec3(uv, 0))
+
+#pragma once
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <GL/gl3w.h>
+
+#include "texture_cache.h"
+
+// Storage shared by every layer of a TextureArray
+struct TextureArrayFormat
+{
+	int width = 0, height = 0;
+	int levels = 0;
+	GLenum internalFormat = 0;
+
+	bool operator==(const TextureArrayFormat& other) const
+	{
+		return width == other.width && height == other.height && levels == other.levels && internalFormat == other.internalFormat;
+	}
+	bool operator!=(const TextureArrayFormat& other) const { return !(*this == other); }
+};
+
+// The storage image needs as a layer, false if it has no data. HDR images are not supported.
+inline bool DescribeTextureImage(const TextureImage& image, TextureArrayFormat& format)
+{
+	if (image.IsCompressed()) {
+		format.width = image.compressed.width;
+		format.height = image.compressed.height;
+		format.levels = static_cast<int>(image.compressed.levels.size());
+		format.internalFormat = TextureCache::CompressedFormat(image.compressed.format);
+		return true;
+	}
+	if (!image.pixels || image.isHDR)
+		return false;
+
+	GLenum pixelFormat;
+	format.width = image.width;
+	format.height = image.height;
+	format.levels = static_cast<int>(image.mips.LevelCount());
+	TextureCache::PixelFormat(image, pixelFormat, format.internalFormat);
+	return true;
+}
+
+class TextureArray
+{
+public:
+	// Immutable storage for layers, filled by SetLayer (GL thread only)
+	TextureArray(const TextureArrayFormat& format, int layers);
+	~TextureArray();
+
+	TextureArray(TextureArray&& other) noexcept;
+	TextureArray& operator=(TextureArray&& other) noexcept;
+	TextureArray(const TextureArray&) = delete;
+	TextureArray& operator=(const TextureArray&) = delete;
+
+	// Uploads every level of image into layer, false if the image does not match the array's format
+	bool SetLayer(int layer, const TextureImage& image);
+
+	// GL_TEXTURE_2D view of layer, created on first use and deleted with the array
+	unsigned int View(int layer);
+
+	unsigned int Id() const { return id; }
+	int Layers() const { return layers; }
+	const TextureArrayFormat& Format() const { return format; }
+	size_t Bytes() const { return bytes; } // uploaded so far
+
+private:
+	void Release();
+
+private:
+	unsigned int id = 0;
+	TextureArrayFormat format;
+	int layers = 0;
+	size_t bytes = 0;
+	std::vector<unsigned int> views; // per layer, 0 until View asks for it
+};
+
+TextureArray::TextureArray(const TextureArrayFormat& arrayFormat, int layerCount)
+	: format(arrayFormat), layers(layerCount), views(layerCount, 0)
+{
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, format.levels, format.internalFormat, format.width, format.height, layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// A single level with a mipmapped min filter would leave the texture incomplete
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, format.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+TextureArray::~TextureArray()
+{
+	Release();
+}
+
+TextureArray::TextureArray(TextureArray&& other) noexcept
+	: id(other.id), format(other.format), layers(other.layers), bytes(other.bytes), views(std::move(other.views))
+{
+	other.id = 0;
+	other.bytes = 0;
+	other.views.clear();
+}
+
+TextureArray& TextureArray::operator=(TextureArray&& other) noexcept
+{
+	if (this != &other) {
+		Release();
+		id = other.id;
+		format = other.format;
+		layers = other.layers;
+		bytes = other.bytes;
+		views = std::move(other.views);
+		other.id = 0;
+		other.bytes = 0;
+		other.views.clear();
+	}
+	return *this;
+}
+
+void TextureArray::Release()
+{
+	for (unsigned int view : views) {
+		if (view != 0)
+			glDeleteTextures(1, &view);
+	}
+	views.clear();
+	if (id != 0) {
+		glDeleteTextures(1, &id);
+		TextureCache::Instance().RemoveArrayBytes(bytes);
+	}
+	id = 0;
+	bytes = 0;
+}
+
+bool TextureArray::SetLayer(int layer, const TextureImage& image)
+{
+	TextureArrayFormat imageFormat;
+	if (layer < 0 || layer >= layers || !DescribeTextureImage(image, imageFormat) || imageFormat != format) {
+		std::cerr << "Texture does not match its texture array layer: " << image.path << std::endl;
+		return false;
+	}
+
+	const size_t uploaded = bytes;
+	glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+	if (image.IsCompressed()) {
+		for (size_t i = 0; i < image.compressed.levels.size(); i++) {
+			const CompressedLevel& level = image.compressed.levels[i];
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(i), 0, 0, layer, level.width, level.height, 1,
+				format.internalFormat, static_cast<GLsizei>(level.size), image.compressed.data.data() + level.offset);
+			bytes += level.size;
+		}
+	}
+	else {
+		GLenum pixelFormat, internalFormat;
+		TextureCache::PixelFormat(image, pixelFormat, internalFormat);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of 1 and 3 component images are not 4-byte aligned
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, image.width, image.height, 1, pixelFormat, GL_UNSIGNED_BYTE,
+			image.pixels.get());
+		bytes += static_cast<size_t>(image.width) * image.height * image.components;
+		for (size_t i = 0; i < image.mips.levels.size(); i++) {
+			const MipLevel& level = image.mips.levels[i];
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(i + 1), 0, 0, layer, level.width, level.height, 1,
+				pixelFormat, GL_UNSIGNED_BYTE, image.mips.data.data() + level.offset);
+			bytes += level.size;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	TextureCache::Instance().AddArrayBytes(bytes - uploaded);
+	return true;
+}
+
+unsigned int TextureArray::View(int layer)
+{
+	if (layer < 0 || layer >= layers)
+		return 0;
+	if (views[layer] == 0) {
+		// A view name must be fresh from glGenTextures, never bound before glTextureView
+		glGenTextures(1, &views[layer]);
+		glTextureView(views[layer], GL_TEXTURE_2D, id, format.internalFormat, 0, format.levels, layer, 1);
+		glBindTexture(GL_TEXTURE_2D, views[layer]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, format.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	return views[layer];
+}
+
+#endif // !TEXTURE_ARRAY_H
@@ -0,0 +1,816 @@
+// One cache for every 2D texture loaded from an image file (model materials, PBR maps, SceneManager::LoadTexture).
+// Block compressed .dds files (see texture_compression.h) are uploaded as they are, with their mip chain;
+// other 8-bit images get theirs from GenerateMipChain on the decoding thread, not glGenerateMipmap.
+// Every texture is created with immutable storage (glTexStorage2D) sized for its final level count.
+// Textures are looked up by canonical path first, then by a hash of the file contents, so a map referenced by
+// several materials, or copied under another name, is decoded and stored in VRAM only once.
+// Load hands out refcounted TextureHandles; the texture is deleted when the last handle goes away.
+// Stream does the same, but a new texture starts at low resolution and TextureStreamer refines it over the next frames.
+//
+// Residency: with SetBudget, Update drops the top mips of the least recently used textures while the resident bytes
+// exceed the budget, and a texture bound again through TextureHandle::Use is re-read on a worker thread and streamed
+// back to full resolution. Both reallocate the texture, so its GL name changes: bind Use() every frame instead of
+// keeping the id. Detached textures (plain ids) are never evicted. TextureArrays report their bytes with
+// AddArrayBytes: they count towards the budget, so the cached textures give up mips in their place.
+//
+// Usage Example:
+// TextureHandle albedo = TextureCache::Instance().Load("res/textures/pbr/rusted_iron/albedo.png");
+// glBindTexture(GL_TEXTURE_2D, albedo.Id());
+//
+// All GL work happens on the thread owning the context; DecodeTexture and Contains may be called from any thread.
+
+#pragma once
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#endif 
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <GL/gl3w.h>
+
+#include "dds_file.h"
+#include "hdr_decoder.h"
+#include "mapped_file.h"
+#include "mip_generator.h"
+#include "png_decoder.h"
+#include "texture_compression.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
+#include "timer.h"
+
+// S3TC is an extension rather than core, but supported by every desktop driver; RGTC and BPTC are core
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// A texture file decoded on the CPU, waiting for the GL thread.
+struct TextureImage
+{
+	std::string path;
+	std::string canonicalPath;
+	bool isHDR = false;           // GL_RGB9_E5 pixels from DecodeHDRImage, flipped vertically
+	uint64_t contentHash = 0;     // HashBytes of the file
+	int width = 0, height = 0, components = 0;
+	std::unique_ptr<void, void(*)(void*)> pixels{ nullptr, stbi_image_free };
+	MipChain mips;                    // levels below pixels for 8-bit images
+	CompressedImage compressed;       // blocks of a .dds file, pixels stays empty
+	long long decodeMicroseconds = 0; // reading, hashing and decoding the file
+
+	bool HasData() const { return pixels || !compressed.levels.empty(); }
+	bool IsCompressed() const { return !compressed.levels.empty(); }
+
+	// Frees the decoded data once uploaded
+	void FreePixels() { pixels.reset(); mips = MipChain(); compressed = CompressedImage(); }
+};
+
+struct TextureCacheStats
+{
+	size_t hits = 0;         // found by path
+	size_t contentHits = 0;  // same file contents under another path
+	size_t misses = 0;       // decoded and uploaded
+	size_t textures = 0;     // currently resident
+	size_t residentBytes = 0; // estimated VRAM of the resident textures, mipmaps included, and of arrayBytes
+	size_t arrayBytes = 0;    // TextureArray layers, budgeted but never evicted
+	size_t peakBytes = 0;     // highest residentBytes so far
+	size_t evictedBytes = 0;  // dropped by the budget so far
+	size_t restoredBytes = 0; // brought back on use so far
+	size_t evictedTextures = 0; // currently below full resolution
+};
+
+// Absolute, normalized path used as cache key, so "a/../b.png" and "b.png" are the same texture.
+inline std::string CanonicalTexturePath(const std::string& path)
+{
+	std::error_code ec;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(path, ec);
+	if (ec)
+		canonical = std::filesystem::path(path).lexically_normal();
+	return canonical.generic_string();
+}
+
+/**
+ * Reads and decodes an image file without touching OpenGL, safe to call from worker threads.
+ * The file is read once, for both the content hash and the decoder.
+ * 8-bit images (PNGs through png_decoder.h, other formats through stb_image) also get their mip chain,
+ * filtered for the role GuessTextureRole reads from the name.
+ * .dds files are parsed into image.compressed instead (isHDR does not apply to them).
+ *
+ * @param isHDR Decode to shared exponent RGB9E5 (hdr_decoder.h) and flip vertically, for equirectangular HDR maps.
+ * @return false if the file is missing or can not be decoded.
+ */
+inline bool DecodeTexture(const std::string& path, TextureImage& image, bool isHDR = false)
+{
+	Timer timer;
+	timer.start();
+
+	image.path = path;
+	image.canonicalPath = CanonicalTexturePath(path);
+	image.isHDR = isHDR;
+
+	MappedFile file(path);
+	if (file.IsOpen() && file.Size() > 0) {
+		image.contentHash = HashBytes(file.Data(), file.Size());
+		const stbi_uc* bytes = reinterpret_cast<const stbi_uc*>(file.Data());
+		std::string extension = std::filesystem::path(path).extension().string();
+		if (extension == ".dds" || extension == ".DDS") {
+			if (ReadDDS(file.Data(), file.Size(), image.compressed)) {
+				image.isHDR = false;
+				image.width = image.compressed.width;
+				image.height = image.compressed.height;
+				image.components = BlockFormatChannels(image.compressed.format);
+			}
+		}
+		else if (!isHDR) {
+			image.pixels.reset(DecodeImage(bytes, file.Size(), image.width, image.height, image.components));
+			if (image.pixels) {
+				GenerateMipChain(static_cast<const uint8_t*>(image.pixels.get()), image.width, image.height, image.components,
+					ChooseMipFilter(GuessTextureRole(path)), image.mips);
+			}
+		}
+		else {
+			image.pixels.reset(DecodeHDRImage(bytes, file.Size(), image.width, image.height, true));
+			image.components = 3;
+		}
+	}
+	image.decodeMicroseconds = timer.elapsedMicroseconds();
+
+	if (!image.HasData()) {
+		std::cerr << "Texture failed to load at path: " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Refcounted reference to a texture owned by TextureCache. Copying adds a reference.
+class TextureHandle
+{
+public:
+	TextureHandle() = default;
+	TextureHandle(const TextureHandle& other);
+	TextureHandle(TextureHandle&& other) noexcept : key(other.key) { other.key = 0; }
+	TextureHandle& operator=(TextureHandle other) noexcept { std::swap(key, other.key); return *this; }
+	~TextureHandle() { Reset(); }
+
+	// GL texture name, 0 if the texture failed to load. Changes when the residency budget evicts or restores mips.
+	unsigned int Id() const;
+
+	// Id() for a draw: marks the texture used this frame and brings its evicted mips back
+	unsigned int Use() const;
+
+	explicit operator bool() const { return key != 0; }
+
+	// Drops the reference, the texture is deleted with the last one
+	void Reset();
+
+	// Gives up the handle without dropping its reference: the texture stays resident for the rest of the program,
+	// and is never evicted so the returned id stays valid. For the callers that keep plain texture ids.
+	unsigned int Detach();
+
+private:
+	friend class TextureCache;
+	explicit TextureHandle(unsigned int textureKey) : key(textureKey) {} // adopts one reference
+
+	unsigned int key = 0; // TextureCache entry, stays the same when the GL name changes
+};
+
+class TextureCache
+{
+public:
+	static TextureCache& Instance() { static TextureCache cache; return cache; }
+
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	// Returns the cached texture for path, decoding and uploading it on a miss (GL thread only).
+	TextureHandle Load(const std::string& path, bool isHDR = false);
+
+	// Same for an image decoded ahead of time with DecodeTexture; its pixels are not needed on a hit (GL thread only).
+	TextureHandle Load(const TextureImage& image);
+
+	// Like Load, but on a miss only the mip tail is uploaded now, the finer levels follow in TextureStreamer::Update.
+	// HDR images are uploaded whole. The image's data is taken over (GL thread only).
+	TextureHandle Stream(const std::string& path);
+	TextureHandle Stream(TextureImage&& image);
+
+	// True if path is resident, e.g. to skip decoding it again on a worker thread
+	bool Contains(const std::string& path, bool isHDR = false) const;
+
+	/**
+	 * Enables mip eviction, see Update.
+	 *
+	 * @param bytes Resident bytes to stay under, 0 for no limit.
+	 * @param unusedFrames Frames without a TextureHandle::Use before a texture may lose mips.
+	 */
+	void SetBudget(size_t bytes, unsigned int unusedFrames);
+
+	// Once per frame before drawing (GL thread only): finishes restores whose files are decoded, then
+	// drops top mips of textures unused for unusedFrames, least recently used first, while over budget.
+	void Update();
+
+	TextureCacheStats GetStats() const;
+	void PrintStats() const;
+
+	// VRAM of a TextureArray, added as its layers are uploaded and removed when it is deleted (any thread)
+	void AddArrayBytes(size_t bytes);
+	void RemoveArrayBytes(size_t bytes);
+
+	// Upload formats of an 8-bit or HDR image and of a block compressed one, shared with TextureArray
+	static void PixelFormat(const TextureImage& image, GLenum& format, GLenum& internalFormat);
+	static GLenum CompressedFormat(BlockFormat format);
+
+private:
+	TextureCache() = default;
+
+	// Size and format of a texture's full mip chain
+	struct TextureStorage
+	{
+		int width = 0, height = 0;
+		GLenum internalFormat = 0;
+		std::vector<size_t> levelBytes; // level 0 first
+
+		int Levels() const { return static_cast<int>(levelBytes.size()); }
+		size_t Bytes(int firstLevel = 0) const;
+	};
+
+	struct CachedTexture
+	{
+		unsigned int name = 0;         // GL texture
+		std::vector<std::string> keys; // every path key aliasing this texture
+		std::string sourcePath;        // file to decode again when restoring evicted mips
+		uint64_t contentHash = 0;
+		bool isHDR = false;
+		TextureStorage storage;
+		int evictedLevels = 0;         // top levels currently dropped
+		uint64_t lastUsedFrame = 0;
+		bool pinned = false;           // detached, its id must not change
+		bool restoring = false;
+		unsigned int refs = 0;
+	};
+
+	friend class TextureHandle;
+	void AddRef(unsigned int key);
+	void Release(unsigned int key);
+	unsigned int Name(unsigned int key, bool use);
+	unsigned int Pin(unsigned int key);
+
+	// HDR and 8-bit loads of the same file are different textures
+	static std::string PathKey(const std::string& canonicalPath, bool isHDR) { return isHDR ? canonicalPath + "|hdr" : canonicalPath; }
+
+	// Load and Stream, streamed is image itself when streaming
+	TextureHandle Insert(const TextureImage& image, TextureImage* streamed);
+
+	// Creates a texture with the image's mip chain (8-bit), a single level RGB9E5 texture (HDR) or
+	// one with the compressed mip chain, 0 if the image is empty.
+	static unsigned int UploadTexture(const TextureImage& image, TextureStorage& storage);
+	static unsigned int UploadCompressedTexture(const CompressedImage& image, TextureStorage& storage);
+	static unsigned int StreamTexture(TextureImage&& image, TextureStorage& storage);
+
+	// Levels of image for TextureStreamer, false if it has no data
+	static bool DescribeLevels(const std::shared_ptr<TextureImage>& image, TextureStreamSource& source, TextureStorage& storage);
+
+	// Immutable storage and sampling state, the level data is uploaded by the callers
+	static unsigned int CreateTexture(int width, int height, GLsizei levels, GLenum internalFormat);
+
+	// Reallocates texture without its top count resident levels, lock must be held
+	void EvictLevels(CachedTexture& texture, int count);
+
+	// Copies levels [firstLevel, end) of the full chain between textures whose level 0 is chain level sourceBase / targetBase
+	static void CopyLevels(unsigned int source, int sourceBase, unsigned int target, int targetBase, const TextureStorage& storage, int firstLevel);
+	bool CanEvict(const CachedTexture& texture) const;
+	void FinishRestore(unsigned int key, TextureImage& image);
+
+	// Takes a reference on key, lock must be held
+	TextureHandle Acquire(unsigned int key) { textures[key].refs++; return TextureHandle(key); }
+
+	void AddResidentBytes(size_t bytes) { stats.residentBytes += bytes; stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes); }
+
+	// Evicted levels never shrink a texture below this size
+	static constexpr int kMinEvictedSize = 64;
+
+	struct PendingRestore
+	{
+		unsigned int key = 0;
+		std::future<TextureImage> image;
+	};
+
+private:
+	mutable std::mutex mutex;
+	std::unordered_map<unsigned int, CachedTexture> textures;      // key -> entry
+	std::unordered_map<std::string, unsigned int> byPath;          // PathKey -> key
+	std::map<std::pair<uint64_t, bool>, unsigned int> byContent;   // (content hash, isHDR) -> key
+	unsigned int nextKey = 1;
+	TextureCacheStats stats;
+
+	size_t budgetBytes = 0;
+	unsigned int budgetUnusedFrames = 0;
+	uint64_t frame = 0;
+	std::vector<PendingRestore> restores;      // GL thread only
+	std::unique_ptr<ThreadPool> restorePool;   // decodes evicted textures again, created on first use
+};
+
+TextureHandle::TextureHandle(const TextureHandle& other) : key(other.key)
+{
+	if (key != 0)
+		TextureCache::Instance().AddRef(key);
+}
+
+unsigned int TextureHandle::Id() const
+{
+	return key != 0 ? TextureCache::Instance().Name(key, false) : 0;
+}
+
+unsigned int TextureHandle::Use() const
+{
+	return key != 0 ? TextureCache::Instance().Name(key, true) : 0;
+}
+
+void TextureHandle::Reset()
+{
+	if (key != 0)
+		TextureCache::Instance().Release(key);
+	key = 0;
+}
+
+unsigned int TextureHandle::Detach()
+{
+	unsigned int texture = key != 0 ? TextureCache::Instance().Pin(key) : 0;
+	key = 0;
+	return texture;
+}
+
+size_t TextureCache::TextureStorage::Bytes(int firstLevel) const
+{
+	size_t bytes = 0;
+	for (int i = firstLevel; i < Levels(); i++)
+		bytes += levelBytes[i];
+	return bytes;
+}
+
+TextureHandle TextureCache::Load(const std::string& path, bool isHDR)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = byPath.find(PathKey(CanonicalTexturePath(path), isHDR));
+		if (it != byPath.end()) {
+			stats.hits++;
+			return Acquire(it->second);
+		}
+	}
+
+	TextureImage image;
+	if (!DecodeTexture(path, image, isHDR))
+		return TextureHandle();
+	return Load(image);
+}
+
+TextureHandle TextureCache::Load(const TextureImage& image)
+{
+	return Insert(image, nullptr);
+}
+
+TextureHandle TextureCache::Stream(const std::string& path)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = byPath.find(PathKey(CanonicalTexturePath(path), false));
+		if (it != byPath.end()) {
+			stats.hits++;
+			return Acquire(it->second);
+		}
+	}
+
+	TextureImage image;
+	if (!DecodeTexture(path, image))
+		return TextureHandle();
+	return Stream(std::move(image));
+}
+
+TextureHandle TextureCache::Stream(TextureImage&& image)
+{
+	return Insert(image, image.isHDR ? nullptr : &image);
+}
+
+TextureHandle TextureCache::Insert(const TextureImage& image, TextureImage* streamed)
+{
+	std::string canonicalPath = image.canonicalPath.empty() ? CanonicalTexturePath(image.path) : image.canonicalPath;
+	std::string key = PathKey(canonicalPath, image.isHDR);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	auto pathHit = byPath.find(key);
+	if (pathHit != byPath.end()) {
+		stats.hits++;
+		return Acquire(pathHit->second);
+	}
+
+	if (!image.HasData()) {
+		// Not decoded ahead of time (it was resident then) or failed to decode
+		lock.unlock();
+		if (image.path.empty())
+			return TextureHandle();
+		TextureImage decoded;
+		if (!DecodeTexture(image.path, decoded, image.isHDR))
+			return TextureHandle();
+		return streamed ? Stream(std::move(decoded)) : Load(decoded);
+	}
+
+	std::pair<uint64_t, bool> contentKey(image.contentHash, image.isHDR);
+	auto contentHit = byContent.find(contentKey);
+	if (contentHit != byContent.end()) {
+		stats.contentHits++;
+		byPath[key] = contentHit->second;
+		textures[contentHit->second].keys.push_back(key);
+		return Acquire(contentHit->second);
+	}
+
+	TextureStorage storage;
+	unsigned int name = streamed ? StreamTexture(std::move(*streamed), storage) : UploadTexture(image, storage);
+	if (name == 0)
+		return TextureHandle();
+
+	unsigned int textureKey = nextKey++;
+	CachedTexture& texture = textures[textureKey];
+	texture.name = name;
+	texture.keys.push_back(key);
+	texture.sourcePath = canonicalPath;
+	texture.contentHash = contentKey.first;
+	texture.isHDR = contentKey.second;
+	texture.storage = std::move(storage);
+	texture.lastUsedFrame = frame;
+	byPath[key] = textureKey;
+	byContent[contentKey] = textureKey;
+
+	stats.misses++;
+	stats.textures++;
+	AddResidentBytes(texture.storage.Bytes());
+	return Acquire(textureKey);
+}
+
+bool TextureCache::Contains(const std::string& path, bool isHDR) const
+{
+	std::string key = PathKey(CanonicalTexturePath(path), isHDR);
+	std::lock_guard<std::mutex> lock(mutex);
+	return byPath.count(key) != 0;
+}
+
+void TextureCache::SetBudget(size_t bytes, unsigned int unusedFrames)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	budgetBytes = bytes;
+	budgetUnusedFrames = unusedFrames;
+}
+
+void TextureCache::Update()
+{
+	for (size_t i = 0; i < restores.size();) {
+		if (restores[i].image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			i++;
+			continue;
+		}
+		unsigned int key = restores[i].key;
+		TextureImage image = restores[i].image.get();
+		restores.erase(restores.begin() + i);
+		FinishRestore(key, image);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	frame++;
+	while (budgetBytes != 0 && stats.residentBytes > budgetBytes) {
+		CachedTexture* victim = nullptr;
+		for (auto& entry : textures) {
+			if (CanEvict(entry.second) && (!victim || entry.second.lastUsedFrame < victim->lastUsedFrame))
+				victim = &entry.second;
+		}
+		if (!victim)
+			break;
+
+		// As many top levels as it takes to get under budget, as far as the texture allows
+		const TextureStorage& storage = victim->storage;
+		int count = 0;
+		size_t freed = 0;
+		// Same bounds as CanEvict: at least one level stays resident, even for a .dds with a partial mip chain
+		while (stats.residentBytes - freed > budgetBytes && victim->evictedLevels + count + 1 < storage.Levels() &&
+			std::max(storage.width, storage.height) >> (victim->evictedLevels + count + 1) >= kMinEvictedSize) {
+			freed += storage.levelBytes[victim->evictedLevels + count];
+			count++;
+		}
+		EvictLevels(*victim, count);
+	}
+}
+
+TextureCacheStats TextureCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void TextureCache::PrintStats() const
+{
+	TextureCacheStats current = GetStats();
+	const double MB = 1024.0 * 1024.0;
+	std::cout << "texture cache: " << current.textures << " textures, " << current.residentBytes / MB
+		<< " MB resident (" << current.arrayBytes / MB << " MB in arrays, peak " << current.peakBytes / MB << " MB), " << current.hits << " hits, " << current.contentHits
+		<< " content hits, " << current.misses << " misses, " << current.evictedTextures << " textures evicted, "
+		<< current.evictedBytes / MB << " MB evicted, " << current.restoredBytes / MB << " MB restored\n";
+}
+
+void TextureCache::AddArrayBytes(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.arrayBytes += bytes;
+	AddResidentBytes(bytes);
+}
+
+void TextureCache::RemoveArrayBytes(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.arrayBytes -= bytes;
+	stats.residentBytes -= bytes;
+}
+
+void TextureCache::AddRef(unsigned int key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	textures[key].refs++;
+}
+
+void TextureCache::Release(unsigned int key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = textures.find(key);
+	if (it == textures.end() || --it->second.refs > 0)
+		return;
+
+	const CachedTexture& texture = it->second;
+	for (const std::string& path : texture.keys)
+		byPath.erase(path);
+	byContent.erase({ texture.contentHash, texture.isHDR });
+	stats.textures--;
+	stats.residentBytes -= texture.storage.Bytes(texture.evictedLevels);
+	if (texture.evictedLevels > 0)
+		stats.evictedTextures--;
+	unsigned int name = texture.name;
+	textures.erase(it); // a pending restore finds the entry gone
+
+	TextureStreamer::Instance().Cancel(name);
+	glDeleteTextures(1, &name);
+}
+
+unsigned int TextureCache::Name(unsigned int key, bool use)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = textures.find(key);
+	if (it == textures.end())
+		return 0;
+
+	CachedTexture& texture = it->second;
+	if (use) {
+		texture.lastUsedFrame = frame;
+		if (texture.evictedLevels > 0 && !texture.restoring && !texture.pinned) {
+			// Read the file again off the GL thread, Update uploads it once decoded
+			texture.restoring = true;
+			if (!restorePool)
+				restorePool.reset(new ThreadPool(1));
+			std::string path = texture.sourcePath;
+			restores.push_back({ key, restorePool->Submit([path]() {
+				TextureImage image;
+				DecodeTexture(path, image);
+				return image;
+			}) });
+		}
+	}
+	return texture.name;
+}
+
+unsigned int TextureCache::Pin(unsigned int key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = textures.find(key);
+	if (it == textures.end())
+		return 0;
+	it->second.pinned = true;
+	return it->second.name;
+}
+
+bool TextureCache::CanEvict(const CachedTexture& texture) const
+{
+	if (texture.pinned || texture.restoring || texture.isHDR || frame - texture.lastUsedFrame < budgetUnusedFrames)
+		return false;
+	int top = texture.evictedLevels + 1;
+	if (top >= texture.storage.Levels() || std::max(texture.storage.width, texture.storage.height) >> top < kMinEvictedSize)
+		return false;
+	return !TextureStreamer::Instance().IsStreaming(texture.name);
+}
+
+void TextureCache::EvictLevels(CachedTexture& texture, int count)
+{
+	if (count <= 0)
+		return;
+
+	const TextureStorage& storage = texture.storage;
+	int first = texture.evictedLevels + count;
+	unsigned int name = CreateTexture(std::max(storage.width >> first, 1), std::max(storage.height >> first, 1),
+		storage.Levels() - first, storage.internalFormat);
+	CopyLevels(texture.name, texture.evictedLevels, name, first, storage, first);
+	glDeleteTextures(1, &texture.name);
+	texture.name = name;
+
+	size_t freed = storage.Bytes(texture.evictedLevels) - storage.Bytes(first);
+	if (texture.evictedLevels == 0)
+		stats.evictedTextures++;
+	texture.evictedLevels = first;
+	stats.residentBytes -= freed;
+	stats.evictedBytes += freed;
+}
+
+void TextureCache::FinishRestore(unsigned int key, TextureImage& image)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = textures.find(key);
+	if (it == textures.end())
+		return;
+	CachedTexture& texture = it->second;
+
+	auto owned = std::make_shared<TextureImage>(std::move(image));
+	TextureStreamSource source;
+	TextureStorage storage;
+	bool matches = DescribeLevels(owned, source, storage) && storage.width == texture.storage.width &&
+		storage.height == texture.storage.height && storage.internalFormat == texture.storage.internalFormat &&
+		storage.Levels() == texture.storage.Levels();
+	if (texture.pinned || !matches) {
+		// Left restoring, so it is neither retried nor evicted further
+		if (!matches)
+			std::cerr << "Failed to restore evicted texture: " << texture.sourcePath << std::endl;
+		return;
+	}
+
+	// The resident levels are copied on the GPU, only the evicted ones are streamed from the file
+	unsigned int name = CreateTexture(storage.width, storage.height, storage.Levels(), storage.internalFormat);
+	CopyLevels(texture.name, texture.evictedLevels, name, 0, storage, texture.evictedLevels);
+	glDeleteTextures(1, &texture.name);
+	source.owner = owned;
+	TextureStreamer::Instance().Enqueue(name, std::move(source), storage.Levels() - texture.evictedLevels);
+
+	size_t restored = storage.Bytes() - storage.Bytes(texture.evictedLevels);
+	texture.name = name;
+	texture.evictedLevels = 0;
+	texture.restoring = false;
+	stats.evictedTextures--;
+	stats.restoredBytes += restored;
+	AddResidentBytes(restored);
+}
+
+void TextureCache::CopyLevels(unsigned int source, int sourceBase, unsigned int target, int targetBase, const TextureStorage& storage, int firstLevel)
+{
+	for (int level = firstLevel; level < storage.Levels(); level++) {
+		glCopyImageSubData(source, GL_TEXTURE_2D, level - sourceBase, 0, 0, 0, target, GL_TEXTURE_2D, level - targetBase, 0, 0, 0,
+			std::max(storage.width >> level, 1), std::max(storage.height >> level, 1), 1);
+	}
+}
+
+unsigned int TextureCache::UploadTexture(const TextureImage& image, TextureStorage& storage)
+{
+	if (image.IsCompressed())
+		return UploadCompressedTexture(image.compressed, storage);
+	if (!image.pixels)
+		return 0;
+
+	GLenum format;
+	PixelFormat(image, format, storage.internalFormat);
+	GLenum dataType = image.isHDR ? GL_UNSIGNED_INT_5_9_9_9_REV : GL_UNSIGNED_BYTE;
+	GLsizei levels = image.isHDR ? 1 : static_cast<GLsizei>(image.mips.LevelCount());
+	storage.width = image.width;
+	storage.height = image.height;
+
+	unsigned int textureID = CreateTexture(image.width, image.height, levels, storage.internalFormat);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of 1 and 3 component images are not 4-byte aligned
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, dataType, image.pixels.get());
+	storage.levelBytes.push_back(static_cast<size_t>(image.width) * image.height * (image.isHDR ? sizeof(uint32_t) : image.components));
+	if (!image.isHDR) {
+		for (size_t i = 0; i < image.mips.levels.size(); i++) {
+			const MipLevel& level = image.mips.levels[i];
+			glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(i + 1), 0, 0, level.width, level.height, format, dataType,
+				image.mips.data.data() + level.offset);
+			storage.levelBytes.push_back(level.size);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	return textureID;
+}
+
+unsigned int TextureCache::UploadCompressedTexture(const CompressedImage& image, TextureStorage& storage)
+{
+	storage.width = image.width;
+	storage.height = image.height;
+	storage.internalFormat = CompressedFormat(image.format);
+
+	// A partial chain gets storage for just its levels, so it is still complete
+	unsigned int textureID = CreateTexture(image.width, image.height, static_cast<GLsizei>(image.levels.size()), storage.internalFormat);
+	for (size_t i = 0; i < image.levels.size(); i++) {
+		const CompressedLevel& level = image.levels[i];
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), 0, 0, level.width, level.height, storage.internalFormat,
+			static_cast<GLsizei>(level.size), image.data.data() + level.offset);
+		storage.levelBytes.push_back(level.size);
+	}
+	return textureID;
+}
+
+unsigned int TextureCache::StreamTexture(TextureImage&& image, TextureStorage& storage)
+{
+	// Owned by the stream until its last level is uploaded
+	auto owned = std::make_shared<TextureImage>(std::move(image));
+	TextureStreamSource source;
+	if (!DescribeLevels(owned, source, storage))
+		return 0;
+
+	unsigned int textureID = CreateTexture(storage.width, storage.height, storage.Levels(), storage.internalFormat);
+	source.owner = owned;
+	TextureStreamer::Instance().Enqueue(textureID, std::move(source));
+	return textureID;
+}
+
+bool TextureCache::DescribeLevels(const std::shared_ptr<TextureImage>& image, TextureStreamSource& source, TextureStorage& storage)
+{
+	if (image->IsCompressed()) {
+		source.compressed = true;
+		source.format = storage.internalFormat = CompressedFormat(image->compressed.format);
+		for (const CompressedLevel& level : image->compressed.levels)
+			source.levels.push_back({ level.width, level.height, image->compressed.data.data() + level.offset, level.size });
+	}
+	else if (image->pixels && !image->isHDR) {
+		PixelFormat(*image, source.format, storage.internalFormat);
+		source.levels.push_back({ image->width, image->height, static_cast<const uint8_t*>(image->pixels.get()),
+			static_cast<size_t>(image->width) * image->height * image->components });
+		for (const MipLevel& level : image->mips.levels)
+			source.levels.push_back({ level.width, level.height, image->mips.data.data() + level.offset, level.size });
+	}
+	else {
+		return false;
+	}
+
+	storage.width = image->width;
+	storage.height = image->height;
+	for (const StreamLevel& level : source.levels)
+		storage.levelBytes.push_back(level.size);
+	return true;
+}
+
+unsigned int TextureCache::CreateTexture(int width, int height, GLsizei levels, GLenum internalFormat)
+{
+	unsigned int textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// A single level with a mipmapped min filter would leave the texture incomplete
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return textureID;
+}
+
+void TextureCache::PixelFormat(const TextureImage& image, GLenum& format, GLenum& internalFormat)
+{
+	format = GL_RGBA;
+	internalFormat = GL_RGBA8;
+	if (image.components == 1) { format = GL_RED; internalFormat = GL_R8; }
+	else if (image.components == 2) { format = GL_RG; internalFormat = GL_RG8; }
+	else if (image.components == 3) { format = GL_RGB; internalFormat = GL_RGB8; }
+	else if (image.components == 4) { format = GL_RGBA; internalFormat = GL_RGBA8; }
+	else std::cerr << "Invalid texture format: Unsupported number of components!\n";
+
+	// Shared exponent format for HDR, without mip chain: the RGBE files convert to it exactly, in 4 bytes per pixel
+	if (image.isHDR)
+		internalFormat = GL_RGB9_E5;
+}
+
+GLenum TextureCache::CompressedFormat(BlockFormat format)
+{
+	switch (format) {
+	case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+	case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+	default: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+}
+
+#endif // !TEXTURE_CACHE_H
@@ -0,0 +1,255 @@
+// Offline side of the block compressed texture pipeline: picks a BCn format from the texture's role
+// and writes a .dds next to the source image, which the loaders then prefer (see PreferCompressedTexture).
+//   normal maps (*_ddn, *_normal, *_nrm)                -> BC5, the shader rebuilds z
+//   single channel maps (roughness, metallic, ao, ...)   -> BC4, sampled as .r
+//   color maps                                           -> BC1 when opaque, BC7 with alpha
+// Like the mesh cache, a .dds older than its source or written by an older pipeline version is rebuilt.
+// Mip levels are filtered in linear space by mip_generator.h (sRGB decoded color, renormalized normals).
+//
+// PBR materials get an import step as well: PackORMTexture packs a material's ao, roughness and metallic maps
+// into the channels of one BC7 orm.dds, one texture fetch instead of three.
+//
+// Usage Example:
+// std::string path = PreferCompressedTexture("res/textures/pbr/rusted_iron/normal.png", true); // writes normal.dds once
+// TextureHandle normal = TextureCache::Instance().Load(path);
+// TextureHandle orm = TextureCache::Instance().Load(PackORMTexture("res/textures/pbr/rusted_iron")); // writes orm.dds once
+
+#pragma once
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "block_compression.h"
+#include "dds_file.h"
+#include "mapped_file.h"
+#include "mip_generator.h"
+#include "png_decoder.h"
+
+// Stored in the .dds files CompressTextureFile writes, bump it when their contents change
+// 1: box filtered mips in gamma space, 2: mip_generator.h
+constexpr uint32_t kTextureCompressionVersion = 2;
+
+enum class TextureRole
+{
+	Color,  // albedo, diffuse, specular color
+	Normal, // tangent space normal map
+	Scalar, // one meaningful channel
+};
+
+// Guesses the role from the file name, e.g. "arm_showroom_ddn.png" is a normal map, "roughness.png" a scalar map.
+inline TextureRole GuessTextureRole(const std::string& path)
+{
+	std::string stem = std::filesystem::path(path).stem().string();
+	std::transform(stem.begin(), stem.end(), stem.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	// The whole name or its last '_' / '-' separated word
+	size_t separator = stem.find_last_of("_-");
+	std::string word = separator == std::string::npos ? stem : stem.substr(separator + 1);
+
+	for (const char* normal : { "ddn", "normal", "nrm", "norm" }) {
+		if (word == normal)
+			return TextureRole::Normal;
+	}
+	for (const char* scalar : { "roughness", "rough", "metallic", "metalness", "metal", "ao", "occlusion", "height", "disp" }) {
+		if (word == scalar)
+			return TextureRole::Scalar;
+	}
+	return TextureRole::Color;
+}
+
+inline MipFilter ChooseMipFilter(TextureRole role)
+{
+	switch (role) {
+	case TextureRole::Normal: return MipFilter::Normal;
+	case TextureRole::Scalar: return MipFilter::Linear;
+	default: return MipFilter::Color;
+	}
+}
+
+inline BlockFormat ChooseBlockFormat(TextureRole role, bool hasAlpha)
+{
+	switch (role) {
+	case TextureRole::Normal: return BlockFormat::BC5;
+	case TextureRole::Scalar: return BlockFormat::BC4;
+	default: return hasAlpha ? BlockFormat::BC7 : BlockFormat::BC1;
+	}
+}
+
+// The .dds path that stands in for an image file: same directory and name
+inline std::string CompressedTexturePath(const std::string& path)
+{
+	return std::filesystem::path(path).replace_extension(".dds").string();
+}
+
+inline bool IsCompressedTexturePath(const std::string& path)
+{
+	std::string extension = std::filesystem::path(path).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return extension == ".dds";
+}
+
+// True if compressedPath exists and is not older than any of sources (those that are gone are ignored).
+// A .dds this pipeline wrote with an older kTextureCompressionVersion is outdated too, and so is one without the
+// writer tag while a source exists: the first writer did not tag its files. Only an untagged .dds with none of
+// its sources beside it is taken as another tool's and kept.
+inline bool IsCompressedTextureCurrent(const std::string& compressedPath, const std::vector<std::string>& sources)
+{
+	std::error_code ec;
+	auto compressedTime = std::filesystem::last_write_time(compressedPath, ec);
+	if (ec)
+		return false;
+	bool hasSource = false;
+	for (const std::string& source : sources) {
+		auto sourceTime = std::filesystem::last_write_time(source, ec);
+		if (ec)
+			continue;
+		hasSource = true;
+		if (compressedTime < sourceTime)
+			return false;
+	}
+
+	MappedFile file(compressedPath);
+	uint32_t version = file.IsOpen() ? ReadDDSWriterVersion(file.Data(), file.Size()) : 0;
+	return version == 0 ? !hasSource : version >= kTextureCompressionVersion;
+}
+
+// True if the .dds for path exists and is up to date, see IsCompressedTextureCurrent
+inline bool HasCurrentCompressedTexture(const std::string& path)
+{
+	return IsCompressedTextureCurrent(CompressedTexturePath(path), { path });
+}
+
+/**
+ * Decodes an image file and writes its block compressed .dds (full mip chain) beside it.
+ * CPU only, safe to call from worker threads.
+ *
+ * @return false if the source can not be decoded or the .dds not written.
+ */
+inline bool CompressTextureFile(const std::string& path)
+{
+	int width = 0, height = 0, components = 0;
+	MappedFile file(path);
+	unsigned char* pixels = file.IsOpen() ? DecodeImage(reinterpret_cast<const uint8_t*>(file.Data()), file.Size(), width, height, components) : nullptr;
+	if (!pixels) {
+		std::cerr << "Texture failed to load at path: " << path << std::endl;
+		return false;
+	}
+
+	bool hasAlpha = false;
+	if (components == 2 || components == 4) {
+		for (size_t i = 0; i < static_cast<size_t>(width) * height && !hasAlpha; i++)
+			hasAlpha = pixels[i * components + components - 1] != 255;
+	}
+
+	TextureRole role = GuessTextureRole(path);
+	CompressedImage image;
+	CompressImage(pixels, width, height, components, ChooseBlockFormat(role, hasAlpha), image, ChooseMipFilter(role));
+	stbi_image_free(pixels);
+
+	std::string compressedPath = CompressedTexturePath(path);
+	if (!WriteDDS(compressedPath, image, kTextureCompressionVersion)) {
+		std::cerr << "Failed to write compressed texture: " << compressedPath << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Returns the up to date .dds for path if there is one (building it first when compress is set), else path itself.
+inline std::string PreferCompressedTexture(const std::string& path, bool compress = false)
+{
+	if (IsCompressedTexturePath(path))
+		return path;
+	if (HasCurrentCompressedTexture(path) || (compress && CompressTextureFile(path)))
+		return CompressedTexturePath(path);
+	return path;
+}
+
+/**
+ * Packs the ao.png, roughness.png and metallic.png of a PBR material directory into orm.dds beside them:
+ * R = ambient occlusion, G = roughness, B = metallic, BC7 with a linearly filtered mip chain.
+ * A missing map takes its neutral value (no occlusion, fully rough, not metallic); maps smaller than the
+ * largest one are sampled bilinearly, wrapping like GL_REPEAT. Does nothing while orm.dds is up to date.
+ *
+ * @return the orm.dds path, empty if none of the maps can be loaded or the file not written.
+ */
+inline std::string PackORMTexture(const std::string& directory)
+{
+	std::filesystem::path root(directory);
+	std::string ormPath = (root / "orm.dds").generic_string();
+	std::vector<std::string> maps = { (root / "ao.png").generic_string(), (root / "roughness.png").generic_string(),
+		(root / "metallic.png").generic_string() };
+	if (IsCompressedTextureCurrent(ormPath, maps))
+		return ormPath;
+
+	// Grayscale, the maps are single channel data stored as RGB
+	struct Channel
+	{
+		unsigned char* pixels = nullptr;
+		int width = 0, height = 0;
+
+		uint8_t At(int x, int y) const { return pixels[static_cast<size_t>((y + height) % height) * width + (x + width) % width]; }
+	};
+	Channel channels[3];
+	int width = 0, height = 0, components;
+	for (int c = 0; c < 3; c++) {
+		channels[c].pixels = stbi_load(maps[c].c_str(), &channels[c].width, &channels[c].height, &components, 1);
+		if (channels[c].pixels && channels[c].width * channels[c].height > width * height) {
+			width = channels[c].width;
+			height = channels[c].height;
+		}
+	}
+	if (width == 0) {
+		std::cerr << "No ao, roughness or metallic map in " << directory << std::endl;
+		return std::string();
+	}
+
+	const unsigned char neutral[3] = { 255, 255, 0 };
+	std::vector<uint8_t> orm(static_cast<size_t>(width) * height * 3);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			uint8_t* texel = orm.data() + (static_cast<size_t>(y) * width + x) * 3;
+			for (int c = 0; c < 3; c++) {
+				const Channel& channel = channels[c];
+				if (!channel.pixels) {
+					texel[c] = neutral[c];
+					continue;
+				}
+				if (channel.width == width && channel.height == height) {
+					texel[c] = channel.At(x, y);
+					continue;
+				}
+				float u = (x + 0.5f) * channel.width / width - 0.5f, v = (y + 0.5f) * channel.height / height - 0.5f;
+				int x0 = static_cast<int>(std::floor(u)), y0 = static_cast<int>(std::floor(v));
+				float fx = u - x0, fy = v - y0;
+				float top = channel.At(x0, y0) * (1.0f - fx) + channel.At(x0 + 1, y0) * fx;
+				float bottom = channel.At(x0, y0 + 1) * (1.0f - fx) + channel.At(x0 + 1, y0 + 1) * fx;
+				texel[c] = static_cast<uint8_t>(top * (1.0f - fy) + bottom * fy + 0.5f);
+			}
+		}
+	}
+	for (Channel& channel : channels)
+		stbi_image_free(channel.pixels);
+
+	CompressedImage image;
+	CompressImage(orm.data(), width, height, 3, BlockFormat::BC7, image, MipFilter::Linear);
+	if (!WriteDDS(ormPath, image, kTextureCompressionVersion)) {
+		std::cerr << "Failed to write compressed texture: " << ormPath << std::endl;
+		return std::string();
+	}
+	return ormPath;
+}
+
+#endif // !TEXTURE_COMPRESSION_H
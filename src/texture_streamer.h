@@ -0,0 +1,313 @@
+// Streams texture mip levels to the GPU a little per frame, coarsest first, so big textures never stall a frame.
+// A streamed texture has immutable storage for its whole chain from the start. Enqueue uploads the small mip tail
+// straight away and sets GL_TEXTURE_BASE_LEVEL to the finest level of it, so the texture can be drawn at once at
+// low resolution. Update copies the remaining levels, in strips of rows, through a ring of persistently mapped
+// pixel buffer slots, each guarded by a fence: a slot the GPU is still reading from ends the frame's streaming
+// instead of waiting for it. Each completed level lowers the base level and the texture sharpens.
+//
+// Usage Example:
+// TextureHandle albedo = TextureCache::Instance().Stream("res/models/planet/mars.png");
+// while (rendering) {
+//     TextureStreamer::Instance().Update(2 * 1024 * 1024); // at most 2 MB of texels this frame
+//     glBindTexture(GL_TEXTURE_2D, albedo.Use());
+//     ...
+// }
+//
+// GL thread only.
+
+#pragma once
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <GL/gl3w.h>
+
+// One mip level of a streamed texture, rows tightly packed
+struct StreamLevel
+{
+	int width = 0, height = 0;
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+};
+
+struct TextureStreamSource
+{
+	bool compressed = false;           // 4x4 blocks, format is then the compressed internal format
+	GLenum format = GL_RGBA;
+	GLenum type = GL_UNSIGNED_BYTE;
+	std::vector<StreamLevel> levels;   // level 0 first
+	std::shared_ptr<const void> owner; // keeps the level data alive, released after the last level
+};
+
+struct TextureStreamStats
+{
+	size_t textures = 0;        // still streaming
+	size_t immediateBytes = 0;  // mip tails uploaded by Enqueue
+	size_t streamedBytes = 0;   // copied through the buffer ring
+	size_t completedLevels = 0;
+	size_t fenceStalls = 0;     // Update calls ended early by a slot still in use
+};
+
+class TextureStreamer
+{
+public:
+	static TextureStreamer& Instance() { static TextureStreamer streamer; return streamer; }
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	static constexpr size_t kSlotCount = 8;
+	static constexpr size_t kSlotBytes = 1024 * 1024;     // largest strip, a row must fit
+	static constexpr size_t kImmediateBytes = 64 * 1024;  // mip tail uploaded by Enqueue, e.g. 128x128 RGBA and below
+
+	/**
+	 * Uploads the mip tail of source and queues the rest for Update.
+	 *
+	 * @param texture Texture with immutable storage (glTexStorage2D) for all of source.levels.
+	 * @param residentLevels Coarsest levels the texture already holds, e.g. copied from an evicted copy.
+	 *                       When not 0 nothing is uploaded right away, the base level starts at the finest of them.
+	 */
+	void Enqueue(unsigned int texture, TextureStreamSource source, int residentLevels = 0);
+
+	// Forgets the levels of texture not uploaded yet, e.g. before it is deleted
+	void Cancel(unsigned int texture);
+
+	/**
+	 * Uploads queued levels until byteBudget bytes are copied, the coarsest pending level of all
+	 * textures first. Call once per frame. Never waits on the GPU; at least one strip is copied
+	 * when a slot is free, so a single strip may exceed the budget.
+	 */
+	void Update(size_t byteBudget);
+
+	// Uploads everything still queued right away, from client memory
+	void Finish();
+
+	bool IsBusy() const { return !streaming.empty(); }
+	bool IsStreaming(unsigned int texture) const;
+	TextureStreamStats GetStats() const;
+	void PrintStats() const;
+
+private:
+	TextureStreamer() = default;
+
+	struct StreamingTexture
+	{
+		unsigned int id = 0;
+		TextureStreamSource source;
+		int level = 0; // next level to upload, counts down to 0
+		int row = 0;   // rows of it done, in block rows for compressed textures
+	};
+
+	bool CreateRing();
+
+	// Rows are single texel rows, or rows of 4x4 blocks for compressed formats
+	static int RowCount(const TextureStreamSource& source, int level);
+	static size_t RowBytes(const TextureStreamSource& source, int level) { return source.levels[level].size / RowCount(source, level); }
+
+	// Uploads rows [row, row + rows) of level into the bound texture, pixels is a pointer or a pixel buffer offset
+	static void UploadRows(const TextureStreamSource& source, int level, int row, int rows, const void* pixels);
+
+	// Marks level of the bound texture complete
+	void CompleteLevel(StreamingTexture& texture);
+
+private:
+	std::vector<StreamingTexture> streaming;
+	unsigned int ring = 0;
+	uint8_t* mapped = nullptr;
+	GLsync fences[kSlotCount] = {};
+	size_t nextSlot = 0;
+	TextureStreamStats stats;
+};
+
+void TextureStreamer::Enqueue(unsigned int texture, TextureStreamSource source, int residentLevels)
+{
+	if (static_cast<int>(source.levels.size()) <= residentLevels)
+		return;
+
+	StreamingTexture entry;
+	entry.id = texture;
+	entry.level = static_cast<int>(source.levels.size()) - 1 - residentLevels;
+	entry.source = std::move(source);
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	if (residentLevels > 0) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.level + 1);
+		streaming.push_back(std::move(entry));
+		return;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	// The coarsest level always, then finer ones while they fit
+	size_t immediate = 0;
+	while (entry.level >= 0 && (immediate == 0 || immediate + entry.source.levels[entry.level].size <= kImmediateBytes)) {
+		immediate += entry.source.levels[entry.level].size;
+		UploadRows(entry.source, entry.level, 0, RowCount(entry.source, entry.level), entry.source.levels[entry.level].data);
+		CompleteLevel(entry);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	stats.immediateBytes += immediate;
+
+	if (entry.level >= 0)
+		streaming.push_back(std::move(entry));
+}
+
+void TextureStreamer::Cancel(unsigned int texture)
+{
+	streaming.erase(std::remove_if(streaming.begin(), streaming.end(),
+		[texture](const StreamingTexture& entry) { return entry.id == texture; }), streaming.end());
+}
+
+void TextureStreamer::Update(size_t byteBudget)
+{
+	if (streaming.empty())
+		return;
+	if (ring == 0 && !CreateRing()) {
+		Finish();
+		return;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	size_t spent = 0;
+	while (!streaming.empty() && spent < byteBudget) {
+		// The GPU may still be copying out of the slot from a few strips ago
+		GLsync& fence = fences[nextSlot];
+		if (fence) {
+			if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+				stats.fenceStalls++;
+				break;
+			}
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+
+		auto next = std::min_element(streaming.begin(), streaming.end(), [](const StreamingTexture& a, const StreamingTexture& b) {
+			return a.source.levels[a.level].size < b.source.levels[b.level].size;
+		});
+		StreamingTexture& texture = *next;
+		const StreamLevel& level = texture.source.levels[texture.level];
+
+		// As many rows as fit in the slot and the rest of the budget, at least one
+		size_t rowBytes = RowBytes(texture.source, texture.level);
+		size_t byteLimit = std::min(kSlotBytes, std::max(byteBudget - spent, rowBytes));
+		int rows = std::min(RowCount(texture.source, texture.level) - texture.row, std::max(static_cast<int>(byteLimit / rowBytes), 1));
+		size_t bytes = rows * rowBytes;
+		size_t offset = nextSlot * kSlotBytes;
+
+		std::memcpy(mapped + offset, level.data + texture.row * rowBytes, bytes);
+		glBindTexture(GL_TEXTURE_2D, texture.id);
+		UploadRows(texture.source, texture.level, texture.row, rows, reinterpret_cast<const void*>(offset));
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		nextSlot = (nextSlot + 1) % kSlotCount;
+		spent += bytes;
+		stats.streamedBytes += bytes;
+
+		texture.row += rows;
+		if (texture.row == RowCount(texture.source, texture.level)) {
+			CompleteLevel(texture);
+			if (texture.level < 0)
+				streaming.erase(next);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::Finish()
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (StreamingTexture& texture : streaming) {
+		glBindTexture(GL_TEXTURE_2D, texture.id);
+		while (texture.level >= 0) {
+			size_t rowBytes = RowBytes(texture.source, texture.level);
+			int rows = RowCount(texture.source, texture.level) - texture.row;
+			UploadRows(texture.source, texture.level, texture.row, rows, texture.source.levels[texture.level].data + texture.row * rowBytes);
+			stats.immediateBytes += rows * rowBytes;
+			CompleteLevel(texture);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	streaming.clear();
+}
+
+bool TextureStreamer::IsStreaming(unsigned int texture) const
+{
+	return std::any_of(streaming.begin(), streaming.end(), [texture](const StreamingTexture& entry) { return entry.id == texture; });
+}
+
+TextureStreamStats TextureStreamer::GetStats() const
+{
+	TextureStreamStats current = stats;
+	current.textures = streaming.size();
+	return current;
+}
+
+void TextureStreamer::PrintStats() const
+{
+	TextureStreamStats current = GetStats();
+	std::cout << "texture streamer: " << current.textures << " textures streaming, " << current.completedLevels << " levels done, "
+		<< current.immediateBytes / (1024.0 * 1024.0) << " MB immediate, " << current.streamedBytes / (1024.0 * 1024.0)
+		<< " MB streamed, " << current.fenceStalls << " fence stalls\n";
+}
+
+bool TextureStreamer::CreateRing()
+{
+	GLsizeiptr size = static_cast<GLsizeiptr>(kSlotCount * kSlotBytes);
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &ring);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+	mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (!mapped) {
+		std::cerr << "Failed to map the texture streaming buffer, uploading textures directly\n";
+		glDeleteBuffers(1, &ring);
+		ring = 0;
+		return false;
+	}
+	return true;
+}
+
+int TextureStreamer::RowCount(const TextureStreamSource& source, int level)
+{
+	int height = source.levels[level].height;
+	return source.compressed ? (height + 3) / 4 : height;
+}
+
+void TextureStreamer::UploadRows(const TextureStreamSource& source, int level, int row, int rows, const void* pixels)
+{
+	const StreamLevel& data = source.levels[level];
+	int unit = source.compressed ? 4 : 1;
+	int y = row * unit;
+	int height = std::min(rows * unit, data.height - y);
+	if (source.compressed) {
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, data.width, height, source.format,
+			static_cast<GLsizei>(rows * RowBytes(source, level)), pixels);
+	}
+	else {
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, y, data.width, height, source.format, source.type, pixels);
+	}
+}
+
+void TextureStreamer::CompleteLevel(StreamingTexture& texture)
+{
+	// Commands run in order, so draws issued after this sample the new level
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.level);
+	stats.completedLevels++;
+	texture.level--;
+	texture.row = 0;
+	if (texture.level < 0)
+		texture.source = TextureStreamSource(); // the texture is complete, drop the data
+}
+
+#endif // !TEXTURE_STREAMER_H
@@ -0,0 +1,101 @@
+// A fixed-size pool of worker threads consuming a FIFO task queue.
+// Used by the loaders for CPU-only work (parsing, decoding); tasks must not touch OpenGL,
+// the GL context stays current on the main thread only.
+//
+// Usage Example:
+// ThreadPool pool(4);
+// std::future<int> result = pool.Submit([]() { return 42; });
+// int value = result.get();
+
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// threadCount == 0 uses one thread per hardware thread
+	explicit ThreadPool(unsigned int threadCount = 0)
+	{
+		if (threadCount == 0)
+			threadCount = HardwareThreads();
+		workers.reserve(threadCount);
+		for (unsigned int i = 0; i < threadCount; i++)
+			workers.emplace_back([this]() { WorkerLoop(); });
+	}
+
+	// Finishes every queued task, then joins the workers
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Queues task and returns a future for its result. Exceptions thrown by the task
+	// are rethrown from future::get().
+	template<typename F>
+	auto Submit(F&& task) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+	{
+		using Result = std::invoke_result_t<std::decay_t<F>>;
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		std::future<Result> future = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.emplace([packaged]() { (*packaged)(); });
+		}
+		condition.notify_one();
+		return future;
+	}
+
+	unsigned int Size() const { return static_cast<unsigned int>(workers.size()); }
+
+	static unsigned int HardwareThreads()
+	{
+		unsigned int count = std::thread::hardware_concurrency();
+		return count > 0 ? count : 1;
+	}
+
+private:
+	void WorkerLoop()
+	{
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+				if (tasks.empty())
+					return; // stopping and drained
+				task = std::move(tasks.front());
+				tasks.pop();
+			}
+			task();
+		}
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping = false;
+};
+
+#endif // !THREAD_POOL_H
@@ -0,0 +1,140 @@
+// Compact 16-byte vertex layout used by Mesh when quantization is enabled:
+//   position  3 x unorm16 inside the mesh AABB (dequantized with positionScale/positionOffset)
+//   normal    2 x snorm16 octahedral encoding
+//   texCoords 2 x half float
+// compared with 32 bytes for the float Vertex.
+//
+// GLSL side (see res/shaders/nanosuit.vert):
+//   vec3 position = aPos * positionScale.xyz + positionOffset;
+//   vec3 normal = positionScale.w > 0.5 ? OctDecode(aNormal.xy) : aNormal;
+
+#pragma once
+#ifndef VERTEX_QUANTIZATION_H
+#define VERTEX_QUANTIZATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+struct QuantizedVertex
+{
+	uint16_t position[3];  // unorm16 within the mesh bounds
+	uint16_t padding;
+	int16_t normal[2];     // octahedral, snorm16
+	uint16_t texCoords[2]; // half float
+};
+static_assert(sizeof(QuantizedVertex) == 16, "QuantizedVertex must stay 16 bytes");
+
+// Largest deviation of the dequantized data from the float vertices
+struct QuantizationError
+{
+	float maxPosition = 0.0f;      // object space units
+	float maxNormalDegrees = 0.0f;
+	float maxTexCoord = 0.0f;
+};
+
+// Maps a unit vector onto the octahedron unfolded into [-1, 1]^2
+inline glm::vec2 OctEncode(glm::vec3 n)
+{
+	float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (sum <= 0.0f)
+		return glm::vec2(0.0f);
+	n /= sum;
+
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f) {
+		e = glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return e;
+}
+
+inline glm::vec3 OctDecode(glm::vec2 e)
+{
+	glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+	float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+template<typename VertexType>
+void ComputeBounds(const std::vector<VertexType>& vertices, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+	boundsMin = vertices.empty() ? glm::vec3(0.0f) : vertices[0].position;
+	boundsMax = boundsMin;
+	for (const VertexType& vertex : vertices) {
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+}
+
+/**
+ * Packs float vertices into QuantizedVertex.
+ *
+ * @param scale Receives the AABB extent, position = unorm * scale + offset.
+ * @param offset Receives the AABB minimum.
+ */
+template<typename VertexType>
+void QuantizeVertices(const std::vector<VertexType>& vertices, std::vector<QuantizedVertex>& quantized,
+	glm::vec3& scale, glm::vec3& offset)
+{
+	glm::vec3 boundsMax;
+	ComputeBounds(vertices, offset, boundsMax);
+	scale = boundsMax - offset;
+
+	glm::vec3 inverseScale(0.0f);
+	for (int axis = 0; axis < 3; axis++)
+		inverseScale[axis] = scale[axis] > 0.0f ? 1.0f / scale[axis] : 0.0f;
+
+	quantized.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const VertexType& vertex = vertices[i];
+		QuantizedVertex& q = quantized[i];
+
+		glm::vec3 unit = glm::clamp((vertex.position - offset) * inverseScale, 0.0f, 1.0f);
+		for (int axis = 0; axis < 3; axis++)
+			q.position[axis] = static_cast<uint16_t>(std::lround(unit[axis] * 65535.0f));
+		q.padding = 0;
+
+		glm::vec2 octahedral = glm::clamp(OctEncode(vertex.normal), -1.0f, 1.0f);
+		q.normal[0] = static_cast<int16_t>(std::lround(octahedral.x * 32767.0f));
+		q.normal[1] = static_cast<int16_t>(std::lround(octahedral.y * 32767.0f));
+
+		q.texCoords[0] = glm::packHalf1x16(vertex.texCoords.x);
+		q.texCoords[1] = glm::packHalf1x16(vertex.texCoords.y);
+	}
+}
+
+// Compares the dequantized vertices (as the shader sees them) with the originals
+template<typename VertexType>
+QuantizationError MeasureQuantizationError(const std::vector<VertexType>& vertices,
+	const std::vector<QuantizedVertex>& quantized, const glm::vec3& scale, const glm::vec3& offset)
+{
+	QuantizationError error;
+	for (size_t i = 0; i < vertices.size() && i < quantized.size(); i++) {
+		const VertexType& vertex = vertices[i];
+		const QuantizedVertex& q = quantized[i];
+
+		glm::vec3 position = glm::vec3(q.position[0], q.position[1], q.position[2]) / 65535.0f * scale + offset;
+		error.maxPosition = std::max(error.maxPosition, glm::length(position - vertex.position));
+
+		float normalLength = glm::length(vertex.normal);
+		if (normalLength > 0.0f) {
+			glm::vec2 octahedral = glm::max(glm::vec2(q.normal[0], q.normal[1]) / 32767.0f, -1.0f);
+			float cosine = glm::clamp(glm::dot(OctDecode(octahedral), vertex.normal / normalLength), -1.0f, 1.0f);
+			error.maxNormalDegrees = std::max(error.maxNormalDegrees, glm::degrees(std::acos(cosine)));
+		}
+
+		glm::vec2 texCoords(glm::unpackHalf1x16(q.texCoords[0]), glm::unpackHalf1x16(q.texCoords[1]));
+		glm::vec2 delta = glm::abs(texCoords - vertex.texCoords);
+		error.maxTexCoord = std::max(error.maxTexCoord, std::max(delta.x, delta.y));
+	}
+	return error;
+}
+
+#endif // !VERTEX_QUANTIZATION_H